@@ -11,9 +11,11 @@
  * microcontroller manufactured by Nanjing Qinheng Microelectronics.
  *******************************************************************************/
 #include <debug.h>
-
-static uint8_t  p_us = 0;
-static uint16_t p_ms = 0;
+#include "timebase.h"
+#include "uart.h"
+#if (PRINT_TARGET == PRINT_TARGET_TFT)
+#include "ili9341.h"
+#endif
 
 #define DEBUG_DATA0_ADDRESS  ((volatile uint32_t*)0xE00000F4)
 #define DEBUG_DATA1_ADDRESS  ((volatile uint32_t*)0xE00000F8)
@@ -21,14 +23,13 @@ static uint16_t p_ms = 0;
 /*********************************************************************
  * @fn      Delay_Init
  *
- * @brief   Initializes Delay Funcation.
+ * @brief   Initializes Delay Funcation, starts the TIM2 timebase.
  *
  * @return  none
  */
 void Delay_Init(void)
 {
-    p_us = SystemCoreClock / 8000000;
-    p_ms = (uint16_t)p_us * 1000;
+    timebase_init();
 }
 
 /*********************************************************************
@@ -42,17 +43,9 @@ void Delay_Init(void)
  */
 void Delay_Us(uint32_t n)
 {
-    uint32_t i;
-
-    SysTick->SR &= ~(1 << 0);
-    i = (uint32_t)n * p_us;
+    uint32_t start = now_us();
 
-    SysTick->CMP = i;
-    SysTick->CNT = 0;
-    SysTick->CTLR |=(1 << 0);
-
-    while((SysTick->SR & (1 << 0)) != (1 << 0));
-    SysTick->CTLR &= ~(1 << 0);
+    while((now_us() - start) < n);
 }
 
 /*********************************************************************
@@ -66,17 +59,10 @@ void Delay_Us(uint32_t n)
  */
 void Delay_Ms(uint32_t n)
 {
-    uint32_t i;
-
-    SysTick->SR &= ~(1 << 0);
-    i = (uint32_t)n * p_ms;
+    uint32_t start = now_us();
 
-    SysTick->CMP = i;
-    SysTick->CNT = 0;
-    SysTick->CTLR |=(1 << 0);
-
-    while((SysTick->SR & (1 << 0)) != (1 << 0));
-    SysTick->CTLR &= ~(1 << 0);
+    n = (n << 10) - (n << 4) - (n << 3);    // x1000
+    while((now_us() - start) < n);
 }
 
 /*********************************************************************
@@ -139,6 +125,9 @@ void USART_Printf_Init(uint32_t baudrate)
 
     USART_Init(USART1, &USART_InitStructure);
     USART_Cmd(USART1, ENABLE);
+
+    // printf goes to the TX ring, sent by DMA1-CH4
+    uart_tx_init();
 }
 
 /*********************************************************************
@@ -172,7 +161,11 @@ int _write(int fd, char *buf, int size)
 {
     int i = 0;
     int writeSize = size;
-#if (SDI_PRINT == SDI_PR_OPEN)
+#if (PRINT_TARGET == PRINT_TARGET_TFT)
+    (void)i;
+    tft_console_write(buf, size);
+
+#elif (SDI_PRINT == SDI_PR_OPEN)
     do
     {
 
@@ -206,12 +199,10 @@ int _write(int fd, char *buf, int size)
     } while (writeSize);
 
 #else
-
-    for(i = 0; i < size; i++){
-        while(USART_GetFlagStatus(USART1, USART_FLAG_TC) == RESET);
-        USART_SendData(USART1, *buf++);
-    }
-
+    // Queued to the TX ring, bytes lost by its overflow policy are counted
+    // there: returning less would make the library write them again.
+    (void)i;
+    uart_write(buf, size);
 
 #endif
     return writeSize;
@@ -39,6 +39,14 @@
 #define SDI_PRINT   SDI_PR_CLOSE
 #endif
 
+/* Printf Target Definition */
+#define PRINT_TARGET_UART  0    // UART or SDI, see SDI_PRINT
+#define PRINT_TARGET_TFT   1    // ILI9341 text console, tft_console_init() first
+
+#ifndef PRINT_TARGET
+#define PRINT_TARGET   PRINT_TARGET_UART
+#endif
+
 void Delay_Init(void);
 void Delay_Us(uint32_t n);
 void Delay_Ms(uint32_t n);
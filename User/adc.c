@@ -0,0 +1,227 @@
+/// \brief Inverter ADC Scan Locked to the TIM1 PWM Carrier
+/// \details ADC1 is triggered by TIM1 TRGO (OC4Ref), DMA1-CH1 is circular
+/// over adc_BUF. HT and TC each handle the 4 sweeps of the settled half:
+///  - the last sweep is published between two _adc_seq increments
+///  - average = (Vout sum of half 0 + Vout sum of half 1) >>3
+///  - iir     = iir + Vout sum of the half - iir >>ADC_IIR_SHIFT
+/// iir holds the value <<(2 +ADC_IIR_SHIFT), 1023 <<6 fits a word.
+
+#include "adc.h"
+#include "ch32v00x_adc.h"
+#include "ch32v00x_dma.h"
+#include "ch32v00x_gpio.h"
+#include "ch32v00x_misc.h"
+#include "ch32v00x_rcc.h"
+#include "ch32v00x_tim.h"
+
+volatile adc_sample_t adc_BUF[ADC_BUF_LEN];
+
+static volatile uint32_t _adc_count;
+static uint16_t _adc_half[2];           // Vout sum of each half of adc_BUF
+static volatile uint16_t _adc_average;
+static volatile uint32_t _adc_iir;
+static volatile adc_sample_t _adc_last; // published sweep
+static volatile uint32_t _adc_seq;      // odd while _adc_last is written
+static adc_hook_t _adc_hook;
+
+//---------------------------------------------------------------------
+// ADC1 scan of Vout, Iout, Vdc, Vrefint (10 Bit ADC), TIM1 TRGO trigger
+//---------------------------------------------------------------------
+static void _adc_init_ADC(void)
+{
+    GPIO_InitTypeDef GPIO_InitStructure = {0};
+    ADC_InitTypeDef  ADC_InitStructure = {0};
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOD, ENABLE);
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+    RCC_ADCCLKConfig(RCC_PCLK2_Div4);
+
+    // ADC_CH4 =PD3, ADC_CH6 =PD6, ADC_CH7 =PD4
+    ADC_DeInit(ADC1);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_3 | GPIO_Pin_4 | GPIO_Pin_6;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;
+    GPIO_Init(GPIOD, &GPIO_InitStructure);
+
+    // ADC1 scan of ADC_CHANNELS, one sweep per TIM1 TRGO
+    ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
+    ADC_InitStructure.ADC_ScanConvMode = ENABLE;
+    ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
+    ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_T1_TRGO;
+    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+    ADC_InitStructure.ADC_NbrOfChannel = ADC_CHANNELS;
+    ADC_Init(ADC1, &ADC_InitStructure);
+
+    // Ranks follow adc_sample_t
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_7, 1, ADC_SampleTime_15Cycles);
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_6, 2, ADC_SampleTime_15Cycles);
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_4, 3, ADC_SampleTime_15Cycles);
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_Vrefint, 4, ADC_SampleTime_30Cycles);
+
+    // Calibration voltage
+    ADC_Calibration_Vol(ADC1, ADC_CALVOL_50PERCENT);
+    ADC_DMACmd(ADC1, ENABLE);
+    ADC_Cmd(ADC1, ENABLE);
+
+    // Reset Calibration
+    ADC_ResetCalibration(ADC1);
+    while(ADC_GetResetCalibrationStatus(ADC1));
+
+    // Start Calibrartion
+    ADC_StartCalibration(ADC1);
+    while(ADC_GetCalibrationStatus(ADC1));
+}
+
+//---------------------------------------------------------------------
+// DMA1-CH1 circular, ADC1 sweeps to adc_BUF
+//---------------------------------------------------------------------
+static void _adc_init_DMA(void)
+{
+    DMA_InitTypeDef DMA_InitStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    DMA_DeInit(DMA1_Channel1);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&ADC1->RDATAR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)adc_BUF;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = ADC_BUF_LEN * ADC_CHANNELS;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA1_Channel1, ENABLE);
+}
+
+//---------------------------------------------------------------------
+// TIM1 CH4 PWM2, no output: OC4Ref rises at CNT =CCR4 as TRGO
+//---------------------------------------------------------------------
+static void _adc_init_trigger(void)
+{
+    TIM_OCInitTypeDef TIM_OCInitStructure = {0};
+
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStructure.TIM_OutputNState = TIM_OutputNState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = ADC_TRIG_DELAY;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC4Init(TIM1, &TIM_OCInitStructure);
+    TIM_OC4PreloadConfig(TIM1, TIM_OCPreload_Enable);
+
+    TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_OC4Ref);
+}
+
+/// \brief Start the scan from TIM1 TRGO
+void adc_init(void)
+{
+    _adc_count = 0;
+    _adc_half[0] = _adc_half[1] = 0;
+    _adc_average = 0;
+    _adc_iir = 0;
+    _adc_seq = 0;
+    _adc_init_ADC();
+    _adc_init_DMA();
+    _adc_init_trigger();
+    ADC_ExternalTrigConvCmd(ADC1, ENABLE);
+}
+
+/// \brief Sweeps converted since adc_init, counted per half buffer
+uint32_t adc_count(void)
+{
+    return _adc_count;
+}
+
+/// \brief Copy the last published sweep, all channels from one scan
+/// \param sample Destination
+void adc_get_sample(adc_sample_t* sample)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = _adc_seq;
+        sample->vout = _adc_last.vout;
+        sample->iout = _adc_last.iout;
+        sample->vdc  = _adc_last.vdc;
+        sample->vref = _adc_last.vref;
+    } while ((seq & 1) || seq != _adc_seq);
+}
+
+/// \brief Function called by the DMA interrupt at each half of adc_BUF
+/// \param hook Function, NULL to remove
+void adc_set_hook(adc_hook_t hook)
+{
+    _adc_hook = hook;
+}
+
+/// \brief Average of Vout over the last ADC_BUF_LEN sweeps, 0 ~ 1023
+uint16_t adc_get_average(void)
+{
+    return _adc_average;
+}
+
+/// \brief First order IIR of Vout, 0 ~ 1023
+uint16_t adc_get_filtered(void)
+{
+    return _adc_iir >> (ADC_BUF_SHIFT - 1 + ADC_IIR_SHIFT);
+}
+
+// Handle the half which DMA does not write: publish, average and IIR
+static void _adc_half_done(uint8_t half)
+{
+    const volatile adc_sample_t* p = &adc_BUF[half ? ADC_BUF_LEN / 2 : 0];
+    uint16_t sum = 0;
+    uint32_t iir = _adc_iir;
+
+    for (uint8_t i = 0; i < ADC_BUF_LEN / 2; i++) sum += p[i].vout;
+    _adc_half[half] = sum;
+
+    p += ADC_BUF_LEN / 2 - 1;
+    _adc_seq++;
+    _adc_last.vout = p->vout;
+    _adc_last.iout = p->iout;
+    _adc_last.vdc  = p->vdc;
+    _adc_last.vref = p->vref;
+    _adc_seq++;
+
+    // Start the IIR at the first half instead of rising from 0
+    if (_adc_count == 0) iir = (uint32_t)sum << ADC_IIR_SHIFT;
+    else iir += sum - (iir >> ADC_IIR_SHIFT);
+
+    _adc_iir = iir;
+    _adc_average = (_adc_half[0] + _adc_half[1]) >> ADC_BUF_SHIFT;
+    _adc_count += ADC_BUF_LEN / 2;
+
+    if (_adc_hook) _adc_hook();
+}
+
+//---------------------------------------------------------------------
+// interrupt for Half and End of adc_BUF
+//---------------------------------------------------------------------
+void DMA1_Channel1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel1_IRQHandler(void)
+{
+    if (DMA_GetITStatus(DMA1_IT_HT1) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_HT1);
+        _adc_half_done(0);
+    }
+
+    if (DMA_GetITStatus(DMA1_IT_TC1) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_TC1);
+        _adc_half_done(1);
+    }
+}
@@ -0,0 +1,76 @@
+/// \brief Inverter ADC Scan Locked to the TIM1 PWM Carrier
+/// \details TIM1 CH4 runs in PWM2 mode with its output disabled. OC4Ref
+/// rises at CNT =CCR4 and, as TIM1 TRGO, starts one scan of the channels
+/// below per PWM period. DMA1-CH1 writes each sweep to an adc_sample_t of
+/// adc_BUF in circular mode, never re-armed. The half and full transfer
+/// interrupts publish the last sweep of the settled half and update the
+/// Vout window and filter, shift only.
+///
+/// | Rank | Channel | Port  | Signal                         |
+/// |------|---------|-------|--------------------------------|
+/// | 1    | A7      | PD4   | Vout, rectified output voltage |
+/// | 2    | A6      | PD6   | Iout, shared with USART1 RX    |
+/// | 3    | A4      | PD3   | Vdc, DC bus divider            |
+/// | 4    | A8      | -     | Vrefint, 1.2V                  |
+///
+/// ADCCLK =PCLK2 /4 =12MHz, conversion =sample time +11 ADCCLK:
+///  - Vout, Iout, Vdc: 15 +11 =26 ADCCLK =2.2us
+///  - Vrefint: 30 +11 =41 ADCCLK =3.4us
+///  - sweep =119 ADCCLK =9.9us, up to 100K sweeps/s
+/// Triggered by the carrier: 15K sweeps/s at 120Hz sine, 49.6K at 400Hz.
+/// The OPA (PA2/PD7 +, PA1/PD0 -) is not used: its inputs are TIM1 pins.
+/// uart_rx_init() takes PD6 back as USART1 RX for the console, Iout is not
+/// valid while the console runs.
+
+#ifndef __ADC_H__
+#define __ADC_H__
+
+#include "ch32v00x.h"
+
+#define ADC_BUF_LEN     8   // sweeps of one DMA cycle, power of two
+#define ADC_BUF_SHIFT   3   // log2(ADC_BUF_LEN)
+#define ADC_IIR_SHIFT   4   // IIR of the half sums, tau =16 halves =4.3ms
+#define ADC_TRIG_DELAY  4   // TIM1 counts from the update to the sweep
+
+/// \brief One sweep, in rank order, 0 ~ 1023
+typedef struct
+{
+    uint16_t vout;
+    uint16_t iout;
+    uint16_t vdc;
+    uint16_t vref;
+} adc_sample_t;
+
+#define ADC_CHANNELS    (sizeof(adc_sample_t) / sizeof(uint16_t))
+
+extern volatile adc_sample_t adc_BUF[ADC_BUF_LEN];
+
+/// \brief Start the scan from TIM1 TRGO
+/// \details TIM1 must be running. The sweep starts ADC_TRIG_DELAY counts
+/// after the update edge where the PWM outputs switch, and is done
+/// before the next one at every SPWM frequency.
+void adc_init(void);
+
+/// \brief Sweeps converted since adc_init, counted per half buffer
+uint32_t adc_count(void);
+
+/// \brief Copy the last published sweep, all channels from one scan
+/// \details Sequence locked, retried if a new sweep is published during
+/// the copy. Up to ADC_BUF_LEN /2 sweeps old.
+void adc_get_sample(adc_sample_t* sample);
+
+/// \brief Average of Vout over the last ADC_BUF_LEN sweeps, 0 ~ 1023
+/// \details Lock free, written as one halfword by the DMA interrupt.
+uint16_t adc_get_average(void);
+
+/// \brief First order IIR of Vout, 0 ~ 1023
+/// \details Lock free, written as one word by the DMA interrupt.
+uint16_t adc_get_filtered(void);
+
+/// \brief Function called by the DMA interrupt at each half of adc_BUF
+/// \details Runs every ADC_BUF_LEN /2 sweeps, after the sweep is
+/// published, NULL to remove.
+typedef void (*adc_hook_t)(void);
+void adc_set_hook(adc_hook_t hook);
+
+#endif  // __ADC_H__
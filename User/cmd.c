@@ -0,0 +1,116 @@
+/// \brief Console Commands of the SPWM Output
+/// \details amp stops the regulation, vout starts it again. While it is
+/// off the sine peak is the one of amp, freq keeps it.
+
+#include "cmd.h"
+#include "console.h"
+#include "control.h"
+#include "fmt.h"
+#include "protect.h"
+#include "sched.h"
+#include "spwm.h"
+#include "uart.h"
+
+static uint16_t _cmd_freq;
+static uint16_t _cmd_amp;   // set by amp, the sine peak while the regulation is off
+static uint8_t _cmd_open;   // 1 = regulation off
+
+// Sine peak now: the commanded one, or the one of the regulation
+static uint16_t _cmd_amplitude(void)
+{
+    return _cmd_open ? _cmd_amp : control_amplitude();
+}
+
+void cmd_init(uint16_t freq_hz)
+{
+    _cmd_freq = freq_hz;
+    _cmd_open = 0;      // _cmd_amp is set by amp first
+}
+
+void cmd_amp(uint8_t argc, const uint32_t* argv)
+{
+    if (argc != 1 || argv[0] > SPWM_Q15_ONE) return;
+    control_stop();
+    _cmd_amp = argv[0];
+    _cmd_open = 1;
+    spwm_set(_cmd_amp, _cmd_freq);
+}
+
+void cmd_freq(uint8_t argc, const uint32_t* argv)
+{
+    if (argc != 1 || argv[0] < SPWM_FREQ_MIN || argv[0] > SPWM_FREQ_MAX) return;
+    _cmd_freq = argv[0];
+    spwm_set(_cmd_amplitude(), _cmd_freq);
+}
+
+void cmd_vout(uint8_t argc, const uint32_t* argv)
+{
+    if (argc != 1 || argv[0] > 1023) return;
+    control_init(argv[0], _cmd_amplitude());
+    _cmd_open = 0;
+}
+
+void cmd_stats(uint8_t argc, const uint32_t* argv)
+{
+    uart_tx_stats_t tx;
+
+    (void)argc;
+    (void)argv;
+    cmd_print_tasks();
+    cmd_print_fault();
+
+    uart_tx_stats(&tx);
+    fmt_print("TX ");
+    fmt_print_dec(tx.queued, 0);
+    fmt_print(" bytes, dropped ");
+    fmt_print_dec(tx.dropped, 0);
+    fmt_print(", overwritten ");
+    fmt_print_dec(tx.overwritten, 0);
+    fmt_print("\r\nRX lost ");
+    fmt_print_dec(uart_rx_lost(), 0);
+    fmt_print(" bytes, ");
+    fmt_print_dec(console_lost(), 0);
+    fmt_print(" lines\r\n");
+}
+
+void cmd_print_tasks(void)
+{
+    for (uint8_t i = 0; i < sched_count(); i++)
+    {
+        const task_stats_t* t = sched_stats(i);
+
+        fmt_print(sched_task(i)->name);
+        fmt_print(": ");
+        fmt_print_dec(t->runs, 0);
+        fmt_print(" runs, WCET ");
+        fmt_print_dec(t->wcet_us, 0);
+        fmt_print(" us, response ");
+        fmt_print_dec(t->response_ms, 0);
+        fmt_print(" ms, overruns ");
+        fmt_print_dec(t->overruns, 0);
+        fmt_print(", misses ");
+        fmt_print_dec(t->misses, 0);
+        fmt_print("\r\n");
+    }
+}
+
+// Latency in TIM1 counts and their length in HCLK: no multiply, the
+// core has none
+void cmd_print_fault(void)
+{
+    protect_fault_t fault;
+
+    protect_get_fault(&fault);
+    if (fault.trips == 0) return;
+
+    fmt_print("trip ");
+    fmt_print_dec(fault.trips, 0);
+    fmt_print(protect_tripped() ? " (off)" : " (on)");
+    fmt_print(": ADC ");
+    fmt_print_dec(fault.value, 0);
+    fmt_print(", latency ");
+    fmt_print_dec(fault.latency, 0);
+    fmt_print(" counts of ");
+    fmt_print_dec(fault.psc + 1, 0);
+    fmt_print(" /48 us\r\n");
+}
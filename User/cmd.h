@@ -0,0 +1,30 @@
+/// \brief Console Commands of the SPWM Output
+/// \details The commands behind the console table of main.c, apart from
+/// the demo select:
+///     amp <0~32768>   sine peak, Q15, the regulation stops
+///     freq <10~400>   sine Hz, at the amplitude of now
+///     vout <0~1023>   regulate ADC1-CH7 to, from the amplitude of now
+///     stats           tasks, last trip, UART counters
+/// A command with arguments out of range does nothing.
+
+#ifndef __CMD_H__
+#define __CMD_H__
+
+#include "ch32v00x.h"
+
+/// \brief Start with the regulation on
+/// \param freq_hz Sine frequency spwm_init() was given
+void cmd_init(uint16_t freq_hz);
+
+void cmd_amp(uint8_t argc, const uint32_t* argv);
+void cmd_freq(uint8_t argc, const uint32_t* argv);
+void cmd_vout(uint8_t argc, const uint32_t* argv);
+void cmd_stats(uint8_t argc, const uint32_t* argv);
+
+/// \brief Print the run statistics of the scheduler tasks
+void cmd_print_tasks(void);
+
+/// \brief Print the last protection trip, nothing before the first one
+void cmd_print_fault(void);
+
+#endif  // __CMD_H__
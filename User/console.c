@@ -0,0 +1,181 @@
+/// \brief Line Oriented Command Console on USART1
+/// \details The FIFO indexes are free running bytes:
+///  - the RX hook writes the line being received from _con_head on, and
+///    moves _con_head past its terminator when the line is complete
+///  - console_poll copies the line at _con_tail out, then moves _con_tail
+/// Each side writes its own index only, no lock is needed.
+
+#include "console.h"
+#include "fmt.h"
+#include "uart.h"
+#include <string.h>
+
+static char _con_fifo[CONSOLE_FIFO];
+static uint8_t _con_wr;                 // next character of the line received
+static uint8_t _con_len;                // characters of the line received
+static uint8_t _con_skip;               // discard up to the end of the line
+static volatile uint8_t _con_head;      // end of the queued lines
+static volatile uint8_t _con_tail;      // start of the next line to run
+static volatile uint16_t _con_lost;
+static const console_cmd_t* _con_cmds;
+static uint8_t _con_count;
+static void (*_con_ready)(void);
+
+// Drop the line received, discard up to its end
+static void _console_drop(void)
+{
+    _con_lost++;
+    _con_skip = 1;
+    _con_wr = _con_head;
+    _con_len = 0;
+}
+
+// RX hook, USART1 and DMA1-CH5 interrupts: cut the characters into lines
+static void _console_rx(void)
+{
+    char buf[8];
+    uint16_t n;
+    uint8_t queued = 0;
+
+    while ((n = uart_read(buf, sizeof(buf))))
+    {
+        for (char* c = buf; n; n--, c++)
+        {
+            if (*c == '\r' || *c == '\n')
+            {
+                if (_con_len && !_con_skip)
+                {
+                    _con_fifo[_con_wr++ & (CONSOLE_FIFO - 1)] = 0;
+                    _con_head = _con_wr;
+                    queued = 1;
+                }
+                _con_wr = _con_head;
+                _con_len = 0;
+                _con_skip = 0;
+            }
+            else if (_con_skip) continue;
+            else if (*c == '\b' || *c == 0x7F)
+            {
+                if (_con_len)
+                {
+                    _con_len--;
+                    _con_wr--;
+                }
+            }
+            // Room for this character and the terminator
+            else if (_con_len >= CONSOLE_LINE - 1 || (uint8_t)(_con_wr - _con_tail) >= CONSOLE_FIFO - 1)
+            {
+                _console_drop();
+            }
+            else
+            {
+                _con_fifo[_con_wr++ & (CONSOLE_FIFO - 1)] = *c;
+                _con_len++;
+            }
+        }
+    }
+    if (queued && _con_ready) _con_ready();
+}
+
+// Cut the next space separated word, terminated in place
+static char* _console_word(char** p)
+{
+    char* w;
+
+    while (**p == ' ') (*p)++;
+    w = *p;
+    while (**p && **p != ' ') (*p)++;
+    if (**p) *(*p)++ = 0;
+    return w;
+}
+
+// Run one line: name [number [number]]
+static void _console_run(char* p)
+{
+    char* name = _console_word(&p);
+    uint32_t argv[CONSOLE_ARGS];
+    uint8_t argc = 0;
+    uint8_t i;
+
+    if (*name == 0) return;
+
+    for (char* w = _console_word(&p); *w; w = _console_word(&p))
+    {
+        uint32_t v = 0;
+        char* d = w;
+
+        for (; *d >= '0' && *d <= '9'; d++) v = (v << 3) + (v << 1) + (*d - '0');
+        if (*d || argc == CONSOLE_ARGS)
+        {
+            fmt_print("? ");
+            fmt_print(w);
+            fmt_print("\r\n");
+            return;
+        }
+        argv[argc++] = v;
+    }
+
+    if (strcmp(name, "help") == 0)
+    {
+        for (i = 0; i < _con_count; i++)
+        {
+            fmt_print(_con_cmds[i].name);
+            fmt_print(" ");
+            fmt_print(_con_cmds[i].help);
+            fmt_print("\r\n");
+        }
+        return;
+    }
+
+    for (i = 0; i < _con_count; i++)
+    {
+        if (strcmp(name, _con_cmds[i].name) == 0)
+        {
+            _con_cmds[i].run(argc, argv);
+            return;
+        }
+    }
+    fmt_print("? ");
+    fmt_print(name);
+    fmt_print("\r\n");
+}
+
+/// \brief Start receiving commands
+/// \param cmds Command table, "help" is built in
+/// \param count Commands in the table
+/// \param ready Called in the RX interrupt when a line is queued, 0 =none
+void console_init(const console_cmd_t* cmds, uint8_t count, void (*ready)(void))
+{
+    _con_cmds = cmds;
+    _con_count = count;
+    _con_ready = ready;
+    _con_wr = _con_head = _con_tail = 0;
+    _con_len = 0;
+    _con_skip = 0;
+    uart_rx_hook(_console_rx);
+}
+
+/// \brief Run the queued lines, from the main loop
+void console_poll(void)
+{
+    char line[CONSOLE_LINE];
+    uint8_t tail = _con_tail;
+    uint8_t i;
+
+    while (tail != _con_head)
+    {
+        // Copy out and free the FIFO before the command runs
+        i = 0;
+        while ((line[i] = _con_fifo[tail++ & (CONSOLE_FIFO - 1)])) i++;
+        _con_tail = tail;
+
+        _console_run(line);
+        fmt_print("> ");
+    }
+}
+
+/// \brief Lines lost: too long, or received while the FIFO was full
+uint16_t console_lost(void)
+{
+    return _con_lost;
+}
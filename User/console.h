@@ -0,0 +1,48 @@
+/// \brief Line Oriented Command Console on USART1
+/// \details Characters arrive by the DMA ring of uart.c. The RX interrupt
+/// hook moves them into a line FIFO at once, so no character is lost while
+/// the main loop is busy: the 32 byte DMA ring only has to be emptied
+/// within the interrupt latency, 2.7ms at 115200. The FIFO holds whole
+/// lines back to back, e.g. 8 commands of 7 characters typed or pasted
+/// during a 50ms LCD step. A line is run by console_poll() from the main
+/// loop:
+///     name [number [number]]
+/// Numbers are unsigned decimal. Backspace and DEL erase, CR or LF ends a
+/// line, a line longer than CONSOLE_LINE -1 is discarded. There is no
+/// echo, use the local echo of the terminal.
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include "ch32v00x.h"
+
+#ifndef CONSOLE_LINE
+#define CONSOLE_LINE    32  // characters of a line, with the terminator
+#endif
+#ifndef CONSOLE_FIFO
+#define CONSOLE_FIFO    64  // characters of the queued lines, power of two
+#endif
+#define CONSOLE_ARGS    2   // numbers after the name
+
+/// \brief Command, called from console_poll()
+typedef struct
+{
+    const char* name;
+    const char* help;   // shown by "help"
+    void (*run)(uint8_t argc, const uint32_t* argv);
+} console_cmd_t;
+
+/// \brief Start receiving commands
+/// \param cmds Command table, "help" is built in
+/// \param count Commands in the table
+/// \param ready Called in the RX interrupt when a line is queued, 0 =none
+/// \details USART1 RX must be running (uart_rx_init).
+void console_init(const console_cmd_t* cmds, uint8_t count, void (*ready)(void));
+
+/// \brief Run the queued lines, from the main loop
+void console_poll(void);
+
+/// \brief Lines lost: too long, or received while the FIFO was full
+uint16_t console_lost(void);
+
+#endif  // __CONSOLE_H__
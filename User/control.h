@@ -0,0 +1,45 @@
+/// \brief Output Voltage Regulation by the Sine Amplitude
+/// \details PI loop run by the SPWM interrupt at each half cycle (0deg and
+/// 180deg). Vout, ADC1-CH7 (PD4), is taken as the rectified and filtered
+/// output voltage feedback; the loop writes the amplitude of the next half.
+/// The loop regulates to a reference which control_update, a task of the
+/// main loop, slews to the target: a soft start at init and after a trip.
+///
+/// Vout needs an RC of 10ms or more after the rectifier. The averages read
+/// at 0deg and 180deg are 2 sweeps apart on the 240Hz ripple (62 periods
+/// per half, 4 sweeps per ADC half): in the plant model of
+/// test/test_control.c the amplitude alternates by half with ~10 counts
+/// of Vout at a 2ms RC, ~2 counts at 10ms.
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include "ch32v00x.h"
+
+// Gains in Q8, Q15 amplitude per ADC count
+#define CONTROL_KP  4096    // 16 per count
+#define CONTROL_KI  1024    // 4 per count and half cycle
+#define CONTROL_SLEW   4    // reference counts per control_update
+
+/// \brief Start regulation
+/// \param target ADC1-CH7 count to regulate to, 0 ~ 1023
+/// \param amplitude_q15 Amplitude the integrator starts from
+/// \details The SPWM and ADC1 must be running.
+void control_init(uint16_t target, uint16_t amplitude_q15);
+
+/// \brief Change the regulated ADC count
+/// \details The reference follows at CONTROL_SLEW per control_update.
+void control_set_target(uint16_t target);
+
+/// \brief Slew the reference to the target, call periodically
+/// \details While the outputs are off by a trip the reference follows
+/// Vout down, the retry ramps up from there. At 10ms: 0 ~ 1023 in 2.6s.
+void control_update(void);
+
+/// \brief Stop regulation, the amplitude stays where it is
+void control_stop(void);
+
+/// \brief Amplitude of the last half cycle, Q15
+uint16_t control_amplitude(void);
+
+#endif  // __CONTROL_H__
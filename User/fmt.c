@@ -0,0 +1,138 @@
+/// \brief Division-free Integer Formatter for CH32V003
+/// \details Subtract-and-compare decimal conversion, no __udivsi3 or
+/// printf from the library. The printf target is reached through _write().
+
+#include "fmt.h"
+
+// Powers of 10, highest first
+static const uint32_t _pow10[10] = {
+    1000000000, 100000000, 10000000, 1000000, 100000,
+    10000, 1000, 100, 10, 1};
+
+// Provided by Debug/debug.c: UART, SDI or the TFT console
+extern int _write(int fd, char* buf, int size);
+
+// Number of decimal digits of value, at least min
+static uint8_t _fmt_digits(uint32_t value, uint8_t min)
+{
+    uint8_t n = 10;
+    while (n > min && value < _pow10[10 - n]) n--;
+    return n;
+}
+
+// Write n digits of value, value must be below 10^n
+static char* _fmt_put_digits(char* p, uint32_t value, uint8_t n)
+{
+    for (const uint32_t* pow = &_pow10[10 - n]; pow < &_pow10[10]; pow++)
+    {
+        char d = '0';
+        while (value >= *pow)
+        {
+            value -= *pow;
+            d++;
+        }
+        *p++ = d;
+    }
+    return p;
+}
+
+// Fill pad characters up to width, for a field of len characters
+static char* _fmt_pad(char* p, uint8_t len, uint8_t width, char pad)
+{
+    if (width > FMT_LEN) width = FMT_LEN;
+    while (len < width)
+    {
+        *p++ = pad;
+        len++;
+    }
+    return p;
+}
+
+/// \brief Format an Unsigned Decimal
+uint8_t fmt_dec(char* buf, uint32_t value, uint8_t width, char pad)
+{
+    uint8_t n = _fmt_digits(value, 1);
+    char*   p = _fmt_pad(buf, n, width, pad);
+
+    return _fmt_put_digits(p, value, n) - buf;
+}
+
+/// \brief Format a Signed Decimal
+uint8_t fmt_int(char* buf, int32_t value, uint8_t width)
+{
+    uint32_t u = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+    uint8_t  n = _fmt_digits(u, 1);
+    char*    p = _fmt_pad(buf, n + (value < 0), width, ' ');
+
+    if (value < 0) *p++ = '-';
+    return _fmt_put_digits(p, u, n) - buf;
+}
+
+/// \brief Format a Fixed Point Decimal
+uint8_t fmt_fixed(char* buf, uint32_t value, uint8_t width, uint8_t decimals)
+{
+    if (!decimals) return fmt_dec(buf, value, width, ' ');
+
+    uint8_t n = _fmt_digits(value, decimals + 1);   // Keep the leading "0."
+    char*   p = _fmt_pad(buf, n + 1, width, ' ');
+
+    p = _fmt_put_digits(p, value, n);
+
+    // Move the decimals right by one for the point
+    for (uint8_t i = 0; i < decimals; i++, p--) *p = p[-1];
+    *p = '.';
+
+    return p + decimals + 1 - buf;
+}
+
+/// \brief Format a Signed Fixed Point Decimal
+uint8_t fmt_fixed_int(char* buf, int32_t value, uint8_t width, uint8_t decimals)
+{
+    if (value >= 0) return fmt_fixed(buf, value, width, decimals);
+
+    // One character less after the sign, the sign goes before the digits
+    if (width > FMT_LEN) width = FMT_LEN;
+    uint8_t n = fmt_fixed(buf + 1, -(uint32_t)value, width ? width - 1 : 0, decimals);
+    uint8_t i = 0;
+
+    for (; buf[i + 1] == ' '; i++) buf[i] = ' ';
+    buf[i] = '-';
+    return n + 1;
+}
+
+/// \brief Format a Hexadecimal
+uint8_t fmt_hex(char* buf, uint32_t value, uint8_t digits)
+{
+    if (digits > 8) digits = 8;
+
+    for (int8_t i = digits - 1; i >= 0; i--)
+    {
+        uint8_t d = value & 0x0F;
+        buf[i] = (d < 10) ? '0' + d : 'A' - 10 + d;
+        value >>= 4;
+    }
+    return digits;
+}
+
+/// \brief Print a String to the printf Target
+void fmt_print(const char* str)
+{
+    int n = 0;
+    while (str[n]) n++;
+
+    _write(1, (char*)str, n);
+}
+
+/// \brief Print an Unsigned Decimal to the printf Target
+void fmt_print_dec(uint32_t value, uint8_t width)
+{
+    char buf[FMT_LEN];
+    _write(1, buf, fmt_dec(buf, value, width, ' '));
+}
+
+/// \brief Print a Hexadecimal to the printf Target
+void fmt_print_hex(uint32_t value, uint8_t digits)
+{
+    char buf[FMT_LEN];
+    _write(1, buf, fmt_hex(buf, value, digits));
+}
@@ -0,0 +1,65 @@
+/// \brief Division-free Integer Formatter for CH32V003
+/// \details The core has no divider, digits are found by subtracting
+/// powers of 10 (at most 9 compares per digit), hex by shifting nibbles.
+/// Output goes to a caller buffer of FMT_LEN characters, not terminated.
+
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <stdint.h>
+
+#define FMT_LEN 12  // Longest field: sign, 10 digits and decimal point
+
+/// \brief Format an Unsigned Decimal
+/// \param buf Output, FMT_LEN characters
+/// \param value Number
+/// \param width Field width, right aligned, 0 = no padding
+/// \param pad Padding character, ' ' or '0'
+/// \return Number of characters
+uint8_t fmt_dec(char* buf, uint32_t value, uint8_t width, char pad);
+
+/// \brief Format a Signed Decimal
+/// \param buf Output, FMT_LEN characters
+/// \param value Number
+/// \param width Field width, right aligned with spaces, 0 = no padding
+/// \return Number of characters
+uint8_t fmt_int(char* buf, int32_t value, uint8_t width);
+
+/// \brief Format a Fixed Point Decimal
+/// \param buf Output, FMT_LEN characters
+/// \param value Number in units of 10^-decimals, e.g. mV with 3 decimals for V
+/// \param width Field width, right aligned with spaces, 0 = no padding
+/// \param decimals Digits right of the decimal point, 0 ~ 9, 0 = no point
+/// \return Number of characters
+uint8_t fmt_fixed(char* buf, uint32_t value, uint8_t width, uint8_t decimals);
+
+/// \brief Format a Signed Fixed Point Decimal
+/// \param buf Output, FMT_LEN characters
+/// \param value Number in units of 10^-decimals, e.g. -5 with 2 decimals is -0.05
+/// \param width Field width, right aligned with spaces, 0 = no padding
+/// \param decimals Digits right of the decimal point, 0 ~ 9, 0 = no point
+/// \return Number of characters
+uint8_t fmt_fixed_int(char* buf, int32_t value, uint8_t width, uint8_t decimals);
+
+/// \brief Format a Hexadecimal
+/// \param buf Output, FMT_LEN characters
+/// \param value Number
+/// \param digits Number of digits, 1 ~ 8, leading zeros kept
+/// \return Number of characters
+uint8_t fmt_hex(char* buf, uint32_t value, uint8_t digits);
+
+/// \brief Print a String to the printf Target
+/// \param str String
+void fmt_print(const char* str);
+
+/// \brief Print an Unsigned Decimal to the printf Target
+/// \param value Number
+/// \param width Field width, right aligned with spaces
+void fmt_print_dec(uint32_t value, uint8_t width);
+
+/// \brief Print a Hexadecimal to the printf Target
+/// \param value Number
+/// \param digits Number of digits
+void fmt_print_hex(uint32_t value, uint8_t digits);
+
+#endif  // __FMT_H__
@@ -16,6 +16,7 @@
 
 #include "ch32v00x_spi.h"
 #include "ili9341.h"
+#include "fmt.h"
 
 #include "font7x10.h"
 #define FONT_WIDTH 7
@@ -28,6 +29,8 @@
 //#include "fonts.h"
 #define ILI9341_X_OFFSET 0
 #define ILI9341_Y_OFFSET 0
+#define ILI9341_TFT_WIDTH  320
+#define ILI9341_TFT_HEIGHT 240
 
 // CH32V003 Pin Definitions
 //#define SPI_RESET 0  // PC0 // not used
@@ -47,12 +50,6 @@
 #define SPI_DMA_MEM_INC_ON()	(DMA1_Channel3->CFGR |= DMA_CFGR1_MINC)
 #define SPI_DMA_MEM_INC_OFF()	(DMA1_Channel3->CFGR &= ~DMA_CFGR1_MINC)
 
-typedef enum 
-{
-	ili9341_landscape = 0,
-	ili9341_portrait
-} ili9341_orient_mode_t;
-
 typedef struct 
 {
 	uint16_t width;
@@ -69,8 +66,30 @@ static uint16_t _cursor_y =0;        // Cursor position (x, y)
 static uint16_t _color  =WHITE;      // Color
 static uint16_t _bg_color =BLACK;    // Background color
 
-// DMA buffer, long enough to fill a row.
-static uint8_t  _buffer[128 << 1] = {0}; 
+// Ping-pong DMA buffer for text scanlines, TFT_TEXT_CHUNK characters each,
+// also used for display list bands, strip chart columns and as the sort
+// scratch of tft_draw_pixels().
+// Solid fills stream the job color word and do not need a buffer.
+#define TFT_TEXT_CHUNK 8
+#define TFT_CELL_WIDTH (FONT_WIDTH +1)  // Glyph and 1 pixel gap column
+static uint16_t _buffer[2][TFT_TEXT_CHUNK * TFT_CELL_WIDTH] __attribute__((aligned(4))) = {0};
+static uint16_t _buffer_ticket[2] = {0};   // Last job reading each half
+static uint8_t  _buffer_sel = 0;
+#define TFT_BAND_LEN (sizeof(_buffer[0]) / sizeof(_buffer[0][0]))   // Pixels per buffer half
+
+#if TFT_GLYPH_LUT
+#if TFT_CELL_WIDTH != 8
+#error "TFT_GLYPH_LUT expands 8 pixel cells, two nibbles per glyph row"
+#endif
+
+// Four pixels of each glyph row nibble in the text colors, as two
+// 32-bit words (little endian, left pixel in the low half).
+// Rebuilt before printing when a text color changed.
+static uint32_t _glyph_lut[16][2];
+static uint8_t  _glyph_lut_dirty = 1;
+#endif
+
+tft_stats_t tft_stats;  // SPI traffic counters
 
 // brief Initialize ST7735
 // details Configure SPI, DMA, and RESET/DC/CS lines.
@@ -78,6 +97,7 @@ static void SPI_init()
 {
     GPIO_InitTypeDef GPIO_InitStructure = {0};
     SPI_InitTypeDef  SPI_InitStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_SPI1, ENABLE);
@@ -127,9 +147,10 @@ static void SPI_init()
     RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;    // Enable DMA peripheral
     DMA1_Channel3->CFGR = 0;    // Clear previous configuration
 
-    // Config DMA for SPI TX in Circular Mode
-    DMA1_Channel3->CFGR = DMA_DIR_PeripheralDST          // Bit 4     - Read from memory
-                          | DMA_Mode_Circular            // Bit 5     - Circulation mode
+    // Config DMA for SPI TX, re-armed by the transfer complete interrupt
+    DMA1_Channel3->CFGR = DMA_IT_TC                      // Bit 1     - Transfer complete interrupt
+                          | DMA_DIR_PeripheralDST        // Bit 4     - Read from memory
+                          | DMA_Mode_Normal              // Bit 5     - Normal mode
                           | DMA_PeripheralInc_Disable    // Bit 6     - Peripheral address no change
                           | DMA_MemoryInc_Enable         // Bit 7     - Increase memory address
                           | DMA_PeripheralDataSize_Byte  // Bit 8-9   - 8-bit data
@@ -137,38 +158,280 @@ static void SPI_init()
                           | DMA_Priority_VeryHigh        // Bit 12-13 - Very high priority
                           | DMA_M2M_Disable;             // Bit 14    - Disable memory to memory mode
     DMA1_Channel3->PADDR = (uint32_t)&SPI1->DATAR;  // Set Peripheral address
+
+    // Transfer engine interrupt, below the SPWM DMA1-CH6 sub priority
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
 }
 
-// Send Data Through SPI via DMA
-// buffer Memory address, size Memory size, repeat Repeat times
-static void SPI_send_DMA(const uint8_t* buffer, uint16_t size, uint16_t repeat)
+//-------------------------------------------------------------
+// Asynchronous SPI-DMA transfer engine (DMA1-CH3)
+// Jobs are queued by the drawing functions and drained by the
+// DMA1-CH3 transfer complete interrupt, so the CPU only pays for
+// the address window while the pixel data is on the wire.
+//-------------------------------------------------------------
+#define TFT_JOB_WINDOW  0x01    // Send CASET/RASET/RAMWR before the data
+#define TFT_JOB_16BIT   0x02    // 16-bit SPI frames, halfword memory reads
+#define TFT_JOB_FIXED   0x04    // Memory address not increased (send job color)
+#define TFT_JOB_CMD     0x08    // Send data with DC low (command bytes)
+
+typedef struct
+{
+    uint16_t       x0, y0, x1, y1;  // Address window (TFT_JOB_WINDOW)
+    const void*    src;             // Source memory, NULL = use color
+    uint16_t       len;             // Number of data per DMA arm
+    uint16_t       repeat;          // Number of DMA arms
+    uint16_t       color;           // Inline source for TFT_JOB_FIXED
+    uint8_t        flags;           // TFT_JOB_xxx
+} tft_job_t;
+
+static tft_job_t         _jobs[TFT_DMA_QUEUE_LEN];
+static volatile uint8_t  _job_head   = 0;   // Next free slot (main)
+static volatile uint8_t  _job_tail   = 0;   // Active job (ISR)
+static volatile uint8_t  _job_busy   = 0;   // DMA1-CH3 is running a job
+static uint16_t          _job_repeat = 0;   // Remaining arms of active job
+static uint16_t          _job_seq    = 0;   // Ticket of the last queued job
+static volatile uint16_t _job_done   = 0;   // Ticket of the last finished job
+
+//-------------------------------------------------------------
+// Shadow of the panel address window and memory write state.
+// The panel keeps CASET/RASET until they are sent again, and a RAMWR
+// stream keeps writing at the next address (left to right, top to
+// bottom inside the window) until any other command is sent.
+//-------------------------------------------------------------
+static uint16_t _win_x0 = 0xFFFF, _win_x1, _win_y0 = 0xFFFF, _win_y1;   // 0xFFFF = unknown
+static uint16_t _ram_x, _ram_y;     // Next address of the RAMWR stream
+static uint8_t  _ram_open = 0;      // RAMWR stream is still open
+
+// Forget the shadow window, after CASET/RASET were sent outside tft_set_window()
+static void _tft_window_invalidate(void)
+{
+    _win_x0 = 0xFFFF;
+    _win_y0 = 0xFFFF;
+    _ram_open = 0;
+}
+
+static void tft_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+// Wait until the last frame has left the shift register
+static inline void _spi_wait_idle(void)
+{
+    while ((SPI1->STATR & SPI_STATR_TXE) != SPI_STATR_TXE) {};
+    while ((SPI1->STATR & SPI_STATR_BSY) == SPI_STATR_BSY) {};
+}
+
+// Arm DMA1-CH3 for one burst of the active job
+static inline void _tft_job_arm(const tft_job_t* job)
+{
+    DMA1_Channel3->MADDR = (job->flags & TFT_JOB_FIXED) ? (uint32_t)&job->color : (uint32_t)job->src;
+    DMA1_Channel3->CNTR  = job->len;
+    DMA1_Channel3->CFGR |= DMA_CFGR1_EN;
+
+    tft_stats.arms++;
+    tft_stats.bytes += (job->flags & TFT_JOB_16BIT) ? (uint32_t)job->len << 1 : job->len;
+}
+
+// Start the job at the queue tail, or release the bus if the queue is empty.
+// Called from the DMA1-CH3 interrupt, or from main with interrupts disabled.
+// The CPU polls SPI1 here for at most the window, CASET, RASET, RAMWR and
+// 8 data bytes at 24MHz: the handler takes about 7us (test_console.c), the
+// USART1 RX interrupts of the same priority wait that long at most.
+static void _tft_job_start(void)
 {
-    // Set memory address and data count
-    DMA1_Channel3->MADDR = (uint32_t)buffer; // Set memory address
-    DMA1_Channel3->CNTR  = size;              // Set number of data items
+    _spi_wait_idle();
+
+    if (_job_tail == _job_head)
+    {
+        SPI_DATA_8B();
+        GPIO_SetBits(GPIOC, SPI_CS);    // END_WRITE();
+        _job_busy = 0;
+        return;
+    }
+
+    const tft_job_t* job = &_jobs[_job_tail];
+    _job_busy = 1;
+
+    if (job->flags & TFT_JOB_WINDOW)
+    {
+        tft_set_window(job->x0, job->y0, job->x1, job->y1);
+        _spi_wait_idle();
+    }
 
-    // Circulate the buffer
-    for (uint16_t i = 0; i < repeat; i++)
+    GPIO_ResetBits(GPIOC, SPI_CS);      // START_WRITE();
+    if (job->flags & TFT_JOB_CMD)
     {
-        DMA1_Channel3->CFGR |= DMA_CFGR1_EN;  // Ensure DMA is enabled
+        GPIO_ResetBits(GPIOC, SPI_DC);  // COMMAND_MODE();
+    }
+    else
+    {
+        GPIO_SetBits(GPIOC, SPI_DC);    // DATA_MODE();
+    }
 
-        // Clear flag before starting a new transfer
-        DMA1->INTFCR |= DMA1_FLAG_TC3; // Clear transfer complete flag
-        while (!(DMA1->INTFR & DMA1_FLAG_TC3)); // Wait until the transfer is complete
+    uint16_t cfgr = DMA1_Channel3->CFGR & ~(DMA_CFGR1_PSIZE | DMA_CFGR1_MSIZE | DMA_CFGR1_MINC);
+    if (job->flags & TFT_JOB_16BIT)
+    {
+        SPI_DATA_16B();
+        cfgr |= DMA_PeripheralDataSize_HalfWord | DMA_MemoryDataSize_HalfWord;
+    }
+    else
+    {
+        SPI_DATA_8B();
     }
+    if (!(job->flags & TFT_JOB_FIXED))
+    {
+        cfgr |= DMA_MemoryInc_Enable;
+    }
+    DMA1_Channel3->CFGR = cfgr;
 
-    // Disable the DMA channel after transfer
-    DMA1_Channel3->CFGR &= ~DMA_CFGR1_EN; // Turn off channel
+    _job_repeat = job->repeat;
+    _tft_job_arm(job);
 }
 
-void spi_send_dma16(uint16_t *data, uint16_t size)
+// Get a free job slot, waits while the queue is full.
+// Main loop only, with interrupts enabled: the slots are freed by the
+// DMA1-CH3 interrupt, so from an interrupt handler or with interrupts
+// disabled a full queue never drains. _tft_job_commit() enables them too.
+static tft_job_t* _tft_job_alloc(void)
+{
+    while (((_job_head + 1) & (TFT_DMA_QUEUE_LEN - 1)) == _job_tail) {};
+    return &_jobs[_job_head];
+}
+
+// Publish the slot returned by _tft_job_alloc() and kick the engine if idle
+// Returns the job ticket for _tft_job_wait()
+static uint16_t _tft_job_commit(void)
+{
+    __disable_irq();
+    _job_head = (_job_head + 1) & (TFT_DMA_QUEUE_LEN - 1);
+    if (!_job_busy)
+    {
+        _tft_job_start();
+    }
+    __enable_irq();
+
+    return ++_job_seq;
+}
+
+// Wait until the job with the given ticket has left the DMA.
+// An idle engine has finished every job: a ticket not renewed for 32768
+// jobs looks ahead of _job_done, the queue drains and ends the wait.
+static inline void _tft_job_wait(uint16_t ticket)
+{
+    while (_job_busy && (int16_t)(_job_done - ticket) < 0) {};
+}
+
+// Queue a memory transfer, optionally preceded by an address window
+// Returns the job ticket for _tft_job_wait()
+static uint16_t _tft_queue(uint8_t flags, const void* src, uint16_t len, uint16_t repeat,
+                           uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    if (len == 0 || repeat == 0) return _job_seq;
+
+    tft_job_t* job = _tft_job_alloc();
+    job->x0     = x0;
+    job->y0     = y0;
+    job->x1     = x1;
+    job->y1     = y1;
+    job->src    = src;
+    job->len    = len;
+    job->repeat = repeat;
+    job->flags  = flags;
+    return _tft_job_commit();
+}
+
+// Queue one 16-bit color word streamed `repeat` x `len` times
+static void _tft_queue_fixed(uint8_t flags, uint16_t color, uint16_t len, uint16_t repeat,
+                             uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    tft_job_t* job = _tft_job_alloc();
+    job->x0     = x0;
+    job->y0     = y0;
+    job->x1     = x1;
+    job->y1     = y1;
+    job->src    = 0;
+    job->len    = len;
+    job->repeat = repeat;
+    job->color  = color;
+    job->flags  = flags | TFT_JOB_16BIT | TFT_JOB_FIXED;
+    _tft_job_commit();
+}
+
+// Fill a window with a single color, memory increment off.
+// The pixel count is split into bursts of up to 65535 transfers:
+// one job with the window repeating full bursts, plus one job with
+// the remainder continuing the same RAMWR stream.
+// A 320x240 clear is two DMA arms and no CPU loop.
+static void _tft_fill_window(uint16_t color, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+    uint32_t count = (uint32_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+    uint16_t full  = 0;
+
+    while (count > 0xFFFF)
+    {
+        count -= 0xFFFF;
+        full++;
+    }
+
+    if (full)
+    {
+        _tft_queue_fixed(TFT_JOB_WINDOW, color, 0xFFFF, full, x0, y0, x1, y1);
+        if (count)
+        {
+            _tft_queue_fixed(0, color, count, 1, 0, 0, 0, 0);
+        }
+    }
+    else
+    {
+        _tft_queue_fixed(TFT_JOB_WINDOW, color, count, 1, x0, y0, x1, y1);
+    }
+}
+
+/// \brief Wait for all Queued SPI-DMA Transfers
+void tft_dma_wait(void)
+{
+    while (_job_busy) {};
+}
+
+/// \brief Check the SPI-DMA Transfer Engine
+/// \return 1 if transfers are queued or on the wire
+uint8_t tft_dma_busy(void)
+{
+    return _job_busy;
+}
+
+//-------------------------------------------------------------
+// interrupt for End of SPI DMA Transfer
+//-------------------------------------------------------------
+void DMA1_Channel3_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel3_IRQHandler(void)
+{
+    DMA1->INTFCR = DMA_CGIF3;   // Clear DMA global flag
+    DMA1_Channel3->CFGR &= ~DMA_CFGR1_EN;
+
+    if (--_job_repeat)
+    {
+        _tft_job_arm(&_jobs[_job_tail]);    // Next burst of the same job
+        return;
+    }
+
+    _job_tail = (_job_tail + 1) & (TFT_DMA_QUEUE_LEN - 1);
+    _job_done++;
+    _tft_job_start();
+}
+
+// Send Data Through SPI via DMA
+// buffer Memory address, size Memory size, repeat Repeat times
+static void SPI_send_DMA(const uint8_t* buffer, uint16_t size, uint16_t repeat)
 {
-	SPI_DATA_16B(); //Change data length to 16bit
+    _tft_queue(0, buffer, size, repeat, 0, 0, 0, 0);
+}
 
-	DMA1_Channel3->CFGR &= ~DMA_CFGR3_EN;   //First disable DMA
-	DMA1_Channel3->MADDR = (uint32_t)data;  //Buffer address
-	DMA1_Channel3->CNTR = (uint16_t)size;   //Number of data transfer
-	DMA1_Channel3->CFGR |= DMA_CFGR3_EN;	//Enable DMA Channel
+void spi_send_dma16(uint16_t *data, uint16_t size)
+{
+    _tft_queue(TFT_JOB_16BIT, data, size, 1, 0, 0, 0, 0);
 }   // End of spi_send from spi.c
 
 //-------------------------------------------------------------
@@ -206,6 +469,7 @@ uint8_t spi_recv8(uint8_t dummy)
 //-------------------------------------------------------------
 static void write_command_8(uint8_t cmd)
 {
+	_ram_open = 0;  // Any command ends a RAMWR stream
 	SPI_DATA_8B();
     GPIO_ResetBits(GPIOC, GPIO_Pin_3);    // DC = low
 
@@ -242,118 +506,83 @@ static void write_data_16(uint16_t data)
 
 void write_dma_data16(uint16_t *data, uint16_t size)
 {
-	GPIO_SetBits(GPIOC, SPI_DC);	// ILI9341_DC_DATA();
-
-	GPIO_ResetBits(GPIOC, SPI_CS);	// ILI9341_CS_ON();
 	spi_send_dma16(data, size); //Send data
-
-	while((DMA1->INTFR & DMA_TCIF3) != DMA_TCIF3){};	//Wait end of transfer
-	DMA1->INTFCR |= DMA_CGIF3;	//Clear DMA global flag  
+	tft_dma_wait();             //Wait end of transfer
 }
 
-// ST7735 Gamma Adjustments (pos. polarity), 16 args.
-const uint8_t gamma_p[] = {0x09, 0x16, 0x09, 0x20, 0x21, 0x1B, 0x13, 0x19,
-                    0x17, 0x15, 0x1E, 0x2B, 0x04, 0x05, 0x02, 0x0E};
+// Initialization sequence from Arduino_GFX, in flash:
+// command, argument count, arguments, then a delay in ms when the
+// count has TFT_INIT_DELAY set. 0 ends the list (NOP is not used).
+// Argument blocks longer than 4 bytes go out by DMA.
+#define TFT_INIT_DELAY 0x80
 
-// ST7735  Gamma Adjustments (neg. polarity), 16 args.
-const uint8_t gamma_n[] = {0x0B, 0x14, 0x08, 0x1E, 0x22, 0x1D, 0x18, 0x1E,
-                    0x1B, 0x1A, 0x24, 0x2B, 0x06, 0x06, 0x02, 0x0F};
+static const uint8_t _tft_init_seq[] =
+{
+    ILI9341_SLPOUT,   TFT_INIT_DELAY | 0, ILI9341_SLPOUT_DELAY,     // Out of sleep mode
+    ILI9341_PWCTR1,   1, 0x23,                  // Power control VRH[5:0]
+    ILI9341_PWCTR2,   1, 0x10,                  // Power control SAP[2:0];BT[3:0]
+    ILI9341_VMCTR1,   2, 0x3e, 0x28,            // VCM control 1
+    ILI9341_VMCTR2,   1, 0x86,                  // VCM control 2
+    ILI9341_MADCTL,   1, ILI9341_MADCTL_MX | ILI9341_MADCTL_MY | ILI9341_MADCTL_MV | ILI9341_MADCTL_BGR, // 0 - Horizontal
+    ILI9341_COLMOD,   1, ILI9341_COLMOD_16_BPP, // Interface Pixel Format = 16 bit/pixel
+    ILI9341_VSCRSADD, 2, 0x00, 0x00,            // Vertical Scrolling Start Address, 16-bit line
+    ILI9341_COLMOD,   1, 0x55,                  // COLMOD: Pixel Format Set
+    ILI9341_FRMCTR1,  2, 0x00, 0x18,            // Frame Rate Control 1
+    ILI9341_DFUNCTR,  3, 0x08, 0x82, 0x27,      // Display Function Control
+    ILI9341_GAMSET,   1, 0x01,                  // Gamma curve 1
+    ILI9341_GMCTRP1,  TFT_INIT_DELAY | 16,      // Gamma Adjustments (pos. polarity)
+        0x09, 0x16, 0x09, 0x20, 0x21, 0x1B, 0x13, 0x19,
+        0x17, 0x15, 0x1E, 0x2B, 0x04, 0x05, 0x02, 0x0E, 10,
+    ILI9341_GMCTRN1,  TFT_INIT_DELAY | 16,      // Gamma Adjustments (neg. polarity)
+        0x0B, 0x14, 0x08, 0x1E, 0x22, 0x1D, 0x18, 0x1E,
+        0x1B, 0x1A, 0x24, 0x2B, 0x06, 0x06, 0x02, 0x0F, 10,
+    ILI9341_FRMCTR1,  1, 0xA0,                  // Frame rate 60Hz
+    ILI9341_INVOFF,   0,                        // Color invert off (INVON to invert)
+    ILI9341_NORON,    TFT_INIT_DELAY | 0, 10,   // Normal display on
+    ILI9341_DISPON,   TFT_INIT_DELAY | 0, 10,   // Main screen turn on
+    ILI9341_RAMWR,    0,                        // 0x2C =Memory Write
+    0
+};
 
 /// \details Initialization sequence from Arduino_GFX
 void tft_init(void)
 {
+    ILI9341.width = ILI9341_TFT_WIDTH;
+    ILI9341.height = ILI9341_TFT_HEIGHT;
+    ILI9341.lcd_orientation = ili9341_landscape;
+
     SPI_init();
     GPIO_ResetBits(GPIOC, GPIO_Pin_4);   // CS = low
 
-    // Out of sleep mode, no args, w/delay
-    write_command_8(ILI9341_SLPOUT);
-    Delay_Ms(ILI9341_SLPOUT_DELAY);
-
-    // Power control VRH[5:0]
-    write_command_8(ILI9341_PWCTR1);
-    write_data_8(0x23);             
-
-    // Power control SAP[2:0];BT[3:0]
-    write_command_8(ILI9341_PWCTR2);
-    write_data_8(0x10);           
-
-    // VCM control 1
-    write_command_8(ILI9341_VMCTR1);
-    write_data_8(0x3e);
-    write_data_8(0x28);       
-
-    // VCM control 2
-    write_command_8(ILI9341_VMCTR2);
-    write_data_8(0x86);             
-
-    // 0x36 =Memory Data Access Control for Set rotation (ILI9341)
-    write_command_8(ILI9341_MADCTL); 
-    write_data_8(ILI9341_MADCTL_MX | ILI9341_MADCTL_MY |ILI9341_MADCTL_MV | ILI9341_MADCTL_BGR); // 0 - Horizontal
-
-    // Set rotate for ST7735 =0 ~ 3
-    //write_data_8(ILI9341_MADCTL_MY | ILI9341_MADCTL_MV | ILI9341_MADCTL_BGR); // 0 - Horizontal
-    //write_data_8(ILI9341_MADCTL_BGR); // 1 - Vertical
-    //write_data_8(ILI9341_MADCTL_MX | ILI9341_MADCTL_MV | ILI9341_MADCTL_BGR); // 2 - Horizontal
-    //write_data_8(ILI9341_MADCTL_MX | ILI9341_MADCTL_MY | ILI9341_MADCTL_BGR); // 3 - Vertical   
-
-    // Set Interface Pixel Format = 16 bit/pixel
-    write_command_8(ILI9341_COLMOD);
-    write_data_8(ILI9341_COLMOD_16_BPP);
-
-    // Vertical Scrolling Start Address
-    write_command_8(0x37);
-    write_data_8(0x00);             
-
-    //COLMOD: Pixel Format Set
-    write_command_8(ILI9341_COLMOD);
-    write_data_8(0x55);
-
-    // Frame Rate Control 1
-    write_command_8(ILI9341_FRMCTR1);
-    write_data_8(0x00);
-    write_data_8(0x18);
-    
-    // Display Function Control
-    write_command_8(ILI9341_DFUNCTR);
-    write_data_8(0x08);
-    write_data_8(0x82);
-    write_data_8(0x27);
-
-    // ILI9341_GAMMASET
-    write_command_8(ILI9341_GAMSET);
-    write_data_8(0x01);
-
-    write_command_8(ILI9341_GMCTRP1); 
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);    // DC = high =data
-    SPI_send_DMA(gamma_p, 16, 1);   // DMA transfer only data
-    Delay_Ms(10);
-
-    write_command_8(ILI9341_GMCTRN1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);    // DC = high =data
-    SPI_send_DMA(gamma_n, 16, 1);   // DMA transfer only data 
-    Delay_Ms(10);
-
-	write_command_8(ILI9341_FRMCTR1);   //Frame rate
-	write_data_8(0xA0);    //60Hz
-
-    // Color invert
-    //write_command_8(ILI9341_INVON);
-    write_command_8(ILI9341_INVOFF);
-
-    // Normal display on, no args, w/delay
-    write_command_8(ILI9341_NORON);
-    Delay_Ms(10);
-
-    // Main screen turn on, no args, w/delay
-    write_command_8(ILI9341_DISPON);
-    Delay_Ms(10);
-
-	write_command_8(ILI9341_RAMWR); // 0x2C =Memory Write
+    for (const uint8_t* p = _tft_init_seq; *p; )
+    {
+        write_command_8(*p++);
+        uint8_t n   = *p++;
+        uint8_t len = n & ~TFT_INIT_DELAY;
+
+        if (len > 4)
+        {
+            GPIO_SetBits(GPIOC, GPIO_Pin_3);    // DC = high =data
+            SPI_send_DMA(p, len, 1);            // DMA transfer only data
+            tft_dma_wait();
+            p += len;
+        }
+        else
+        {
+            while (len--) write_data_8(*p++);
+        }
+
+        if (n & TFT_INIT_DELAY) Delay_Ms(*p++);
+    }
+
     GPIO_SetBits(GPIOC, GPIO_Pin_4);    // CS = high
+    _tft_window_invalidate();
 }
 
 void tft_cursor_position(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) 
 {
+	tft_dma_wait();
+	_tft_window_invalidate();
 	write_command_8(0x2A);  // ILI9341_COLUMN_ADDR
 	write_data_16(x1);
 	write_data_16(x2);
@@ -378,6 +607,9 @@ void tft_set_cursor(uint16_t x, uint16_t y)
 /// \details Set to `_color` variable
 void tft_set_color(uint16_t color)
 {
+#if TFT_GLYPH_LUT
+    if (color != _color) _glyph_lut_dirty = 1;
+#endif
     _color = color;
 }
 
@@ -386,26 +618,120 @@ void tft_set_color(uint16_t color)
 /// \details Set to `_bg_color` variable
 void tft_set_background_color(uint16_t color)
 {
+#if TFT_GLYPH_LUT
+    if (color != _bg_color) _glyph_lut_dirty = 1;
+#endif
     _bg_color = color;
 }
 
+#if TFT_GLYPH_LUT
+// Fill _glyph_lut from the current text colors
+static void _tft_glyph_lut_build(void)
+{
+    for (uint8_t n = 0; n < 16; n++)
+    {
+        uint32_t p3 = (n & 0x08) ? _color : _bg_color;
+        uint32_t p2 = (n & 0x04) ? _color : _bg_color;
+        uint32_t p1 = (n & 0x02) ? _color : _bg_color;
+        uint32_t p0 = (n & 0x01) ? _color : _bg_color;
+
+        _glyph_lut[n][0] = p3 | (p2 << 16);
+        _glyph_lut[n][1] = p1 | (p0 << 16);
+    }
+    _glyph_lut_dirty = 0;
+}
+#endif
+
+// Send a 16-bit start/end parameter pair as 4 bytes in 8-bit frames
+static void write_data_range(uint16_t a, uint16_t b)
+{
+    GPIO_SetBits(GPIOC, SPI_DC);    // DC = high
+
+    while ((SPI1->STATR & SPI_STATR_TXE) != SPI_STATR_TXE) {};
+    SPI1->DATAR = a >> 8;
+    while ((SPI1->STATR & SPI_STATR_TXE) != SPI_STATR_TXE) {};
+    SPI1->DATAR = a;
+    while ((SPI1->STATR & SPI_STATR_TXE) != SPI_STATR_TXE) {};
+    SPI1->DATAR = b >> 8;
+    while ((SPI1->STATR & SPI_STATR_TXE) != SPI_STATR_TXE) {};
+    SPI1->DATAR = b;
+    while ((SPI1->STATR & SPI_STATR_BSY) == SPI_STATR_BSY) {};
+}
+
 /// \brief Set Memory Write Window
 /// \param x0 Start column
 /// \param y0 Start row
 /// \param x1 End column
 /// \param y1 End row
-
+/// \details Sends only the parts that differ from the shadow window.
+/// Nothing is sent when (x0, y0) is the next address of the open RAMWR
+/// stream and the new window is the stream's natural continuation.
+/// RASET always ends on the bottom row, so a stream that stops above it
+/// points at the next row and a window below continues it.
+/// The caller must write the whole window.
 static void tft_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
-    write_command_8(ILI9341_CASET);
-    write_data_16(x0);
-    write_data_16(x1);
+    uint16_t bottom = ILI9341.height -1 +ILI9341_Y_OFFSET;
+    if (y1 > bottom) bottom = y1;
+
+    tft_stats.windows++;
+
+    if (_ram_open && x0 == _ram_x && y0 == _ram_y &&
+        ((y0 == y1 && x1 <= _win_x1) ||                                 // Rest of a row
+         (x0 == _win_x0 && x1 == _win_x1 && y1 <= _win_y1)))            // Whole rows
+    {
+        tft_stats.ramwr_continued++;
+    }
+    else
+    {
+        SPI_DATA_8B();
+        if (x0 != _win_x0 || x1 != _win_x1)
+        {
+            write_command_8(ILI9341_CASET);
+            write_data_range(x0, x1);
+            _win_x0 = x0;
+            _win_x1 = x1;
+            tft_stats.bytes += 5;
+        }
+        else
+        {
+            tft_stats.caset_skipped++;
+        }
+
+        if (y0 != _win_y0 || y1 > _win_y1)
+        {
+            write_command_8(ILI9341_RASET);
+            write_data_range(y0, bottom);
+            _win_y0 = y0;
+            _win_y1 = bottom;
+            tft_stats.bytes += 5;
+        }
+        else
+        {
+            tft_stats.raset_skipped++;
+        }
 
-    write_command_8(ILI9341_RASET);
-    write_data_16(y0);
-    write_data_16(y1);
+        write_command_8(ILI9341_RAMWR);
+        tft_stats.bytes += 1;
+        _ram_open = 1;
+    }
 
-    write_command_8(ILI9341_RAMWR);
+    // Next address once the window is written
+    if (x1 < _win_x1)
+    {
+        _ram_x = x1 + 1;
+        _ram_y = y1;
+    }
+    else if (y1 < _win_y1)
+    {
+        _ram_x = _win_x0;
+        _ram_y = y1 + 1;
+    }
+    else
+    {
+        _ram_x = _win_x0;   // Wraps to the window start
+        _ram_y = _win_y0;
+    }
 }
 
 /// \brief Print a Character
@@ -444,72 +770,89 @@ void tft_print_char(char c)
 }
 */
 
-void tft_print_char(char c)
+//-------------------------------------------------------------
+// Print a run of characters at the cursor with one address window.
+// Glyph rows are expanded across all characters scanline by scanline
+// into the ping-pong _buffer, one half is built while DMA drains the other.
+// The gap column right of each glyph is painted with the background color.
+//-------------------------------------------------------------
+static void _tft_print_run(const char* str, uint16_t n)
 {
-    if (c < 32 || c > 126) return; // Ensure character is printable
+    // Clip to the right and bottom edges of the screen,
+    // a line cut by the bottom edge keeps its upper glyph rows
+    if (_cursor_x >= ILI9341.width || _cursor_y >= ILI9341.height) return;
+    uint16_t max = (ILI9341.width -_cursor_x) / TFT_CELL_WIDTH;
+    if (n > max) n = max;
+    if (n == 0) return;
 
-    // Get the starting address of character
-    const uint8_t* start = &font7x10[(c -32) *FONT_HEIGHT];  // font address offset
-    //const uint16_t* start = &font11x18[(c -32) *FONT_HEIGHT];   // font address offset
+    uint8_t rows = FONT_HEIGHT;
+    if (ILI9341.height -_cursor_y < rows) rows = ILI9341.height -_cursor_y;
 
-    uint16_t sz =0;
-    for (uint8_t i =0; i < FONT_HEIGHT; i++) // font height =0~10
-    {
-        uint8_t row = start[i];   // Get the row data from font address offset
-        //uint8_t row = (start[i] >>8) & 0xFF;    // row = high byte of font word
+    uint16_t x0 = _cursor_x;
+    uint16_t x1 = _cursor_x +n *TFT_CELL_WIDTH -1;
+    uint8_t  flags = TFT_JOB_WINDOW | TFT_JOB_16BIT;
 
-        for (uint8_t j =0; j < FONT_WIDTH; j++) // j =0~7
-        {
-            if (row & (1 << (FONT_WIDTH -1 -j))) // bit is set = 7~0
-            {
-                _buffer[sz++] = _color >> 8; // High byte of font color
-                _buffer[sz++] = _color;      // Low byte of font color
-            }
-            else    // bit is reset = 7~0
-            {
-                _buffer[sz++] = _bg_color >> 8; // High byte of bg color
-                _buffer[sz++] = _bg_color;      // Low byte of bg color
-            }
-        }
+#if TFT_GLYPH_LUT
+    if (_glyph_lut_dirty) _tft_glyph_lut_build();
+#endif
 
-        /*
-        row = start[i] & 0xFF;    // row = low byte of font word
-        for (uint8_t j =0; j < FONT_WIDTH -8; j++) // j =0~3
+    for (uint8_t i =0; i < rows; i++)       // font height =0~10
+    {
+        for (uint16_t k =0; k < n; k += TFT_TEXT_CHUNK)
         {
-            if (row & (1 << (FONT_WIDTH -9 -j))) // bit is set = 2~0
-            {
-                _buffer[sz++] = _color >> 8; // High byte of font color
-                _buffer[sz++] = _color;      // Low byte of font color
-            }
-            else    // bit is reset = 2~0
+            uint16_t m = (n -k < TFT_TEXT_CHUNK) ? n -k : TFT_TEXT_CHUNK;
+            uint16_t* p = _buffer[_buffer_sel];
+
+            _tft_job_wait(_buffer_ticket[_buffer_sel]);  // half may still be on the wire
+
+            for (uint16_t c =k; c < k +m; c++)
             {
-                _buffer[sz++] = _bg_color >> 8; // High byte of bg color
-                _buffer[sz++] = _bg_color;      // Low byte of bg color
+                uint8_t ch = str[c];
+                if (ch < 32 || ch > 126) ch = ' ';  // Ensure character is printable
+
+                // Glyph pixels are bit 6~0, shift to 7~1 so bit 0 is the gap column
+                uint8_t row = font7x10[(ch -32) *FONT_HEIGHT +i] << 1;
+#if TFT_GLYPH_LUT
+                // Two nibble lookups, four 32-bit stores per glyph row
+                const uint32_t* hi = _glyph_lut[row >> 4];
+                const uint32_t* lo = _glyph_lut[row & 0x0F];
+                uint32_t* w = (uint32_t*)p;
+                w[0] = hi[0];
+                w[1] = hi[1];
+                w[2] = lo[0];
+                w[3] = lo[1];
+                p += TFT_CELL_WIDTH;
+#else
+                for (uint8_t mask =0x80; mask; mask >>= 1)
+                {
+                    *p++ = (row & mask) ? _color : _bg_color;
+                }
+#endif
             }
+
+            _buffer_ticket[_buffer_sel] = _tft_queue(flags, _buffer[_buffer_sel], m *TFT_CELL_WIDTH, 1,
+                                                     x0, _cursor_y, x1, _cursor_y +rows -1);
+            flags = TFT_JOB_16BIT;  // Following chunks continue the RAMWR stream
+            _buffer_sel ^= 1;
         }
-        */
     }
+}
 
-    // Set the window for the current character
-    tft_set_window(_cursor_x, _cursor_y, _cursor_x +FONT_WIDTH -1, _cursor_y +FONT_HEIGHT -1);
-
-    // Send the character data to the display
-    GPIO_SetBits(GPIOC, SPI_DC);    // DATA_MODE();
-
-    GPIO_ResetBits(GPIOC, SPI_CS);  // START_WRITE();
-    SPI_send_DMA(_buffer, sz, 1);
-    GPIO_SetBits(GPIOC, SPI_CS);    // END_WRITE();
+void tft_print_char(char c)
+{
+    _tft_print_run(&c, 1);
 }
 
 /// \brief Print a String
 /// \param str String to print
+/// \details One address window and one DMA stream per string.
 void tft_print(const char* str)
 {
-    while (*str)
-    {
-        tft_print_char(*str++);
-        _cursor_x += FONT_WIDTH +1;
-    }
+    uint16_t n = 0;
+    while (str[n]) n++;
+
+    _tft_print_run(str, n);
+    _cursor_x += n *TFT_CELL_WIDTH;
 }
 
 /// \brief Print an Integer
@@ -519,58 +862,123 @@ void tft_print(const char* str)
 /// Align right if it is greater than the width of the number.
 void tft_print_number(int32_t num, uint16_t width)
 {
-    static char str[12];
-    uint8_t     position  = 11;
-    uint8_t     negative  = 0;
-    uint16_t    num_width = 0;
+    char    str[FMT_LEN];
+    uint8_t n = fmt_int(str, num, 0);
 
-    // Handle negative number
-    if (num < 0)
+    // Calculate alignment
+    uint16_t num_width = n *TFT_CELL_WIDTH -1;
+    if (width > num_width)
     {
-        negative = 1;
-        num      = -num;
+        _cursor_x += width -num_width;
     }
+    _tft_print_run(str, n);
+    _cursor_x += n *TFT_CELL_WIDTH;
+}
 
-    str[position] = '\0';  // End of the string.
-    while (num)
-    {
-        str[--position] = num % 10 + '0';
-        num /= 10;
-    }
+/// \brief Print an Unsigned Decimal
+/// \param value Number to print
+/// \param digits Field width in characters, right aligned with spaces
+/// \details Division free, the digits go straight to the glyph stream.
+void tft_print_dec(uint32_t value, uint8_t digits)
+{
+    char    str[FMT_LEN];
+    uint8_t n = fmt_dec(str, value, digits, ' ');
 
-    if (position == 11)
-    {
-        str[--position] = '0';
-    }
+    _tft_print_run(str, n);
+    _cursor_x += n *TFT_CELL_WIDTH;
+}
+
+/// \brief Print a Fixed Point Decimal
+/// \param value Number in units of 10^-decimals, e.g. mV with 3 decimals for V
+/// \param digits Field width in characters including the point
+/// \param decimals Digits right of the decimal point
+void tft_print_fixed(uint32_t value, uint8_t digits, uint8_t decimals)
+{
+    char    str[FMT_LEN];
+    uint8_t n = fmt_fixed(str, value, digits, decimals);
+
+    _tft_print_run(str, n);
+    _cursor_x += n *TFT_CELL_WIDTH;
+}
+
+/// \brief Print a Hexadecimal
+/// \param value Number to print
+/// \param digits Number of digits, leading zeros kept
+void tft_print_hex(uint32_t value, uint8_t digits)
+{
+    char    str[FMT_LEN];
+    uint8_t n = fmt_hex(str, value, digits);
+
+    _tft_print_run(str, n);
+    _cursor_x += n *TFT_CELL_WIDTH;
+}
+
+/// \brief Update a Numeric Readout
+/// \param field Readout, zero initialized state draws it in full
+/// \param value Number, in units of 10^-decimals
+/// \details The value is formatted and compared with the characters on
+/// screen, each run of changed characters is one window and one DMA stream.
+/// A counter ticking by one usually sends one glyph.
+void tft_field_set(tft_field_t* field, uint32_t value)
+{
+    char    str[FMT_LEN];
+    uint8_t n = fmt_fixed(str, value, field->width, field->decimals);
 
-    if (negative)
+    if (n != field->len)
     {
-        str[--position] = '-';
+        // Width changed (value wider than the field), redraw all and
+        // clear what is left of a longer previous value
+        if (n < field->len)
+        {
+            tft_fill_rect(field->x + n *TFT_CELL_WIDTH, field->y,
+                          (field->len - n) *TFT_CELL_WIDTH, FONT_HEIGHT, field->bg);
+        }
+        tft_field_invalidate(field);
+        field->len = n;
     }
 
-    // Calculate alignment
-    num_width = (11 -position) *(FONT_WIDTH +1) -1;
-    if (width > num_width)
+    tft_set_color(field->color);
+    tft_set_background_color(field->bg);
+
+    uint16_t cursor_x = _cursor_x, cursor_y = _cursor_y;
+    for (uint8_t i = 0; i < n; )
     {
-        _cursor_x += width -num_width;
+        if (str[i] == field->last[i])
+        {
+            i++;
+            continue;
+        }
+
+        uint8_t k = i;
+        for (; k < n && str[k] != field->last[k]; k++) field->last[k] = str[k];
+
+        _cursor_x = field->x + i *TFT_CELL_WIDTH;
+        _cursor_y = field->y;
+        _tft_print_run(&str[i], k - i);
+        i = k;
     }
-    tft_print(&str[position]);
+    _cursor_x = cursor_x;
+    _cursor_y = cursor_y;
+}
+
+/// \brief Redraw a Numeric Readout in Full on the Next Update
+/// \param field Readout, e.g. after the screen was cleared
+void tft_field_invalidate(tft_field_t* field)
+{
+    for (uint8_t i = 0; i < FMT_LEN; i++) field->last[i] = 0;
 }
 
 /// \brief Draw a Pixel
 /// \param x X
 /// \param y Y
 /// \param color Pixel color
-/// \details SPI direct write
+/// \details DMA queued, color sent from the job itself
 void tft_draw_pixel(uint16_t x, uint16_t y, uint16_t color)
 {
     x += ILI9341_X_OFFSET;
     y += ILI9341_Y_OFFSET;
 
-    GPIO_ResetBits(GPIOC, GPIO_Pin_4);   //START_WRITE();
-    tft_set_window(x, y, x, y);
-    write_data_16(color);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);    //END_WRITE();
+    _tft_queue_fixed(TFT_JOB_WINDOW, color, 1, 1, x, y, x, y);
 }
 
 /// \brief Fill a Rectangle Area
@@ -579,24 +987,15 @@ void tft_draw_pixel(uint16_t x, uint16_t y, uint16_t color)
 /// \param width Width
 /// \param height Height
 /// \param color Fill Color
-/// \details DMA accelerated.
+/// \details DMA accelerated, single color word with memory increment off.
 void tft_fill_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color)
 {
+    if (width == 0 || height == 0) return;
+
     x += ILI9341_X_OFFSET;
     y += ILI9341_Y_OFFSET;
 
-    uint16_t sz = 0;
-    for (uint16_t x = 0; x < width; x++)
-    {
-        _buffer[sz++] = color >> 8;
-        _buffer[sz++] = color;
-    }
-
-    GPIO_ResetBits(GPIOC, GPIO_Pin_4);   //START_WRITE();
-    tft_set_window(x, y, x + width - 1, y + height - 1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);    //DATA_MODE();
-    SPI_send_DMA(_buffer, sz, height);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);    //END_WRITE();
+    _tft_fill_window(color, x, y, x + width - 1, y + height - 1);
 }
 
 /// \brief Draw a Bitmap
@@ -605,16 +1004,13 @@ void tft_fill_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint
 /// \param width Width
 /// \param height Height
 /// \param bitmap Bitmap
+/// \details DMA queued, bitmap must stay valid until tft_dma_wait()
 void tft_draw_bitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bitmap)
 {
     x += ILI9341_X_OFFSET;
     y += ILI9341_Y_OFFSET;
 
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);    //DATA_MODE();
-    GPIO_ResetBits(GPIOC, GPIO_Pin_4);  //START_WRITE();
-    tft_set_window(x, y, x + width -1, y + height -1);
-    SPI_send_DMA(bitmap, width * height << 1, 1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);    //END_WRITE();
+    _tft_queue(TFT_JOB_WINDOW, bitmap, width * height << 1, 1, x, y, x + width -1, y + height -1);
 }
 
 /// \brief Draw a Vertical Line Fast
@@ -623,24 +1019,23 @@ void tft_draw_bitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, co
 /// \param x1 End X coordinate
 /// \param y1 End Y coordinate
 /// \param color Line color
-/// \details DMA accelerated
+/// \details DMA accelerated, single color word with memory increment off.
 static void _tft_draw_fast_v_line(int16_t x, int16_t y, int16_t h, uint16_t color)
 {
-    x += ILI9341_X_OFFSET;
-    y += ILI9341_Y_OFFSET;
-
-    uint16_t sz = 0;
-    for (int16_t j = 0; j < h; j++)
+    // Clip to the screen
+    if (x < 0 || x >= (int16_t)ILI9341.width) return;
+    if (y < 0)
     {
-        _buffer[sz++] = color >> 8;
-        _buffer[sz++] = color;
+        h += y;
+        y = 0;
     }
+    if (y + h > (int16_t)ILI9341.height) h = ILI9341.height - y;
+    if (h <= 0) return;
 
-    GPIO_ResetBits(GPIOC, GPIO_Pin_4);   //START_WRITE();
-    tft_set_window(x, y, x, y + h - 1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);     // DATA_MODE();   
-    SPI_send_DMA(_buffer, sz, 1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);    //END_WRITE();
+    x += ILI9341_X_OFFSET;
+    y += ILI9341_Y_OFFSET;
+
+    _tft_queue_fixed(TFT_JOB_WINDOW, color, h, 1, x, y, x, y + h - 1);
 }
 
 /// \brief Draw a Horizontal Line Fast
@@ -649,24 +1044,139 @@ static void _tft_draw_fast_v_line(int16_t x, int16_t y, int16_t h, uint16_t colo
 /// \param x1 End X coordinate
 /// \param y1 End Y coordinate
 /// \param color Line color
-/// \details DMA accelerated
+/// \details DMA accelerated, single color word with memory increment off.
 static void _tft_draw_fast_h_line(int16_t x, int16_t y, int16_t w, uint16_t color)
 {
+    // Clip to the screen
+    if (y < 0 || y >= (int16_t)ILI9341.height) return;
+    if (x < 0)
+    {
+        w += x;
+        x = 0;
+    }
+    if (x + w > (int16_t)ILI9341.width) w = ILI9341.width - x;
+    if (w <= 0) return;
+
     x += ILI9341_X_OFFSET;
     y += ILI9341_Y_OFFSET;
 
-    uint16_t sz = 0;
-    for (int16_t j = 0; j < w; j++)
+    _tft_queue_fixed(TFT_JOB_WINDOW, color, w, 1, x, y, x +w -1, y);
+}
+
+// Sort key of a pixel, row major
+#define _pixel_key(p) (((uint32_t)(p).y << 16) | (p).x)
+
+// Insertion sort by row and column, then drop off-screen pixels and
+// collapse duplicates keeping the last one. Returns the new count.
+#define _tft_sort_pixels(type, pts, n)                                      \
+    do {                                                                    \
+        for (uint16_t i = 1; i < n; i++)                                    \
+        {                                                                   \
+            type     p   = pts[i];                                          \
+            uint32_t key = _pixel_key(p);                                   \
+            uint16_t j   = i;                                               \
+            for (; j > 0 && _pixel_key(pts[j - 1]) > key; j--)              \
+            {                                                               \
+                pts[j] = pts[j - 1];                                        \
+            }                                                               \
+            pts[j] = p;                                                     \
+        }                                                                   \
+        uint16_t kept = 0;                                                  \
+        for (uint16_t i = 0; i < n; i++)                                    \
+        {                                                                   \
+            if (pts[i].x >= ILI9341.width || pts[i].y >= ILI9341.height)    \
+                continue;                                                   \
+            if (kept > 0 && _pixel_key(pts[kept - 1]) == _pixel_key(pts[i])) \
+                kept--;                                                     \
+            pts[kept++] = pts[i];                                           \
+        }                                                                   \
+        n = kept;                                                           \
+    } while (0)
+
+// Send sorted colored pixels, one window per run
+static void _tft_draw_pixel_runs(const pixel_t* pts, uint16_t m)
+{
+    for (uint16_t i = 0; i < m; )
     {
-        _buffer[sz++] = color >> 8;
-        _buffer[sz++] = color;
+        uint16_t start = i;
+        for (i++; i < m && pts[i].y == pts[start].y && pts[i].x == pts[i - 1].x + 1; i++) {};
+
+        uint16_t x0 = pts[start].x + ILI9341_X_OFFSET;
+        uint16_t x1 = pts[i - 1].x + ILI9341_X_OFFSET;
+        uint16_t y  = pts[start].y + ILI9341_Y_OFFSET;
+        uint8_t  flags = TFT_JOB_WINDOW;
+
+        for (uint16_t k = start; k < i; )
+        {
+            uint16_t color = pts[k].color;
+            uint16_t len = 1;
+            for (k++; k < i && pts[k].color == color; k++) len++;
+
+            _tft_queue_fixed(flags, color, len, 1, x0, y, x1, y);
+            flags = 0;  // Same window, continue the RAMWR stream
+        }
+    }
+}
+
+// Batches are copied into a buffer half and sorted there. Runs are
+// sent as fixed color jobs, which do not read the buffer.
+#define TFT_POINTS_MAX (sizeof(_buffer[0]) / sizeof(point_t))   // 32
+#define TFT_PIXELS_MAX (sizeof(_buffer[0]) / sizeof(pixel_t))   // 21
+
+/// \brief Draw a Batch of Pixels
+/// \param points Pixel coordinates, not modified
+/// \param n Number of pixels
+/// \param color Pixel color
+/// \details Up to 32 pixels at a time are copied to the driver's scratch
+/// buffer and sorted there by row and column, horizontally adjacent
+/// pixels are merged into runs and each run is one window and one DMA
+/// burst. Runs do not span batches. The sort is O(n^2) per batch.
+void tft_draw_pixels(const point_t* points, uint16_t n, uint16_t color)
+{
+    point_t* pts = (point_t*)_buffer[_buffer_sel];
+    _tft_job_wait(_buffer_ticket[_buffer_sel]);     // half may still be on the wire
+
+    while (n > 0)
+    {
+        uint16_t m = (n < TFT_POINTS_MAX) ? n : TFT_POINTS_MAX;
+        for (uint16_t i = 0; i < m; i++) pts[i] = points[i];
+        points += m;
+        n -= m;
+
+        _tft_sort_pixels(point_t, pts, m);
+
+        for (uint16_t i = 0; i < m; )
+        {
+            uint16_t start = i;
+            for (i++; i < m && pts[i].y == pts[start].y && pts[i].x == pts[i - 1].x + 1; i++) {};
+
+            _tft_draw_fast_h_line(pts[start].x, pts[start].y, i - start, color);
+        }
+    }
+}
+
+/// \brief Draw a Batch of Colored Pixels
+/// \param pixels Pixel coordinates and colors, not modified
+/// \param n Number of pixels
+/// \details Like tft_draw_pixels() with batches of up to 21 pixels, each
+/// run is one window. Its pixels go out as one DMA burst per color change,
+/// continuing the same RAMWR stream. When a pixel is given twice, the
+/// last one wins.
+void tft_draw_pixels_color(const pixel_t* pixels, uint16_t n)
+{
+    pixel_t* pts = (pixel_t*)_buffer[_buffer_sel];
+    _tft_job_wait(_buffer_ticket[_buffer_sel]);     // half may still be on the wire
+
+    while (n > 0)
+    {
+        uint16_t m = (n < TFT_PIXELS_MAX) ? n : TFT_PIXELS_MAX;
+        for (uint16_t i = 0; i < m; i++) pts[i] = pixels[i];
+        pixels += m;
+        n -= m;
+
+        _tft_sort_pixels(pixel_t, pts, m);
+        _tft_draw_pixel_runs(pts, m);
     }
-    
-    GPIO_ResetBits(GPIOC, GPIO_Pin_4);   //START_WRITE();
-    tft_set_window(x, y, x +w -1, y);
-    GPIO_SetBits(GPIOC, GPIO_Pin_3);    //DATA_MODE();
-    SPI_send_DMA(_buffer, sz, 1);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);    //END_WRITE();
 }
 
 // Draw line helpers
@@ -683,7 +1193,9 @@ static void _tft_draw_fast_h_line(int16_t x, int16_t y, int16_t w, uint16_t colo
 /// \param x1 End X coordinate
 /// \param y1 End Y coordinate
 /// \param color Line color
-/// \details SPI direct write
+/// \details Pixels sharing a minor coordinate are coalesced into one run,
+/// shallow lines emit horizontal runs, steep lines vertical runs.
+/// A 45 degree segment degrades to single pixel runs.
 static void _tft_draw_line_bresenham(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
 {
     uint8_t steep = _diff(y1, y0) > _diff(x1, x0);
@@ -703,18 +1215,23 @@ static void _tft_draw_line_bresenham(int16_t x0, int16_t y0, int16_t x1, int16_t
     int16_t dy   = _diff(y1, y0);
     int16_t err  = dx >> 1;
     int16_t step = (y0 < y1) ? 1 : -1;
+    int16_t run  = x0;  // Start of the current run
 
     for (; x0 <= x1; x0++)
     {
-        if (steep)
-        {
-            tft_draw_pixel(y0, x0, color);
-        }
-        else
+        err -= dy;
+        if (err < 0 || x0 == x1)
         {
-            tft_draw_pixel(x0, y0, color);
+            if (steep)
+            {
+                _tft_draw_fast_v_line(y0, run, x0 - run + 1, color);
+            }
+            else
+            {
+                _tft_draw_fast_h_line(run, y0, x0 - run + 1, color);
+            }
+            run = x0 + 1;
         }
-        err -= dy;
         if (err < 0)
         {
             err += dx;
@@ -768,6 +1285,47 @@ void tft_draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t colo
     }
 }
 
+//-------------------------------------------------------------
+// Emit one run [xs, xe] of first octant points at height y of a circle
+// as horizontal runs (top and bottom octants) and vertical runs
+// (left and right octants). The diagonal point x == y belongs to the
+// horizontal runs only, so no pixel is sent twice.
+//-------------------------------------------------------------
+static void _tft_circle_runs(int16_t x0, int16_t y0, int16_t xs, int16_t xe, int16_t y, uint16_t color)
+{
+    int16_t ve = (xe < y) ? xe : y - 1;  // Vertical runs stop before the diagonal
+
+    if (xs == 0)
+    {
+        _tft_draw_fast_h_line(x0 - xe, y0 - y, (xe << 1) + 1, color);
+        _tft_draw_fast_h_line(x0 - xe, y0 + y, (xe << 1) + 1, color);
+        if (ve >= 0)
+        {
+            _tft_draw_fast_v_line(x0 - y, y0 - ve, (ve << 1) + 1, color);
+            _tft_draw_fast_v_line(x0 + y, y0 - ve, (ve << 1) + 1, color);
+        }
+        return;
+    }
+
+    _tft_draw_fast_h_line(x0 - xe, y0 - y, xe - xs + 1, color);
+    _tft_draw_fast_h_line(x0 + xs, y0 - y, xe - xs + 1, color);
+    _tft_draw_fast_h_line(x0 - xe, y0 + y, xe - xs + 1, color);
+    _tft_draw_fast_h_line(x0 + xs, y0 + y, xe - xs + 1, color);
+    if (ve >= xs)
+    {
+        _tft_draw_fast_v_line(x0 - y, y0 - ve, ve - xs + 1, color);
+        _tft_draw_fast_v_line(x0 + y, y0 - ve, ve - xs + 1, color);
+        _tft_draw_fast_v_line(x0 - y, y0 + xs, ve - xs + 1, color);
+        _tft_draw_fast_v_line(x0 + y, y0 + xs, ve - xs + 1, color);
+    }
+}
+
+/// \brief Draw a Circle
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param r Radius
+/// \param color Line color
+/// \details Midpoint circle, points with the same y are coalesced into runs.
 void tft_draw_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color) 
 {
 	int16_t f = 1 - r;
@@ -775,16 +1333,26 @@ void tft_draw_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
 	int16_t ddF_y = -2 * r;
 	int16_t x = 0;
 	int16_t y = r;
+    int16_t xs = 0;     // Start of the current run
+
+    if (r <= 0)
+    {
+        _tft_draw_fast_h_line(x0, y0, 1, color);
+        return;
+    }
 
-    tft_draw_pixel(x0, y0 + r, color);  // 180 deg point
-    tft_draw_pixel(x0, y0 - r, color);  // 360 deg point
-    tft_draw_pixel(x0 + r, y0, color);  // 90 deg point
-    tft_draw_pixel(x0 - r, y0, color);  // 270 deg point
+    while (1)
+    {
+        // Next point of the first octant is (x +1, y) or (x +1, y -1)
+        int16_t ny = (f >= 0) ? y - 1 : y;
+
+        if (ny != y || x + 1 > ny)
+        {
+            _tft_circle_runs(x0, y0, xs, x, y, color);
+            if (x + 1 > ny) break;
+            xs = x + 1;
+        }
 
-    // for (x =0; x < r; (x++; f +=2))
-    while (x < y) 
-	{
-        // for (y =r; y+2 >0; (y--; f +=2)) 
         if (f >= 0) 
 		{
             y--;    // y = y -1
@@ -794,49 +1362,710 @@ void tft_draw_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
         x++;    // x = x +1
         ddF_x += 2;
         f += ddF_x; // f = f +2
-        
-        // x =(0~r), y =(r ~0)
-        tft_draw_pixel(x0 +x, y0 +y, color);  // 135~180
-        tft_draw_pixel(x0 -x, y0 +y, color);  // 225~180
-        tft_draw_pixel(x0 +x, y0 -y, color);  // 360~45
-        tft_draw_pixel(x0 -x, y0 -y, color);  // 315~360 
+    }
+}
+
+// Fill the box [x0, x1] x [y0, y1] clipped to the screen
+static void _tft_fill_box(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= (int16_t)ILI9341.width) x1 = ILI9341.width -1;
+    if (y1 >= (int16_t)ILI9341.height) y1 = ILI9341.height -1;
+    if (x0 > x1 || y0 > y1) return;
+
+    _tft_fill_window(color, x0 +ILI9341_X_OFFSET, y0 +ILI9341_Y_OFFSET,
+                     x1 +ILI9341_X_OFFSET, y1 +ILI9341_Y_OFFSET);
+}
+
+//-------------------------------------------------------------
+// Fill a shape made of a center box [cx0, cx1] x [cy0, cy1] and four
+// elliptic corners with radius rx, ry as horizontal spans.
+// The box rows are one fill window, every other row is exactly one
+// span through the DMA h-line path, no row is sent twice.
+// Corner edge: dx^2 *ry^2 + dy^2 *rx^2 <= rx^2 *ry^2 + (rx^2 *ry + ry^2 *rx) /2,
+// tracked incrementally with additions only.
+//-------------------------------------------------------------
+static void _tft_fill_rounded(int16_t cx0, int16_t cy0, int16_t cx1, int16_t cy1,
+                              int16_t rx, int16_t ry, uint16_t color)
+{
+    if (rx < 0 || ry < 0 || cx1 < cx0 || cy1 < cy0) return;
+
+    // Center rows are one window
+    _tft_fill_box(cx0 -rx, cy0, cx1 +rx, cy1, color);
+
+    int32_t rx2 = (int32_t)rx *rx;
+    int32_t ry2 = (int32_t)ry *ry;
+    int32_t err = -(((int32_t)rx2 *ry + (int32_t)ry2 *rx) >> 1);  // dx =rx, dy =0
+    int32_t ddx = (int32_t)((rx << 1) -1) *ry2;   // (2dx -1) *ry^2
+    int32_t ddy = rx2;                            // (2dy -1) *rx^2 for dy =1
+    int16_t dx  = rx;
+
+    for (int16_t dy = 1; dy <= ry; dy++)
+    {
+        err += ddy;
+        ddy += rx2 << 1;
+        while (err > 0 && dx > 0)
+        {
+            err -= ddx;
+            ddx -= ry2 << 1;
+            dx--;
+        }
+
+        int16_t w = cx1 -cx0 +1 +(dx << 1);
+        _tft_draw_fast_h_line(cx0 -dx, cy0 -dy, w, color);
+        _tft_draw_fast_h_line(cx0 -dx, cy1 +dy, w, color);
+    }
+}
+
+/// \brief Fill a Circle
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param r Radius
+/// \param color Fill color
+/// \details One DMA h-line span per row.
+void tft_fill_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+    _tft_fill_rounded(x0, y0, x0, y0, r, r, color);
+}
+
+/// \brief Fill an Ellipse
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param rx Horizontal radius
+/// \param ry Vertical radius
+/// \param color Fill color
+/// \details One DMA h-line span per row.
+void tft_fill_ellipse(int16_t x0, int16_t y0, int16_t rx, int16_t ry, uint16_t color)
+{
+    _tft_fill_rounded(x0, y0, x0, y0, rx, ry, color);
+}
+
+/// \brief Fill a Rounded Rectangle
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param width Width
+/// \param height Height
+/// \param r Corner radius, at most (side -1) /2
+/// \param color Fill color
+/// \details The straight middle part is one fill window, corners are DMA h-line spans.
+void tft_fill_round_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t r, uint16_t color)
+{
+    // At most half the inner size: an even side keeps a straight middle
+    // of 2 pixels and the corner centers stay in order
+    if (r > ((width -1) >> 1)) r = (width -1) >> 1;
+    if (r > ((height -1) >> 1)) r = (height -1) >> 1;
+
+    _tft_fill_rounded(x +r, y +r, x +width -1 -r, y +height -1 -r, r, r, color);
+}
+
+/// \brief Show a Sprite
+/// \param sprite Sprite with position, size and colors set
+/// \details Fills the whole sprite once, later moves only send the difference.
+void tft_sprite_show(tft_sprite_t* sprite)
+{
+    _tft_fill_box(sprite->x, sprite->y, sprite->x + sprite->width - 1, sprite->y + sprite->height - 1,
+                  sprite->color);
+    sprite->visible = 1;
+}
+
+/// \brief Hide a Sprite
+/// \param sprite Sprite to restore to its background color
+void tft_sprite_hide(tft_sprite_t* sprite)
+{
+    if (!sprite->visible) return;
+
+    _tft_fill_box(sprite->x, sprite->y, sprite->x + sprite->width - 1, sprite->y + sprite->height - 1,
+                  sprite->bg);
+    sprite->visible = 0;
+}
+
+/// \brief Move a Sprite
+/// \param sprite Visible sprite
+/// \param x New X coordinate
+/// \param y New Y coordinate
+/// \details Only the damage is sent: the strips the sprite newly covers are
+/// filled with its color, the strips it leaves are restored to the background.
+/// Each side is at most one full width strip and one strip over the shared rows,
+/// an L-shaped region. A 40x20 sprite moving by (2, 2) sends 232 pixels instead of 800.
+void tft_sprite_move(tft_sprite_t* sprite, int16_t x, int16_t y)
+{
+    int16_t w = sprite->width, h = sprite->height;
+    int16_t ox = sprite->x, oy = sprite->y;
+    int16_t dx = x - ox, dy = y - oy;
+
+    sprite->x = x;
+    sprite->y = y;
+
+    if (!sprite->visible || dx <= -w || dx >= w || dy <= -h || dy >= h)
+    {
+        // No overlap, erase and draw in full
+        if (sprite->visible)
+        {
+            _tft_fill_box(ox, oy, ox + w - 1, oy + h - 1, sprite->bg);
+        }
+        tft_sprite_show(sprite);
+        return;
+    }
+
+    // Rows shared by the old and the new position
+    int16_t top    = (dy > 0) ? y : oy;
+    int16_t bottom = (dy > 0) ? oy + h - 1 : y + h - 1;
+
+    if (dy > 0)
+    {
+        _tft_fill_box(ox, oy, ox + w - 1, y - 1, sprite->bg);           // Uncovered top
+        _tft_fill_box(x, oy + h, x + w - 1, y + h - 1, sprite->color);  // Covered bottom
+    }
+    else if (dy < 0)
+    {
+        _tft_fill_box(x, y, x + w - 1, oy - 1, sprite->color);          // Covered top
+        _tft_fill_box(ox, y + h, ox + w - 1, oy + h - 1, sprite->bg);   // Uncovered bottom
+    }
+
+    if (dx > 0)
+    {
+        _tft_fill_box(ox, top, x - 1, bottom, sprite->bg);              // Uncovered left
+        _tft_fill_box(ox + w, top, x + w - 1, bottom, sprite->color);   // Covered right
+    }
+    else if (dx < 0)
+    {
+        _tft_fill_box(x, top, ox - 1, bottom, sprite->color);           // Covered left
+        _tft_fill_box(x + w, top, ox + w - 1, bottom, sprite->bg);      // Uncovered right
+    }
+}
+
+//-------------------------------------------------------------
+// Vertical scrolling
+// The panel scrolls along its 320 lines, the screen x axis in landscape.
+// MADCTL has MY set, so panel line 0 is the right screen edge and screen
+// column x shows panel line 319 -x when not scrolled: the top fixed area
+// (TFA) is the right strip and the bottom fixed area (BFA) the left strip.
+//-------------------------------------------------------------
+#define _tft_line_x(line) (ILI9341_TFT_WIDTH - 1 - (line))    // Landscape only
+
+/// \brief Define the Vertical Scrolling Area
+/// \param left Fixed columns on the left
+/// \param right Fixed columns on the right
+void tft_scroll_area(uint16_t left, uint16_t right)
+{
+    tft_dma_wait();
+
+    write_command_8(ILI9341_VSCRDEF);
+    write_data_range(right, ILI9341_TFT_WIDTH - left - right);  // TFA, VSA
+    write_data_8(left >> 8);                                     // BFA
+    write_data_8(left);
+    GPIO_SetBits(GPIOC, SPI_CS);
+}
+
+/// \brief Set the Vertical Scrolling Start Address
+/// \param line Panel line shown first in the scrolling area
+void tft_scroll(uint16_t line)
+{
+    tft_dma_wait();
+
+    write_command_8(ILI9341_VSCRSADD);
+    write_data_8(line >> 8);
+    write_data_8(line);
+    GPIO_SetBits(GPIOC, SPI_CS);
+}
+
+/// \brief Turn Scrolling Off, whole screen unscrolled
+void tft_scroll_reset(void)
+{
+    tft_scroll_area(0, 0);
+    tft_scroll(0);
+}
+
+#if TFT_CHART
+/// \brief Initialize a Strip Chart
+/// \param chart Chart with fixed columns and colors set
+/// \details Clears the scrolling area and draws the grid.
+void tft_chart_init(tft_chart_t* chart)
+{
+    int16_t x0 = chart->left, x1 = ILI9341_TFT_WIDTH - 1 - chart->right;
+
+    tft_scroll_area(chart->left, chart->right);
+    chart->line = chart->right;     // First line of the scrolling area, unscrolled
+    chart->last = -1;
+    tft_scroll(chart->line);
+
+    _tft_fill_box(x0, 0, x1, ILI9341.height - 1, chart->bg);
+    if (chart->grid_mask)
+    {
+        for (int16_t y = 0; y < (int16_t)ILI9341.height; y += chart->grid_mask + 1)
+        {
+            _tft_draw_fast_h_line(x0, y, x1 - x0 + 1, chart->grid);
+        }
+    }
+}
+
+/// \brief Add a Sample to a Strip Chart
+/// \param chart Initialized chart
+/// \param value Sample 0 ~ (1 << chart->bits) -1
+/// \details The oldest column, shown at the left end of the scrolling area,
+/// is redrawn with the new sample and becomes the right end by moving the
+/// start line back by one. A column is one window and 480 bytes, whatever
+/// the chart width. The trace joins the previous sample with a vertical run.
+void tft_chart_push(tft_chart_t* chart, uint16_t value)
+{
+    uint16_t first = chart->right;
+    uint16_t last  = ILI9341_TFT_WIDTH - 1 - chart->left;
+    int16_t  h     = ILI9341.height;
+
+    int16_t y = h - 1 - (int16_t)(((uint32_t)value * h) >> chart->bits);
+    if (y < 0) y = 0;
+
+    int16_t lo = y, hi = y;
+    if (chart->last >= 0)
+    {
+        if (chart->last < lo) lo = chart->last;
+        if (chart->last > hi) hi = chart->last;
+    }
+    chart->last = y;
+
+    chart->line = (chart->line == first) ? last : chart->line - 1;
+    uint16_t x = _tft_line_x(chart->line) + ILI9341_X_OFFSET;
+
+    uint8_t  flags = TFT_JOB_WINDOW | TFT_JOB_16BIT;
+    for (int16_t y0 = 0; y0 < h; y0 += TFT_BAND_LEN)
+    {
+        int16_t   n = (h - y0 < (int16_t)TFT_BAND_LEN) ? h - y0 : (int16_t)TFT_BAND_LEN;
+        uint16_t* p = _buffer[_buffer_sel];
+
+        _tft_job_wait(_buffer_ticket[_buffer_sel]);    // half may still be on the wire
+
+        for (int16_t row = y0; row < y0 + n; row++)
+        {
+            if (row >= lo && row <= hi) *p++ = chart->color;
+            else if (chart->grid_mask && !(row & chart->grid_mask)) *p++ = chart->grid;
+            else *p++ = chart->bg;
+        }
+
+        _buffer_ticket[_buffer_sel] = _tft_queue(flags, _buffer[_buffer_sel], n, 1,
+                                                 x, ILI9341_Y_OFFSET, x, h - 1 + ILI9341_Y_OFFSET);
+        flags = TFT_JOB_16BIT;  // Following bands continue the RAMWR stream
+        _buffer_sel ^= 1;
+    }
+
+    tft_scroll(chart->line);
+}
+#endif  // TFT_CHART
+
+/// \brief Set Screen Rotation
+/// \param mode ili9341_landscape (320x240) or ili9341_portrait (240x320)
+/// \details In portrait the panel scroll axis is the screen y axis,
+/// panel line y is screen row y.
+void tft_set_rotation(ili9341_orient_mode_t mode)
+{
+    tft_dma_wait();
+
+    write_command_8(ILI9341_MADCTL);
+    if (mode == ili9341_portrait)
+    {
+        write_data_8(ILI9341_MADCTL_MX | ILI9341_MADCTL_BGR);
+        ILI9341.width  = ILI9341_TFT_HEIGHT;
+        ILI9341.height = ILI9341_TFT_WIDTH;
+    }
+    else
+    {
+        write_data_8(ILI9341_MADCTL_MX | ILI9341_MADCTL_MY | ILI9341_MADCTL_MV | ILI9341_MADCTL_BGR);
+        ILI9341.width  = ILI9341_TFT_WIDTH;
+        ILI9341.height = ILI9341_TFT_HEIGHT;
+    }
+    GPIO_SetBits(GPIOC, SPI_CS);
+
+    ILI9341.lcd_orientation = mode;
+    _tft_window_invalidate();   // Column and page ranges swap meaning
+}
+
+#if TFT_CONSOLE
+//-------------------------------------------------------------
+// Text console, portrait
+// Text rows live in a ring of ILI9341_TFT_WIDTH / FONT_HEIGHT rows
+// over the 320 panel lines. A new line past the bottom clears the
+// oldest row, writes there and scrolls it to the bottom with one
+// VSCRSADD write, the rest of the screen is not sent again.
+//-------------------------------------------------------------
+static uint16_t _con_x   = 0;   // Column of the next character
+static uint16_t _con_y   = 0;   // Panel line of the current text row
+static uint16_t _con_top = 0;   // Panel line shown at the top (scroll start)
+static uint8_t  _con_on  = 0;   // Console started, writes before are dropped
+
+// Start the next text row, recycling the oldest one when the ring is full
+static void _tft_console_newline(void)
+{
+    _con_x = 0;
+    _con_y += FONT_HEIGHT;
+    if (_con_y + FONT_HEIGHT > ILI9341_TFT_WIDTH) _con_y = 0;
+
+    if (_con_y == _con_top)
+    {
+        _tft_fill_box(0, _con_y, ILI9341.width - 1, _con_y + FONT_HEIGHT - 1, _bg_color);
+        _con_top += FONT_HEIGHT;
+        if (_con_top + FONT_HEIGHT > ILI9341_TFT_WIDTH) _con_top = 0;
+        tft_scroll(_con_top);
+    }
+}
+
+/// \brief Start the Text Console
+/// \details Switches to portrait, clears the screen with the text
+/// background color and puts the cursor at the top left.
+void tft_console_init(void)
+{
+    tft_set_rotation(ili9341_portrait);
+    tft_scroll_reset();
+    tft_fill_rect(0, 0, ILI9341.width, ILI9341.height, _bg_color);
+
+    _con_x   = 0;
+    _con_y   = 0;
+    _con_top = 0;
+    _con_on  = 1;
+}
+
+/// \brief Write Text to the Console
+/// \param str Text, not null terminated
+/// \param len Number of characters
+/// \details Handles '\n', '\r' and wraps at the right edge.
+/// Printable runs of a row are one window and one DMA stream.
+/// Text written before tft_console_init() is dropped.
+void tft_console_write(const char* str, uint16_t len)
+{
+    if (!_con_on) return;
+
+    uint16_t cursor_x = _cursor_x, cursor_y = _cursor_y;
+
+    while (len)
+    {
+        if (*str == '\n')
+        {
+            _tft_console_newline();
+            str++;
+            len--;
+            continue;
+        }
+        if (*str == '\r')
+        {
+            _con_x = 0;
+            str++;
+            len--;
+            continue;
+        }
+
+        if (_con_x + TFT_CELL_WIDTH > ILI9341.width)
+        {
+            _tft_console_newline();
+        }
+
+        // Run of printable characters up to the end of the row
+        uint16_t room = (ILI9341.width - _con_x) / TFT_CELL_WIDTH;
+        uint16_t n = 0;
+        while (n < len && n < room && str[n] != '\n' && str[n] != '\r') n++;
+
+        _cursor_x = _con_x;
+        _cursor_y = _con_y;
+        _tft_print_run(str, n);
+
+        _con_x += n * TFT_CELL_WIDTH;
+        str += n;
+        len -= n;
+    }
+
+    _cursor_x = cursor_x;
+    _cursor_y = cursor_y;
+}
+
+#endif  // TFT_CONSOLE
+
+#if TFT_DISPLAY_LIST
+//-------------------------------------------------------------
+// Display list
+// Retained items are rasterized in painter's order into the
+// ping-pong _buffer, in raster order over the rendered area:
+// a band is as many whole rows as fit a buffer half, or a slice of
+// one row on wide areas. The final color of each pixel is resolved
+// in RAM, so every pixel of the area is sent exactly once.
+//-------------------------------------------------------------
+#define TFT_DL_RECT   0
+#define TFT_DL_TEXT   1
+#define TFT_DL_CIRCLE 2
+#define TFT_DL_BITMAP 3
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  opaque;            // Text: paint the background of the cells
+    int16_t  x0, y0, x1, y1;    // Bounding box, inclusive
+    int16_t  sx0, sx1;          // Span on the row being rasterized, empty if sx0 > sx1
+    uint16_t color;
+    uint16_t bg;
+    union
+    {
+        const char*    str;
+        const uint8_t* bitmap;
+        struct
+        {
+            int16_t r;
+            int16_t dx;         // Half width on the last rasterized row
+        } circ;
+    } u;
+} tft_dl_item_t;
+
+static tft_dl_item_t _dl[TFT_DL_LEN];
+static uint8_t       _dl_len = 0;
 
-        tft_draw_pixel(x0 +y, y0 +x, color);
-        tft_draw_pixel(x0 -y, y0 +x, color);
-        tft_draw_pixel(x0 +y, y0 -x, color);
-        tft_draw_pixel(x0 -y, y0 -x, color);
+// Append an item, returns NULL if the list is full or the box is empty
+static tft_dl_item_t* _tft_dl_add(uint8_t type, int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+    if (_dl_len >= TFT_DL_LEN || x1 < x0 || y1 < y0) return 0;
+
+    tft_dl_item_t* item = &_dl[_dl_len++];
+    item->type  = type;
+    item->x0    = x0;
+    item->y0    = y0;
+    item->x1    = x1;
+    item->y1    = y1;
+    item->color = color;
+    return item;
+}
+
+// Index of an item for the caller, -1 if it was not added.
+// Evaluates item twice, pass a variable.
+#define _tft_dl_index(item) ((item) ? (int8_t)((item) - _dl) : -1)
+
+// Compute the span of every item on row y
+static void _tft_dl_row(int16_t y)
+{
+    for (tft_dl_item_t* item = _dl; item < _dl + _dl_len; item++)
+    {
+        if (y < item->y0 || y > item->y1)
+        {
+            item->sx0 = 1;
+            item->sx1 = 0;
+            continue;
+        }
+
+        if (item->type == TFT_DL_CIRCLE)
+        {
+            // Same edge as tft_fill_circle(): dx^2 + dy^2 <= r^2 + r.
+            // Rows are rasterized in order, dx moves a few steps per row.
+            int16_t r   = item->u.circ.r;
+            int16_t dx  = item->u.circ.dx;
+            int16_t dy  = y - item->y0 - r;
+            int32_t lim = (int32_t)r * r + r - (int32_t)dy * dy;
+
+            while (dx < r && (int32_t)(dx + 1) * (dx + 1) <= lim) dx++;
+            while (dx > 0 && (int32_t)dx * dx > lim) dx--;
+
+            item->u.circ.dx = dx;
+            item->sx0 = item->x0 + r - dx;
+            item->sx1 = item->x0 + r + dx;
+        }
+        else
+        {
+            item->sx0 = item->x0;
+            item->sx1 = item->x1;
+        }
     }
 }
 
-void tft_fill_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color) 
+// Rasterize columns [xs, xe] of row y into dst
+static void _tft_dl_paint(uint16_t* dst, int16_t y, int16_t xs, int16_t xe, uint16_t bg)
 {
-    int x = r;
-    int y = 0;
-    int xChange = 1 - (r << 1);
-    int yChange = 0;
-    int radiusError = 0;
+    for (uint16_t* p = dst; p <= dst + (xe - xs); p++) *p = bg;
 
-    while (x >= y)
+    for (const tft_dl_item_t* item = _dl; item < _dl + _dl_len; item++)
     {
-        for (int i = x0 - x; i <= x0 + x; i++)
+        int16_t a = (item->sx0 > xs) ? item->sx0 : xs;
+        int16_t b = (item->sx1 < xe) ? item->sx1 : xe;
+        if (a > b) continue;
+
+        uint16_t* p = dst + (a - xs);
+        uint16_t  color = item->color;
+
+        switch (item->type)
         {
-            tft_draw_pixel(i, y0 +y, color);
-            tft_draw_pixel(i, y0 -y, color);
+        case TFT_DL_TEXT:
+        {
+            uint16_t    col  = a - item->x0;
+            uint8_t     row  = y - item->y0;
+            const char* s    = item->u.str + col / TFT_CELL_WIDTH;
+            uint8_t     mask = 0x80 >> (col % TFT_CELL_WIDTH);
+            uint8_t     ch   = *s;
+            if (ch < 32 || ch > 126) ch = ' ';
+            uint8_t     bits = font7x10[(ch -32) *FONT_HEIGHT +row] << 1;  // Bit 0 is the gap column
+
+            for (; a <= b; a++, p++)
+            {
+                if (bits & mask) *p = color;
+                else if (item->opaque) *p = item->bg;
+
+                mask >>= 1;
+                if (!mask && a < b)
+                {
+                    mask = 0x80;
+                    ch = *++s;
+                    if (ch < 32 || ch > 126) ch = ' ';
+                    bits = font7x10[(ch -32) *FONT_HEIGHT +row] << 1;
+                }
+            }
+            break;
         }
-        for (int i = x0 -y; i <= x0 +y; i++)
+
+        case TFT_DL_BITMAP:
         {
-            tft_draw_pixel(i, y0 +x, color);
-            tft_draw_pixel(i, y0 -x, color);
+            // Big endian RGB565, as sent by tft_draw_bitmap()
+            const uint8_t* src = item->u.bitmap +
+                (((uint32_t)(y - item->y0) * (item->x1 - item->x0 + 1) + (a - item->x0)) << 1);
+            for (; a <= b; a++, src += 2) *p++ = (src[0] << 8) | src[1];
+            break;
         }
 
-        y++;
-        radiusError += yChange;
-        yChange += 2;
-        if (((radiusError << 1) + xChange) > 0)
+        default:    // Rectangle, circle span
+            for (; a <= b; a++) *p++ = color;
+            break;
+        }
+    }
+}
+
+/// \brief Clear the Display List
+void tft_dl_clear(void)
+{
+    _dl_len = 0;
+}
+
+/// \brief Add a Filled Rectangle to the Display List
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param width Width
+/// \param height Height
+/// \param color Fill color
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint16_t color)
+{
+    tft_dl_item_t* item = _tft_dl_add(TFT_DL_RECT, x, y, x + width - 1, y + height - 1, color);
+    return _tft_dl_index(item);
+}
+
+/// \brief Add a Horizontal Span to the Display List
+/// \param x Start X coordinate
+/// \param y Y coordinate
+/// \param width Width
+/// \param color Span color
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_span(int16_t x, int16_t y, int16_t width, uint16_t color)
+{
+    return tft_dl_rect(x, y, width, 1, color);
+}
+
+/// \brief Add a String to the Display List
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param str String, must stay valid while the item is in the list
+/// \param color Text color
+/// \param bg Background color of the cells, or ILI9341_TRANSPARENT
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_text(int16_t x, int16_t y, const char* str, uint16_t color, uint32_t bg)
+{
+    int16_t n = 0;
+    while (str[n]) n++;
+
+    tft_dl_item_t* item = _tft_dl_add(TFT_DL_TEXT, x, y, x + n * TFT_CELL_WIDTH - 1, y + FONT_HEIGHT - 1, color);
+    if (item)
+    {
+        item->u.str  = str;
+        item->bg     = bg;
+        item->opaque = !(bg & ILI9341_TRANSPARENT);
+    }
+    return _tft_dl_index(item);
+}
+
+/// \brief Add a Filled Circle to the Display List
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param r Radius
+/// \param color Fill color
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+    tft_dl_item_t* item = (r < 0) ? 0 : _tft_dl_add(TFT_DL_CIRCLE, x0 - r, y0 - r, x0 + r, y0 + r, color);
+    if (item)
+    {
+        item->u.circ.r = r;
+    }
+    return _tft_dl_index(item);
+}
+
+/// \brief Add a Bitmap to the Display List
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param width Width
+/// \param height Height
+/// \param bitmap Bitmap, must stay valid while the item is in the list
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_bitmap(int16_t x, int16_t y, int16_t width, int16_t height, const uint8_t* bitmap)
+{
+    tft_dl_item_t* item = _tft_dl_add(TFT_DL_BITMAP, x, y, x + width - 1, y + height - 1, 0);
+    if (item)
+    {
+        item->u.bitmap = bitmap;
+    }
+    return _tft_dl_index(item);
+}
+
+/// \brief Render the Display List into an Area
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param width Width
+/// \param height Height
+/// \param bg Background color under the items
+/// \details One address window for the area, every pixel is sent once.
+/// A buffer half is rasterized while DMA drains the other one.
+void tft_dl_render(int16_t x, int16_t y, int16_t width, int16_t height, uint16_t bg)
+{
+    int16_t left = x, top = y, right = x + width - 1, bottom = y + height - 1;
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right >= (int16_t)ILI9341.width) right = ILI9341.width - 1;
+    if (bottom >= (int16_t)ILI9341.height) bottom = ILI9341.height - 1;
+    if (left > right || top > bottom) return;
+
+    for (tft_dl_item_t* item = _dl; item < _dl + _dl_len; item++)
+    {
+        if (item->type == TFT_DL_CIRCLE) item->u.circ.dx = 0;
+    }
+
+    uint8_t  flags = TFT_JOB_WINDOW | TFT_JOB_16BIT;
+    uint16_t fill  = 0;     // Pixels in the current buffer half
+
+    for (int16_t row = top; row <= bottom; row++)
+    {
+        _tft_dl_row(row);
+
+        for (int16_t xs = left; xs <= right; )
         {
-            x--;
-            radiusError += xChange;
-            xChange += 2;
+            if (fill == 0)
+            {
+                _tft_job_wait(_buffer_ticket[_buffer_sel]);    // half may still be on the wire
+            }
+
+            int16_t n = right - xs + 1;
+            if (n > (int16_t)(TFT_BAND_LEN - fill)) n = TFT_BAND_LEN - fill;
+
+            _tft_dl_paint(&_buffer[_buffer_sel][fill], row, xs, xs + n - 1, bg);
+            fill += n;
+            xs   += n;
+
+            if (fill == TFT_BAND_LEN || (row == bottom && xs > right))
+            {
+                _buffer_ticket[_buffer_sel] = _tft_queue(flags, _buffer[_buffer_sel], fill, 1,
+                                                         left +ILI9341_X_OFFSET, top +ILI9341_Y_OFFSET,
+                                                         right +ILI9341_X_OFFSET, bottom +ILI9341_Y_OFFSET);
+                flags = TFT_JOB_16BIT;  // Following bands continue the RAMWR stream
+                _buffer_sel ^= 1;
+                fill = 0;
+            }
         }
     }
 }
+#endif  // TFT_DISPLAY_LIST
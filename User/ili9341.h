@@ -15,12 +15,47 @@
 
 #include "ch32v00x.h"
 #include "ch32v00x_spi.h"
+#include "fmt.h"
 
 // Delays
 #define ILI9341_RST_DELAY    50   // delay ms wait for reset finish
 #define ILI9341_SLPOUT_DELAY 120  // delay ms wait for sleep out finish
 #define ILI9341_TRANSPARENT	0x80000000
 
+// SPI-DMA transfer engine, number of queued jobs (power of 2)
+// Drawing functions queue jobs, call them from the main loop with
+// interrupts enabled, never from an interrupt handler.
+#define TFT_DMA_QUEUE_LEN    4
+
+// Glyph expansion, 1 = nibble lookup table (128 bytes RAM), 0 = test one font bit per pixel
+#ifndef TFT_GLYPH_LUT
+#define TFT_GLYPH_LUT        1
+#endif
+
+// Optional parts, 1 = built. The defaults fit the 16KB flash of the
+// CH32V003 together with the SPWM, ADC and UART console firmware.
+// Display list, tft_dl_*() (about 2KB flash, 300 bytes RAM)
+#ifndef TFT_DISPLAY_LIST
+#define TFT_DISPLAY_LIST     0
+#endif
+
+// Hardware scrolled strip chart, tft_chart_*() (about 700 bytes flash)
+#ifndef TFT_CHART
+#define TFT_CHART            0
+#endif
+
+// Text console for printf, tft_console_*(), on with PRINT_TARGET_TFT
+#ifndef TFT_CONSOLE
+#if defined(PRINT_TARGET) && (PRINT_TARGET == PRINT_TARGET_TFT)
+#define TFT_CONSOLE          1
+#else
+#define TFT_CONSOLE          0
+#endif
+#endif
+
+// Display list, number of retained items
+#define TFT_DL_LEN           12
+
 // System Function Command List - Write Commands Only
 #define ILI9341_NOP     0x00
 #define ILI9341_SWRESET 0x01
@@ -47,9 +82,11 @@
 #define ILI9341_RAMRD   0x2E
 
 #define ILI9341_PLTAR   0x30  // Partial Area
+#define ILI9341_VSCRDEF 0x33  // Vertical Scrolling Definition
 #define ILI9341_TEOFF   0x34  // Tearing Effect Line Off
 #define ILI9341_TEON    0x35  // Tearing Effect Line On
 #define ILI9341_MADCTL  0x36  // Memory Data Access Control
+#define ILI9341_VSCRSADD 0x37 // Vertical Scrolling Start Address
 #define ILI9341_IDMOFF  0x38  // Idle Mode Off
 #define ILI9341_IDMON   0x39  // Idle Mode On
 #define ILI9341_COLMOD  0x3A  // Interface Pixel Format
@@ -116,9 +153,96 @@
 #define GREENYELLOW RGB(173, 255, 41)
 #define PINK        RGB(255, 130, 198)
 
+typedef enum 
+{
+	ili9341_landscape = 0,
+	ili9341_portrait
+} ili9341_orient_mode_t;
+
+/// \brief SPI Traffic Counters
+/// \details Updated by the SPI-DMA transfer engine, clear them before a measurement.
+typedef struct
+{
+    uint32_t bytes;     // Bytes sent on SPI (window commands and pixel data)
+    uint32_t arms;      // DMA1-CH3 arms
+    uint32_t windows;   // Address windows requested
+    uint32_t caset_skipped;     // CASET not sent, column range unchanged
+    uint32_t raset_skipped;     // RASET not sent, same start row, end covered
+    uint32_t ramwr_continued;   // Window continued the open RAMWR stream, nothing sent
+} tft_stats_t;
+
+extern tft_stats_t tft_stats;
+
+/// \brief Pixel Coordinate for tft_draw_pixels()
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+} point_t;
+
+/// \brief Pixel with Color for tft_draw_pixels_color()
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t color;
+} pixel_t;
+
+/// \brief Solid Rectangle Sprite for tft_sprite_move()
+typedef struct
+{
+    int16_t  x;
+    int16_t  y;
+    int16_t  width;
+    int16_t  height;
+    uint16_t color;     // Sprite color
+    uint16_t bg;        // Background restored where the sprite leaves
+    uint8_t  visible;
+} tft_sprite_t;
+
+#if TFT_CHART
+/// \brief Hardware Scrolled Strip Chart for tft_chart_push()
+/// \details Uses the whole screen height between the fixed columns.
+typedef struct
+{
+    uint16_t left;      // Fixed columns on the left, not scrolled
+    uint16_t right;     // Fixed columns on the right, not scrolled
+    uint16_t color;     // Trace color
+    uint16_t bg;        // Background color
+    uint16_t grid;      // Grid line color
+    uint8_t  grid_mask; // Grid line on rows with (y & grid_mask) == 0, 0 = no grid
+    uint8_t  bits;      // Sample resolution, samples are 0 ~ (1 << bits) -1
+    uint16_t line;      // Scroll start line
+    int16_t  last;      // Trace row of the previous sample, -1 = none
+} tft_chart_t;
+#endif
+
+/// \brief Numeric Readout for tft_field_set()
+/// \details Set position, width, decimals and colors, the rest is state.
+typedef struct
+{
+    uint16_t x;
+    uint16_t y;
+    uint8_t  width;         // Characters, right aligned with spaces
+    uint8_t  decimals;      // Digits right of the decimal point, 0 = integer
+    uint16_t color;         // Digit color
+    uint16_t bg;            // Background color
+    char     last[FMT_LEN]; // Characters on screen, 0 = not drawn
+    uint8_t  len;           // Number of characters on screen
+} tft_field_t;
+
 /// \brief Initialize ST7735
 void tft_init(void);
 
+/// \brief Wait for all Queued SPI-DMA Transfers
+/// \details Drawing functions return as soon as their transfer is queued,
+/// call this before reusing a bitmap passed to `tft_draw_bitmap`.
+void tft_dma_wait(void);
+
+/// \brief Check the SPI-DMA Transfer Engine
+/// \return 1 if transfers are queued or on the wire
+uint8_t tft_dma_busy(void);
+
 /// \brief Set Cursor Position for Print Functions
 /// \param x X coordinate, from left to right.
 /// \param y Y coordinate, from top to bottom.
@@ -147,12 +271,50 @@ void tft_print(const char* str);
 /// Align right if it is greater than the width of the number.
 void tft_print_number(int32_t num, uint16_t width);
 
+/// \brief Print an Unsigned Decimal
+/// \param value Number to print
+/// \param digits Field width in characters, right aligned with spaces
+void tft_print_dec(uint32_t value, uint8_t digits);
+
+/// \brief Print a Fixed Point Decimal
+/// \param value Number in units of 10^-decimals, e.g. mV with 3 decimals for V
+/// \param digits Field width in characters including the point
+/// \param decimals Digits right of the decimal point
+void tft_print_fixed(uint32_t value, uint8_t digits, uint8_t decimals);
+
+/// \brief Print a Hexadecimal
+/// \param value Number to print
+/// \param digits Number of digits, leading zeros kept
+void tft_print_hex(uint32_t value, uint8_t digits);
+
+/// \brief Update a Numeric Readout
+/// \param field Readout, zero initialized state draws it in full
+/// \param value Number, in units of 10^-decimals
+/// \details Only characters that differ from the screen are sent.
+/// Sets the text colors to the field colors.
+void tft_field_set(tft_field_t* field, uint32_t value);
+
+/// \brief Redraw a Numeric Readout in Full on the Next Update
+/// \param field Readout, e.g. after the screen was cleared
+void tft_field_invalidate(tft_field_t* field);
+
 /// \brief Draw a Pixel
 /// \param x X
 /// \param y Y
 /// \param color Pixel color
 void tft_draw_pixel(uint16_t x, uint16_t y, uint16_t color);
 
+/// \brief Draw a Batch of Pixels
+/// \param points Pixel coordinates, not modified
+/// \param n Number of pixels
+/// \param color Pixel color
+void tft_draw_pixels(const point_t* points, uint16_t n, uint16_t color);
+
+/// \brief Draw a Batch of Colored Pixels
+/// \param pixels Pixel coordinates and colors, not modified
+/// \param n Number of pixels
+void tft_draw_pixels_color(const pixel_t* pixels, uint16_t n);
+
 /// \brief Draw a Line
 /// \param x0 Start X coordinate
 /// \param y0 Start Y coordinate
@@ -186,6 +348,121 @@ void tft_fill_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint
 void tft_draw_bitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bitmap);
 
 void tft_draw_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+/// \brief Fill a Circle
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param r Radius
+/// \param color Fill color
 void tft_fill_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
 
+/// \brief Fill an Ellipse
+/// \param x0 Center X coordinate
+/// \param y0 Center Y coordinate
+/// \param rx Horizontal radius
+/// \param ry Vertical radius
+/// \param color Fill color
+void tft_fill_ellipse(int16_t x0, int16_t y0, int16_t rx, int16_t ry, uint16_t color);
+
+/// \brief Fill a Rounded Rectangle
+/// \param x Start X coordinate
+/// \param y Start Y coordinate
+/// \param width Width
+/// \param height Height
+/// \param r Corner radius, at most (side -1) /2
+/// \param color Fill color
+void tft_fill_round_rect(int16_t x, int16_t y, int16_t width, int16_t height, int16_t r, uint16_t color);
+
+/// \brief Show a Sprite
+/// \param sprite Sprite with position, size and colors set
+void tft_sprite_show(tft_sprite_t* sprite);
+
+/// \brief Hide a Sprite
+/// \param sprite Sprite to restore to its background color
+void tft_sprite_hide(tft_sprite_t* sprite);
+
+/// \brief Move a Sprite
+/// \param sprite Visible sprite
+/// \param x New X coordinate
+/// \param y New Y coordinate
+/// \details Sends only the newly covered and the uncovered strips.
+void tft_sprite_move(tft_sprite_t* sprite, int16_t x, int16_t y);
+
+/// \brief Define the Vertical Scrolling Area
+/// \param left Fixed columns on the left
+/// \param right Fixed columns on the right
+/// \details In landscape the panel scrolls along the 320 pixel side.
+void tft_scroll_area(uint16_t left, uint16_t right);
+
+/// \brief Set the Vertical Scrolling Start Address
+/// \param line Panel line shown first in the scrolling area
+void tft_scroll(uint16_t line);
+
+/// \brief Turn Scrolling Off, whole screen unscrolled
+void tft_scroll_reset(void);
+
+#if TFT_CHART
+/// \brief Initialize a Strip Chart
+/// \param chart Chart with fixed columns and colors set
+/// \details Clears the scrolling area and draws the grid.
+void tft_chart_init(tft_chart_t* chart);
+
+/// \brief Add a Sample to a Strip Chart
+/// \param chart Initialized chart
+/// \param value Sample 0 ~ (1 << chart->bits) -1
+/// \details Draws one new column and scrolls the chart by one pixel.
+void tft_chart_push(tft_chart_t* chart, uint16_t value);
+#endif
+
+/// \brief Set Screen Rotation
+/// \param mode ili9341_landscape (320x240) or ili9341_portrait (240x320)
+void tft_set_rotation(ili9341_orient_mode_t mode);
+
+#if TFT_CONSOLE
+/// \brief Start the Text Console
+/// \details Switches to portrait and clears the screen.
+void tft_console_init(void);
+
+/// \brief Write Text to the Console
+/// \param str Text, not null terminated
+/// \param len Number of characters
+/// \details Handles '\n', '\r' and wraps at the right edge. When the
+/// screen is full the oldest row is cleared and hardware scrolled to
+/// the bottom, the other rows are not redrawn.
+void tft_console_write(const char* str, uint16_t len);
+#endif
+
+#if TFT_DISPLAY_LIST
+/// \brief Clear the Display List
+void tft_dl_clear(void);
+
+/// \brief Add a Filled Rectangle to the Display List
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint16_t color);
+
+/// \brief Add a Horizontal Span to the Display List
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_span(int16_t x, int16_t y, int16_t width, uint16_t color);
+
+/// \brief Add a String to the Display List
+/// \param str String, must stay valid while the item is in the list
+/// \param bg Background color of the cells, or ILI9341_TRANSPARENT
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_text(int16_t x, int16_t y, const char* str, uint16_t color, uint32_t bg);
+
+/// \brief Add a Filled Circle to the Display List
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_circle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
+
+/// \brief Add a Bitmap to the Display List
+/// \param bitmap Big endian RGB565, must stay valid while the item is in the list
+/// \return Item index, -1 if the list is full
+int8_t tft_dl_bitmap(int16_t x, int16_t y, int16_t width, int16_t height, const uint8_t* bitmap);
+
+/// \brief Render the Display List into an Area
+/// \param bg Background color under the items
+/// \details Items are composed in RAM in the order they were added,
+/// every pixel of the area is sent exactly once.
+void tft_dl_render(int16_t x, int16_t y, int16_t width, int16_t height, uint16_t bg);
+#endif
+
 #endif  // __ILI9341_H__
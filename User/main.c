@@ -19,18 +19,33 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 ///-|----------------------|----------|--------------------|
 /// | Data TRansfer Source |  DMA-CH  | Destination        | 
 ///-|----------------------|----------|--------------------|
-/// | 62 Step SPWM Table   | DMA1-CH5 | TIM1-CH1, TIM1-CH2 | 
+/// | 62 Step SPWM Table   | DMA1-CH6 | TIM1-CH1, TIM1-CH2 | 
 ///-|----------------------|----------|--------------------|
 /// | 10 Bit ADC1-CH7 data | DMA1-CH1 | ADC-BUFF (Average) | 
 ///-|----------------======|----------|--------------------|
 /// | 320x240 Graphic data | DMA1-CH3 | SPI-ILI9341        |
 ///-|----------------------|----------|--------------------|
+/// | printf TX ring       | DMA1-CH4 | USART1 TX (PD5)    |
+///-|----------------------|----------|--------------------|
+/// | USART1 RX (PD6)      | DMA1-CH5 | Console RX ring    |
+///-|----------------------|----------|--------------------|
 
 #include "ILI9341.h"
+#include "fmt.h"
+#include "spwm.h"
+#include "control.h"
+#include "adc.h"
+#include "protect.h"
+#include "timebase.h"
+#include "sched.h"
+#include "uart.h"
+#include "console.h"
+#include "cmd.h"
 ///---------------------------------------------------------------|
 /// | CH32V003 Port  | ILI9341 Pin | LCD Description              |
 ///-|----------------|------------|-------------------------------|
@@ -48,6 +63,11 @@
 #define ILI9341_WIDTH    320
 #define ILI9341_HEIGHT   240
 
+// Demos draw above the status line, which the LCD task keeps up to date
+#define LINE_HEIGHT     16
+#define DEMO_HEIGHT     (ILI9341_HEIGHT -LINE_HEIGHT)
+#define STATUS_Y        (LINE_HEIGHT *14)
+
 //--------------------------------------------------------
 // TIM1 CCPx register Definition
 //--------------------------------------------------------
@@ -61,28 +81,35 @@
 #define TIM1_PSC    16   // Clock = 6MHz, SPWM = 15KHz
 #define TIM1_ARR    201  // Amplitude = 0~200
 
-#define buf_size 62    // Sine step =62 (180deg)
-// Sine amplitude = 0~200 (reference =50%)
-u16 sine_tbl[buf_size] = {
-      5, 10, 15, 20, 25, 30, 34, 39, 44, 48,
-     52, 57, 61, 65, 68, 72, 75, 79, 83, 85,
-     87, 89, 91, 93, 95, 96, 97, 99, 99,100,
-    100,100, 99, 99, 97, 96, 95, 93, 91, 89,
-     87, 85, 83, 79, 75, 72, 68, 65, 61, 57,
-     52, 48, 44, 39, 34, 30, 25, 20, 15, 10, 
-      5,  0
-};
+#define SPWM_AMPLITUDE  16384   // Sine peak =50% of TIM1 period (Q15)
+#define SPWM_FREQ       120     // Sine =120Hz, SPWM =15KHz
+#define VOUT_TARGET     450     // ADC1-CH7 feedback to regulate, 1430mV
+#define VOUT_TRIP       700     // ADC1-CH7 overvoltage trip, 2220mV
+#define TRIP_RETRY      15000   // PWM periods before a retry, 1sec
+#define TRIP_RETRIES    3       // then the fault latches
+
+// Task periods, deadline =period
+#define CONTROL_PERIOD  10      // ms, reference slew of the PI loop
+#define READOUT_PERIOD  25      // ms, ADC1-CH7 readout on the LCD
+#if (PRINT_TARGET == PRINT_TARGET_TFT)
+#define CONSOLE_PERIOD  100     // ms, ADC1-CH7 log line
+#else
+#define CONSOLE_PERIOD  1000    // ms, trip report
+#endif
 
-// sine amplitude = 0~200 (feedback =output)
-u16 sine_fdb[buf_size] = {
-      5, 10, 15, 20, 25, 30, 34, 39, 44, 48,
-     52, 57, 61, 65, 68, 72, 75, 79, 83, 85,
-     87, 89, 91, 93, 95, 96, 97, 99, 99,100,
-    100,100, 99, 99, 97, 96, 95, 93, 91, 89,
-     87, 85, 83, 79, 75, 72, 68, 65, 61, 57,
-     52, 48, 44, 39, 34, 30, 25, 20, 15, 10, 
-      5,  0
-};
+// Graphics demos and benchmarks in turn on the LCD, 1 = built.
+// 0 leaves the menu and the status line, that build fits 16KB flash.
+// The strip chart and display list demos also need TFT_CHART and
+// TFT_DISPLAY_LIST.
+#ifndef DEMO_SUITE
+#define DEMO_SUITE      0
+#endif
+
+// Command console on USART1 RX, 1 = built. 0 leaves PD6 to ADC Iout,
+// without the RX ring and the line FIFO of the console.
+#ifndef UART_CONSOLE
+#define UART_CONSOLE    1
+#endif
 
 //--------------------------------------------------------
 // Port of the Sine PWM
@@ -189,105 +216,6 @@ void TIM1_PWMOut_Init(u16 arr, u16 psc, u16 ccp)
     TIM_Cmd(TIM1, ENABLE); //  Start TIM1
 }
 
-//--------------------------------------------------------
-// TIM1_DMA_Init
-// Initializes the TIM DMAy Channelx configuration.
-//--------------------------------------------------------
-void TIM1_DMA_Init(DMA_Channel_TypeDef *DMA_CHx, u32 ppadr, u32 memadr, u16 bufsize)
-{
-    DMA_InitTypeDef DMA_InitStructure = {0};
-    NVIC_InitTypeDef NVIC_InitStructure = {0};
-    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
-
-    DMA_DeInit(DMA_CHx);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = ppadr;
-    DMA_InitStructure.DMA_MemoryBaseAddr = memadr;
-    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
-    DMA_InitStructure.DMA_BufferSize = bufsize;
-    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
-    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
-    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
-
-    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
-    //DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
-
-    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
-    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
-    DMA_Init(DMA_CHx, &DMA_InitStructure);
-    DMA_Cmd(DMA_CHx, ENABLE);
-
-    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel5_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 2;
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
-    NVIC_Init(&NVIC_InitStructure);
-
-    DMA_ITConfig(DMA1_Channel5, DMA_IT_TC, ENABLE );
-}
-
-//--------------------------------------------------------
-// interrupt for End of DMA Transfer
-//--------------------------------------------------------
-void DMA1_Channel5_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
-void DMA1_Channel5_IRQHandler(void)
-{
-    if(DMA_GetITStatus(DMA1_IT_TC5) != RESET )
-    {
-        if (GPIO_ReadOutputDataBit(GPIOC, DMA_LED) ==SET)
-        {
-            GPIO_ResetBits(GPIOC, DMA_LED);  // DMA LED off
-
-            // 180~360deg Sine PWM by Sine Table
-            TIM1_DMA_Init(DMA1_Channel5, (u32)TIM1_CH2CVR_ADDRESS, (u32)sine_fdb, buf_size);
-        }
-
-        else
-        {
-            GPIO_SetBits(GPIOC, DMA_LED);   // DMA LED on
-
-            // 0~180deg Sine PWM by Sine Table
-            TIM1_DMA_Init(DMA1_Channel5, (u32)TIM1_CH1CVR_ADDRESS, (u32)sine_fdb, buf_size);
-        }
-        DMA_ClearITPendingBit(DMA1_IT_TC5);
-    }
-}
-
-//--------------------------------------------------------
-// TIM2_INT_Init(USER_DELAY -1, 48 -1);
-// TIM2 Clock =1us
-//--------------------------------------------------------
-static u8 timer2_flag =1;
-
-void TIM2_INT_Init(u32 arr, u16 psc)
-{
-    TIM_TimeBaseInitTypeDef TIMBase_InitStruct;
-    //TIM_OCInitTypeDef TIM_OCInitStructure = {0};
-    NVIC_InitTypeDef NVIC_InitStruct;
-
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
-
-    TIM_DeInit(TIM2);
-    TIMBase_InitStruct.TIM_Period = arr -1;
-    TIMBase_InitStruct.TIM_CounterMode = TIM_CounterMode_Up;
-    TIMBase_InitStruct.TIM_Prescaler = psc -1;
-    TIMBase_InitStruct.TIM_ClockDivision = TIM_CKD_DIV1;
-    TIM_TimeBaseInit(TIM2, &TIMBase_InitStruct);
-
-    //TIM_OCInitStructure.TIM_Pulse = 0;
-    //TIM_OC1Init(TIM2, &TIM_OCInitStructure);
-    TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
-
-    NVIC_InitStruct.NVIC_IRQChannel = TIM2_IRQn;
-    NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 5;
-    NVIC_InitStruct.NVIC_IRQChannelSubPriority = 5;
-    NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
-    NVIC_Init(&NVIC_InitStruct);
-    TIM_Cmd(TIM2, ENABLE);  //  Start TIM2
-
-    timer2_flag =1; // set timer2 flag
-}
-
 //---------------------------------------------------------------------
 // TIM1_IRQHandler handles of TIM1 interrupt
 //---------------------------------------------------------------------
@@ -302,150 +230,27 @@ void TIM1_UP_IRQHandler(void)
    TIM_ClearITPendingBit(TIM1, TIM_IT_Update );
 }
 
-//---------------------------------------------------------------------
-// TIM2_IRQHandler handles of TIM2 interrupt
-// Interrupt flag is set
-//---------------------------------------------------------------------
-void TIM2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
-void TIM2_IRQHandler(void)
-{
-   if (TIM_GetITStatus(TIM2, TIM_IT_Update) ==SET)
-   {
-       TIM_Cmd(TIM2, DISABLE);  // Stop TIM2
-
-       // this can be replaced with your code of flag set
-       // so that in main's that flag can be handled
-       timer2_flag =0;  // end of timer2
-
-       // Clear TIM2 flag
-       TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
-   }
-}
-
-//---------------------------------------------------------------------
-// Init ADC1_CH7 =PD4 (10 Bit ADC)
-//---------------------------------------------------------------------
-void init_ADC(void)
-{
-    GPIO_InitTypeDef GPIO_InitStructure = {0};
-    ADC_InitTypeDef  ADC_InitStructure = {0};
-
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOD, ENABLE);
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
-    RCC_ADCCLKConfig(RCC_PCLK2_Div8);
-
-    // ADC_CH7 =PD4
-    ADC_DeInit(ADC1);
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_4;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;
-    GPIO_Init(GPIOD, &GPIO_InitStructure);
-
-    // ADC1 Single channel use internal clock
-    ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;
-    ADC_InitStructure.ADC_ScanConvMode = DISABLE;
-    ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
-    ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
-    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
-    ADC_InitStructure.ADC_NbrOfChannel = 1;
-    ADC_Init(ADC1, &ADC_InitStructure);
-
-    // Calibration voltage
-    ADC_Calibration_Vol(ADC1, ADC_CALVOL_50PERCENT);
-    ADC_DMACmd(ADC1, ENABLE);
-    ADC_Cmd(ADC1, ENABLE);
-
-    // Reset Calibration
-    ADC_ResetCalibration(ADC1);
-    while(ADC_GetResetCalibrationStatus(ADC1));
-    
-    // Start Calibrartion
-    ADC_StartCalibration(ADC1);
-    while(ADC_GetCalibrationStatus(ADC1));
-}
-
-//---------------------------------------------------------------------
-// Initializes the DMAy Channelx configuration.
-// DMA_CHx - x can be 1 to 7.
-// ppadr - Peripheral base address.
-// memadr - Memory base address.
-// bufsize - DMA channel buffer size.
-//---------------------------------------------------------------------
-void DMA_Tx_Init(DMA_Channel_TypeDef *DMA_CHx, u32 ppadr, u32 memadr, u16 bufsize)
-{
-    DMA_InitTypeDef DMA_InitStructure = {0};
-    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
-
-    DMA_DeInit(DMA_CHx);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = ppadr;
-    DMA_InitStructure.DMA_MemoryBaseAddr = memadr;
-    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
-    DMA_InitStructure.DMA_BufferSize = bufsize;
-    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
-    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
-    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
-    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
-    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
-    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
-    DMA_Init(DMA_CHx, &DMA_InitStructure);
-}
-
-//---------------------------------------------------------------------
-// Init DMA1-CH1 for ADC value
-//---------------------------------------------------------------------
-#define adc_buf_size (10)   // Number of average =10
-u16 adc_BUF[adc_buf_size +1];
-
-void init_DMA(void)
-{
-    // Init DMAx for ADC1
-    DMA_Tx_Init(DMA1_Channel1, (u32)&ADC1->RDATAR, (u32)adc_BUF, adc_buf_size);
-    DMA_Cmd(DMA1_Channel1, ENABLE); // Start DMA1_CH1
-
-    // Start ADC1_CH7
-    ADC_RegularChannelConfig(ADC1, ADC_Channel_7, 1, ADC_SampleTime_30Cycles);
-    ADC_SoftwareStartConvCmd(ADC1, ENABLE);     // Start
-
-    //Delay_Ms(50);
-    //ADC_SoftwareStartConvCmd(ADC1, DISABLE);    // Stop
-}
-
-//---------------------------------------------------------------------
-// Single Read ADC1-CH7 (not use DMA)
-//---------------------------------------------------------------------
-u16 get_ADC(void)
-{
-    u16 val;    // 10 bit result of ADC1_CH7
-
-    ADC_RegularChannelConfig(ADC1, ADC_Channel_7, 1, ADC_SampleTime_30Cycles);
-    ADC_SoftwareStartConvCmd(ADC1, ENABLE);
-
-    while(!ADC_GetFlagStatus(ADC1, ADC_FLAG_EOC));  // End of ADC?
-    val = ADC_GetConversionValue(ADC1); // Read ADC vlaue
-    return val;
-}
-
+#if DEMO_SUITE
 //---------------------------------------------------------------------
 // White Noise Generator State
 //---------------------------------------------------------------------
-#define NOISE_BITS      8
-#define NOISE_MASK      ((1 << NOISE_BITS) -1)
+#define NOISE_BITS      8       // new bits per call
 #define NOISE_POLY_TAP0 31
 #define NOISE_POLY_TAP1 11
 #define NOISE_POLY_TAP2 1
 #define NOISE_POLY_TAP3 0
 
-uint32_t frame = 0;
-uint16_t colors[] =
+const uint16_t colors[] =
 {
     BLACK, NAVY, DARKGREEN, DARKCYAN, MAROON,
     PURPLE, OLIVE, LIGHTGREY, DARKGREY, BLUE,
     GREEN, CYAN, RED, MAGENTA, YELLOW, WHITE,
     ORANGE, GREENYELLOW, PINK,
 };
+#define COLOR_COUNT (sizeof(colors) / sizeof(colors[0]))
 
 //---------------------------------------------------------------------
-// random byte generator
+// random 16-bit generator, NOISE_BITS new bits per call
 //---------------------------------------------------------------------
 uint32_t lfsr = 1;
 
@@ -460,324 +265,620 @@ uint16_t rand16(void)
                     (lfsr >> NOISE_POLY_TAP3));
         lfsr     = (lfsr << 1) | (new_data & 1);
     }
-    return (lfsr & NOISE_MASK) *3;
+    return lfsr;
 }
 
 //---------------------------------------------------------------------
-// draw random Dot
+// random number 0 ~ n-1, no division (the CPU has none)
+// masked to the next power of two, drawn again while out of range:
+// unbiased, less than 2 draws on average
 //---------------------------------------------------------------------
-void random_dot()
+uint16_t rand_below(uint16_t n)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    u16 mask =n -1;
+    u16 r;
+
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
+    do
     {
-        for (uint16_t i = 0; i < ILI9341_WIDTH; i++)
-        {
-            u16 c =colors[rand16() %19];
-            tft_draw_pixel(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, c);
-            tft_draw_pixel((rand16() %ILI9341_WIDTH) +1, (rand16() %ILI9341_HEIGHT), c);
-            tft_draw_pixel((rand16() %ILI9341_WIDTH), (rand16() %ILI9341_HEIGHT) +1, c);
-            tft_draw_pixel((rand16() %ILI9341_WIDTH) +1, (rand16() %ILI9341_HEIGHT) +1, c);
-        }
-    }
+        r =rand16() & mask;
+    } while (r >= n);
+    return r;
+}
+
+//---------------------------------------------------------------------
+// Print primitives per second and SPI traffic of the last demo
+// (demo time =1sec), tft_stats must be cleared at start of the demo.
+//---------------------------------------------------------------------
+void print_stats(const char *name, u32 count)
+{
+    fmt_print(name);
+    fmt_print(": ");
+    fmt_print_dec(count, 0);
+    fmt_print("/s, SPI ");
+    fmt_print_dec(tft_stats.bytes, 0);
+    fmt_print(" bytes, ");
+    fmt_print_dec(tft_stats.windows, 0);
+    fmt_print(" windows, ");
+    fmt_print_dec(tft_stats.arms, 0);
+    fmt_print(" DMA arms\r\n  skipped CASET ");
+    fmt_print_dec(tft_stats.caset_skipped, 0);
+    fmt_print(", RASET ");
+    fmt_print_dec(tft_stats.raset_skipped, 0);
+    fmt_print(", continued RAMWR ");
+    fmt_print_dec(tft_stats.ramwr_continued, 0);
+    fmt_print("\r\n");
+}
+#endif  // DEMO_SUITE
+
+#if DEMO_SUITE
+//---------------------------------------------------------------------
+// Demo steps, one primitive per call, return the primitives drawn
+// The demo runner calls a step at a time between the other tasks,
+// graphics stay above DEMO_HEIGHT.
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+// draw random Dot
+//---------------------------------------------------------------------
+u32 random_dot(void)
+{
+    u16 c =colors[rand_below(COLOR_COUNT)];
+    point_t pts[4];
+    pts[0].x =rand_below(ILI9341_WIDTH);        pts[0].y =rand_below(DEMO_HEIGHT);
+    pts[1].x =rand_below(ILI9341_WIDTH) +1;     pts[1].y =rand_below(DEMO_HEIGHT);
+    pts[2].x =rand_below(ILI9341_WIDTH);        pts[2].y =rand_below(DEMO_HEIGHT -1) +1;
+    pts[3].x =rand_below(ILI9341_WIDTH) +1;     pts[3].y =rand_below(DEMO_HEIGHT -1) +1;
+    tft_draw_pixels(pts, 4, c);
+    return 4;
 }
 
 //---------------------------------------------------------------------
 // Scan H-Line
 //---------------------------------------------------------------------
-void scan_hline()
+u32 scan_hline(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    static u16 y =0;
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint16_t i = 0; i < ILI9341_HEIGHT; i++)
-        {
-            tft_draw_line(0, i, ILI9341_WIDTH, i, colors[rand16() %19]);
-        }
-    }
+    tft_draw_line(0, y, ILI9341_WIDTH, y, colors[rand_below(COLOR_COUNT)]);
+    if (++y >= DEMO_HEIGHT) y =0;
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Scan V-Line
 //---------------------------------------------------------------------
-void scan_vline()
+u32 scan_vline(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    static u16 x =0;
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint16_t i = 0; i < ILI9341_WIDTH; i++)
-        {
-            tft_draw_line(i, 0, i, ILI9341_HEIGHT, colors[rand16() %19]);
-        }
-    }
+    tft_draw_line(x, 0, x, DEMO_HEIGHT -1, colors[rand_below(COLOR_COUNT)]);
+    if (++x >= ILI9341_WIDTH) x =0;
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Random Line
 //---------------------------------------------------------------------
-void random_line(void)
+u32 random_line(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
-
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        tft_draw_line(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, colors[rand16() %19]);
-    }
+    tft_draw_line(rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT), rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT), colors[rand_below(COLOR_COUNT)]);
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Centered Rectangle
 //---------------------------------------------------------------------
-void center_rect(void)
+u32 center_rect(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    static u8 i =0;
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint8_t i = 0; i < 110; i++)
-        {
-            tft_draw_rect(i, i, ILI9341_WIDTH -(i << 1), ILI9341_HEIGHT -(i << 1), colors[rand16() %19]);
-        }
-    }
+    tft_draw_rect(i, i, ILI9341_WIDTH -(i << 1), DEMO_HEIGHT -(i << 1), colors[rand_below(COLOR_COUNT)]);
+    if (++i >= 110) i =0;
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Random Rectangle
 //---------------------------------------------------------------------
-void random_rect(void)
+u32 random_rect(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
-
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint8_t i = 0; i < 120; i++)
-        {
-            tft_draw_rect(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, 20, 20, colors[rand16() % 19]);
-        }
-    }
+    tft_draw_rect(rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT -20), 20, 20, colors[rand_below(COLOR_COUNT)]);
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Fill Rectangle
 //---------------------------------------------------------------------
-void fill_rect(void)
+u32 fill_rect(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
-
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint8_t i = 0; i < 120; i++)
-        {
-            tft_fill_rect(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, 20, 20, colors[rand16() %19]);
-        }
-    }
+    tft_fill_rect(rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT -20), 20, 20, colors[rand_below(COLOR_COUNT)]);
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Move Rectangle
 //---------------------------------------------------------------------
-void move_rect(void)
+tft_sprite_t sprite;
+int16_t sprite_x, sprite_y, sprite_dx, sprite_dy;
+
+void move_rect_start(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    sprite_x =0;    sprite_y =0;
+    sprite_dx =2;   sprite_dy =2;
+    sprite = (tft_sprite_t){0, 0, 40, 20, colors[rand_below(COLOR_COUNT)], BLACK, 0};
+    tft_sprite_show(&sprite);
+}
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
+u32 move_rect(void)
+{
+    sprite_x += sprite_dx;
+    if (sprite_x <= 0 || sprite_x >= ILI9341_WIDTH -40)
     {
-        frame =1000;
-        u16 x =0, y =0, step_x =2, step_y =2;
-        while (frame-- >0)
-        {
-            uint16_t bg = colors[rand16() %19];
-            tft_fill_rect(x, y, 40, 20, bg);
-            tft_set_color(colors[rand16() %19]);
-            
-            x += step_x;
-            if (x >= ILI9341_WIDTH -40)
-            {
-                step_x = -step_x;
-            }
-            y += step_y;
-            if (y >= ILI9341_HEIGHT -20)
-            {
-                step_y = -step_y;
-            }
-        }
+        sprite_dx = -sprite_dx;
+    }
+    sprite_y += sprite_dy;
+    if (sprite_y <= 0 || sprite_y >= DEMO_HEIGHT -20)
+    {
+        sprite_dy = -sprite_dy;
     }
+    tft_sprite_move(&sprite, sprite_x, sprite_y);   // Only the damaged strips are sent
+    return 1;
+}
+
+void move_rect_stop(void)
+{
+    tft_sprite_hide(&sprite);
 }
 
 //---------------------------------------------------------------------
 // Random Circle
 //---------------------------------------------------------------------
-void random_circ(void)
+u32 random_circ(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
-
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
-    {
-        for (uint8_t i = 0; i < 80; i++)
-        {
-            tft_draw_circle(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, 10, colors[rand16() %19]);
-        }
-    }
+    tft_draw_circle(rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT -20) +10, 10, colors[rand_below(COLOR_COUNT)]);
+    return 1;
 }
 
 //---------------------------------------------------------------------
 // Filled Random Circle
 //---------------------------------------------------------------------
-void fill_circ(void)
+u32 fill_circ(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    tft_fill_circle(rand_below(ILI9341_WIDTH), rand_below(DEMO_HEIGHT -20) +10, 10, colors[rand_below(COLOR_COUNT)]);
+    return 1;
+}
 
-    // user interval timer =TIM2 clock =1ms
-    TIM2_INT_Init(1000, 24000);   // ARR =1sec
-    while(timer2_flag)
+#if TFT_DISPLAY_LIST
+//---------------------------------------------------------------------
+// Overlapping panel, immediate mode against the display list
+// Both paths draw the same 200x160 panel, the display list sends
+// each pixel once, immediate mode pays for every overdrawn layer.
+//---------------------------------------------------------------------
+void compose_panel_immediate(u16 x, u16 y, u16 color)
+{
+    tft_fill_rect(x, y, 200, 160, DARKGREY);
+    tft_fill_rect(x, y, 200, 14, NAVY);
+    tft_set_cursor(x +4, y +2);
+    tft_set_color(WHITE);
+    tft_set_background_color(NAVY);
+    tft_print("Display list");
+    tft_fill_circle(x +100, y +88, 60, BLACK);
+    tft_fill_circle(x +100, y +88, 50, color);
+    tft_fill_rect(x +60, y +83, 80, 10, BLACK);
+    tft_set_cursor(x +64, y +83);
+    tft_set_color(YELLOW);
+    tft_set_background_color(BLACK);
+    tft_print("1234 mV");
+}
+
+void compose_panel_list(u16 x, u16 y, u16 color)
+{
+    tft_dl_clear();
+    tft_dl_rect(x, y, 200, 14, NAVY);
+    tft_dl_text(x +4, y +2, "Display list", WHITE, NAVY);
+    tft_dl_circle(x +100, y +88, 60, BLACK);
+    tft_dl_circle(x +100, y +88, 50, color);
+    tft_dl_rect(x +60, y +83, 80, 10, BLACK);
+    tft_dl_text(x +64, y +83, "1234 mV", YELLOW, ILI9341_TRANSPARENT);
+    tft_dl_render(x, y, 200, 160, DARKGREY);
+}
+
+u32 panel_immediate(void)
+{
+    compose_panel_immediate(60, 40, colors[rand_below(COLOR_COUNT)]);
+    return 1;
+}
+
+u32 panel_list(void)
+{
+    compose_panel_list(60, 40, colors[rand_below(COLOR_COUNT)]);
+    return 1;
+}
+#endif
+#endif  // DEMO_SUITE
+
+//---------------------------------------------------------------------
+// Display Main Menu at ST7789 (128x160)
+//---------------------------------------------------------------------
+// Readouts of the status line, the labels are drawn once by disp_status
+// ADC1-CH7:____mV Time:____ms
+tft_field_t adc_field  = {8 *9,  STATUS_Y, 4, 0, YELLOW, BLACK};
+tft_field_t time_field = {8 *21, STATUS_Y, 4, 0, YELLOW, BLACK};
+
+// Readouts written by the LCD task, the strip chart moves them
+tft_field_t *status_adc  =&adc_field;
+tft_field_t *status_time =&time_field;
+
+void disp_status(void)
+{
+    tft_fill_rect(0, DEMO_HEIGHT, ILI9341_WIDTH, ILI9341_HEIGHT -DEMO_HEIGHT, BLACK);
+    tft_set_background_color(BLACK);
+    tft_set_color(GREEN);
+    tft_set_cursor(0, STATUS_Y);
+    tft_print("ADC1-CH7:    mV Time:    ms");
+    tft_field_invalidate(&adc_field);
+    tft_field_invalidate(&time_field);
+    status_adc =&adc_field;
+    status_time =&time_field;
+}
+
+//---------------------------------------------------------------------
+// ADC 0~1023 to [mV] at VCC =3.25V, division free
+// adc *3250 /1023 ~= adc *3253 >>10, 3253 =0b110010110101 as shift-add
+//---------------------------------------------------------------------
+u16 adc_to_mV(u16 adc)
+{
+    u32 v = adc;
+    return ((v << 11) + (v << 10) + (v << 7) + (v << 5) + (v << 4) + (v << 2) + v) >> 10;
+}
+
+#if DEMO_SUITE
+//---------------------------------------------------------------------
+// Glyph expansion benchmark, timed by now_us() of the TIM2 timebase
+// Cycles per glyph of tft_print, including the wait for the last DMA.
+// A glyph is 160 bytes, 53us at 24MHz SPI =2560 cycles: below that
+// the expansion is hidden behind the DMA of the other buffer half.
+// Build with TFT_GLYPH_LUT=0 for the bit test expander.
+// SysTick is left to Delay_Us/Delay_Ms of debug.c.
+//---------------------------------------------------------------------
+void glyph_bench(void)
+{
+    const char *line = "0123456789ABCDEFGHIJKLMNOPQRSTUV";    // 32 glyphs
+    u32 us;
+
+    tft_set_background_color(BLACK);
+    tft_set_color(WHITE);
+    tft_dma_wait();
+
+    us =now_us();
+
+    for (u16 y = 0; y < 16 *10; y += 10)   // 512 glyphs
     {
-        for (uint8_t i = 0; i < 80; i++)
-        {
-            tft_fill_circle(rand16() %ILI9341_WIDTH, rand16() %ILI9341_HEIGHT, 10, colors[rand16() %19]);
-        }
+        tft_set_cursor(0, y);
+        tft_print(line);
     }
+    tft_dma_wait();
+
+    us =now_us() -us;
+
+    fmt_print("glyph_bench: ");
+    fmt_print_dec(((us << 5) + (us << 4)) >> 9, 0);    // x48 cycles/us, /512 glyphs
+    fmt_print(" cycles/glyph (TFT_GLYPH_LUT=");
+    fmt_print_dec(TFT_GLYPH_LUT, 0);
+    fmt_print(")\r\n");
 }
 
+#if TFT_CHART
 //---------------------------------------------------------------------
-// ST7735 demo display
+// Strip chart of ADC1-CH7, hardware scrolled
+// Left fixed strip: scale, right fixed strip: current value [mV]
+// The chart scrolls the whole height, the ADC readout moves to the
+// right strip and the status line is drawn again at the end.
 //---------------------------------------------------------------------
-void demo_LCD(void)
+tft_chart_t chart = {32, 64, YELLOW, BLACK, DARKGREY, 31, 10};
+tft_field_t chart_field = {ILI9341_WIDTH -64, 20, 4, 0, YELLOW, BLACK};
+
+void strip_chart_start(void)
 {
-    random_dot();
+    tft_fill_rect(0, DEMO_HEIGHT, ILI9341_WIDTH, ILI9341_HEIGHT -DEMO_HEIGHT, BLACK);
+    tft_chart_init(&chart);
 
-    scan_hline();
-    scan_vline();
-    random_line();
+    tft_set_background_color(BLACK);
+    tft_set_color(GREEN);
+    tft_set_cursor(0, 0);
+    tft_print("3250");
+    tft_set_cursor(0, ILI9341_HEIGHT /2 -5);
+    tft_print("1625");
+    tft_set_cursor(0, ILI9341_HEIGHT -10);
+    tft_print("0 mV");
+    tft_set_cursor(ILI9341_WIDTH -64, 0);
+    tft_print("ADC1-CH7");
+    tft_set_color(YELLOW);
+    tft_set_cursor(ILI9341_WIDTH -32, 20);
+    tft_print("mV");
 
-    center_rect();
-    random_rect();
+    tft_field_invalidate(&chart_field);
+    status_adc =&chart_field;
+    status_time =0;
+}
 
-    fill_rect();
-    move_rect();
+u32 strip_chart(void)
+{
+    tft_chart_push(&chart, adc_get_average());  // last 8 sweeps
+    return 1;
+}
 
-    random_circ();
-    fill_circ();
+void strip_chart_stop(void)
+{
+    tft_scroll_reset();
+    disp_status();
 }
- 
+#endif
+
 //---------------------------------------------------------------------
-// Display Main Menu at ST7789 (128x160)
+// Demo runner, a task which runs one step per call
+// Start: clear the demo area and the counts, start the demo period
+// Step:  one primitive while the period runs, then post itself again
+// End:   print the primitives per second, go to the next demo
+// A demo without steps waits for the end of its period, the demo
+// timer posts the task then.
+//---------------------------------------------------------------------
+typedef struct
+{
+    const char *name;
+    void (*start)(void);    // after the demo area is cleared, 0 =none
+    u32  (*step)(void);     // one primitive, 0 =static screen
+    void (*stop)(void);     // 0 =none
+    u16  period_ms;
+    u8   shift;             // log2 of the period in seconds, for print_stats
+} demo_t;
+
+void disp_MENU(void);
+
+const demo_t demos[] =
+{
+    {"menu",               disp_MENU,         0,               0,                5000, 0},
+    {"glyph_bench",        glyph_bench,       0,               0,                0,    0},
+#if TFT_CHART
+    {"strip_chart",        strip_chart_start, strip_chart,     strip_chart_stop, 4000, 2},
+#endif
+    {"random_dot",         0,                 random_dot,      0,                1000, 0},
+    {"scan_hline",         0,                 scan_hline,      0,                1000, 0},
+    {"scan_vline",         0,                 scan_vline,      0,                1000, 0},
+    {"random_line",        0,                 random_line,     0,                1000, 0},
+    {"center_rect",        0,                 center_rect,     0,                1000, 0},
+    {"random_rect",        0,                 random_rect,     0,                1000, 0},
+    {"fill_rect",          0,                 fill_rect,       0,                1000, 0},
+    {"move_rect",          move_rect_start,   move_rect,       move_rect_stop,   1000, 0},
+    {"random_circ",        0,                 random_circ,     0,                1000, 0},
+    {"fill_circ",          0,                 fill_circ,       0,                1000, 0},
+#if TFT_DISPLAY_LIST
+    {"panel immediate",    0,                 panel_immediate, 0,                1000, 0},
+    {"panel display list", 0,                 panel_list,      0,                1000, 0},
+#endif
+};
+#define DEMO_COUNT  (sizeof(demos) / sizeof(demos[0]))
+
 //---------------------------------------------------------------------
-#define LINE_HEIGHT 16
+// Menu of the demos[] table, numbered as the console "demo n" takes them
+// 12 pixel line steps: 16 entries between the title and the status line
+//---------------------------------------------------------------------
+#define MENU_LINE       12
 
 void disp_MENU(void)
 {
-    tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
+    u16 y =LINE_HEIGHT *2;
+
     tft_set_background_color(BLACK);
     tft_set_color(GREEN);
     tft_set_cursor(0, LINE_HEIGHT *0);
     tft_print("CH32V003 DMA-TIM1-SPWM, DMA-SPI-ILI9341");
 
     tft_set_color(WHITE);
-    tft_set_cursor(0, LINE_HEIGHT *2);
-    tft_print("1. Random Dot");
-    tft_set_cursor(0, LINE_HEIGHT *3);
-    tft_print("2. Horizontal Line");
-    tft_set_cursor(0, LINE_HEIGHT *4);
-    tft_print("3. Vertical Line");
-    tft_set_cursor(0, LINE_HEIGHT *5);
-    tft_print("4. Random Line");
-    tft_set_cursor(0, LINE_HEIGHT *6);
-    tft_print("5. Centered Rectangle");
-    tft_set_cursor(0, LINE_HEIGHT *7);
-    tft_print("6. Random Rectangle");
-    tft_set_cursor(0, LINE_HEIGHT *8);
-    tft_print("7. Filled Rectangle");
-    tft_set_cursor(0, LINE_HEIGHT *9);
-    tft_print("8. Move Rectangle");
-    tft_set_cursor(0, LINE_HEIGHT *10);
-    tft_print("9. Random Circle");
-    tft_set_cursor(0, LINE_HEIGHT *11);
-    tft_print("10. Filled Circle");
-}
-
-//---------------------------------------------------------------------
-// Display ADC-CH7 0~1023
+    for (u8 i =0; i <DEMO_COUNT && y +MENU_LINE <= DEMO_HEIGHT; i++, y +=MENU_LINE)
+    {
+        tft_set_cursor(0, y);
+        tft_print_dec(i, 2);
+        tft_print(" ");
+        tft_print(demos[i].name);
+    }
+}
+
+void demo_run(void);
+const task_t demo_task = {"demo", demo_run, 0, 0, 4};   // lowest, steps when idle
+
+//--------------------------------------------------------
+// demo_timer_start(1000);
+// Demo period by a one-shot software timer of the TIM2 timebase,
+// demo_flag clears and the demo task is posted at the end
+//--------------------------------------------------------
+static volatile u8 demo_flag =0;
+static tb_timer_t demo_timer;
+static u32 demo_start_ms;
+
+static void demo_timer_end(void *arg)
+{
+    demo_flag =0;   // end of demo period
+    sched_post((const task_t *)arg);
+}
+
+void demo_timer_start(u32 ms)
+{
+    demo_flag =1;   // set demo flag
+    demo_start_ms =now_ms();
+    timer_start(&demo_timer, ms, 0, demo_timer_end, (void *)&demo_task);
+}
+
+u8  demo_index =0;
+u8  demo_next =0xFF;    // requested by the console, 0xFF =none
+u8  demo_running =0;    // started, steps until demo_flag clears
+u32 demo_items;
+
+// End the running demo, the next start is demo n
+void demo_select(u8 n)
+{
+    demo_next =n;
+    timer_stop(&demo_timer);
+    demo_flag =0;
+    sched_post(&demo_task);
+}
+
+void demo_run(void)
+{
+    const demo_t *d =&demos[demo_index];
+
+    if (!demo_running)
+    {
+        if (demo_next < DEMO_COUNT)
+        {
+            demo_index =demo_next;
+            d =&demos[demo_index];
+        }
+        demo_next =0xFF;
+        tft_fill_rect(0, 0, ILI9341_WIDTH, DEMO_HEIGHT, BLACK);
+        memset(&tft_stats, 0, sizeof(tft_stats));
+        demo_items =0;
+        demo_running =1;
+        if (d->start) d->start();
+        demo_timer_start(d->period_ms);
+    }
+    else if (demo_flag)
+    {
+        demo_items += d->step();
+    }
+    else
+    {
+        if (d->stop) d->stop();
+        if (d->step) print_stats(d->name, demo_items >> d->shift);
+        demo_running =0;
+
+        // Task table after each round of the demos
+        if (++demo_index >= DEMO_COUNT)
+        {
+            demo_index =0;
+            cmd_print_tasks();
+        }
+    }
+
+    if (demo_running && demo_flag && !d->step) return;
+    sched_post(&demo_task);
+}
+#else
+static const u32 demo_start_ms =0;  // The time readout shows the uptime
+#endif  // DEMO_SUITE
+
+//---------------------------------------------------------------------
+// LCD task: ADC [mV] and time of the demo period (0~9999 ms)
+// 4 digit decimal as right align, only changed digits are sent
 //---------------------------------------------------------------------
 u32 adc_val;
 u32 mv_val;
-char dec_str[9];
 
-void disp_ADC(void)
+void disp_readout(void)
 {
-    u16 i;
-    u16 adc_sum =0;
-    u16 ave_val;
+    tft_field_set(status_adc, mv_val);
+    if (status_time) tft_field_set(status_time, now_ms() - demo_start_ms);
+}
 
-    // read ADC buffer from DMA1
-    for(i = 0; i < adc_buf_size; i++)
-    {
-        //adc_sum += (u32)(get_ADC());    // read direct ADC1-CH7
-        adc_sum += adc_BUF[i];  // make sum by DMA1-CH1 tranfered
-    }
-    ave_val =adc_sum /adc_buf_size; // make average of ADC
+const task_t lcd_task = {"lcd", disp_readout, 0, READOUT_PERIOD, 2};   // posted by the ADC task
 
-    // Start ADC1-CH7 data DMA transfer to adc_BUF 
-    DMA_Tx_Init(DMA1_Channel1, (u32)&ADC1->RDATAR, (u32)adc_BUF, adc_buf_size);
-    DMA_Cmd(DMA1_Channel1, ENABLE); // Start DMA1_CH1
+//---------------------------------------------------------------------
+// ADC task: readout of the IIR kept by the DMA1-CH1 interrupt
+// 25ms periodic whatever the demo, then releases the LCD task
+//---------------------------------------------------------------------
+void read_ADC(void)
+{
+    u16 ave_val =adc_get_filtered();    // IIR kept by DMA1-CH1 interrupt
 
     adc_val =(u32)(ave_val);    // save for the feedback control
-    mv_val =(ave_val *3250) /1023; // make [mV] from measured VCC value =3.25V
+    mv_val =adc_to_mV(ave_val); // make [mV] from measured VCC value =3.25V
 
-    tft_set_cursor(0, LINE_HEIGHT *14);
-    tft_set_color(GREEN);
-    tft_print("ADC1-CH7:");
-
-    // binary to 4 digit decimal as right align
-    sprintf(dec_str, "%4d", mv_val);
-    tft_set_color(YELLOW);
-    tft_print(dec_str);
+#if (PRINT_TARGET != PRINT_TARGET_TFT)
+    sched_post(&lcd_task);
+#endif
+}
 
-    tft_set_color(GREEN);
-    tft_print("mV ");
+//---------------------------------------------------------------------
+// Console commands: SPWM setting and statistics in cmd.c,
+// the demo select here
+//---------------------------------------------------------------------
+#if DEMO_SUITE
+void cmd_demo(u8 argc, const u32 *argv)
+{
+    if (argc == 1 && argv[0] < DEMO_COUNT)
+    {
+        demo_select(argv[0]);
+        return;
+    }
+    for (u8 i =0; i <DEMO_COUNT; i++)
+    {
+        fmt_print_dec(i, 2);
+        fmt_print(" ");
+        fmt_print(demos[i].name);
+        fmt_print("\r\n");
+    }
 }
+#endif
+
+const console_cmd_t commands[] =
+{
+    {"amp",   "<0~32768> sine peak, Q15, regulation off", cmd_amp},
+    {"freq",  "<10~400> sine Hz",                         cmd_freq},
+    {"vout",  "<0~1023> regulate ADC1-CH7 to",            cmd_vout},
+#if DEMO_SUITE
+    {"demo",  "[n] list, or go to demo n",                cmd_demo},
+#endif
+    {"stats", "tasks, trip, UART",                        cmd_stats},
+};
 
 //---------------------------------------------------------------------
-// Display User Timer2 Counter (0~9999)
+// Console task: command lines, then the trip report,
+// or the ADC1-CH7 log on the LCD console
 //---------------------------------------------------------------------
-u32 timer2_cnt =0;  // Start user time =0ms
+u16 console_trips =0;
 
-void disp_TIM2(void)
+void console_run(void)
 {
-    //tft_set_cursor(0, LINE_HEIGHT *12);
-    tft_set_color(GREEN);
-    tft_print("TIM2:");
+#if UART_CONSOLE
+    console_poll();
+#endif
 
-    // Read TIM2-CNT value [ms]
-    timer2_cnt = TIM2->CNT;
+#if (PRINT_TARGET == PRINT_TARGET_TFT)
+    fmt_print("ADC1-CH7:");
+    fmt_print_dec(mv_val, 4);
+    fmt_print(" mV, Time:");
+    fmt_print_dec(now_ms(), 0);
+    fmt_print("\n");
+#else
+    protect_fault_t fault;
 
-    // 32 bit binary to 4 digit decimal as right align
-    sprintf(dec_str, "%4d", timer2_cnt);
-    tft_set_color(YELLOW);
-    tft_print(dec_str);
+    protect_get_fault(&fault);
+    if (fault.trips != console_trips)
+    {
+        console_trips =fault.trips;
+        cmd_print_fault();  // Last overvoltage trip
+    }
+#endif
+}
 
-    tft_set_color(GREEN);
-    tft_print("ms");
+//---------------------------------------------------------------------
+// Periodic tasks, priority 0~3, the LCD and demo tasks are posted
+// The PI loop itself runs in the SPWM interrupt, the control task
+// slews its reference.
+//---------------------------------------------------------------------
+const task_t control_task = {"control", control_update, CONTROL_PERIOD, CONTROL_PERIOD, 0};
+const task_t adc_task     = {"adc",     read_ADC,       READOUT_PERIOD, READOUT_PERIOD, 1};
+const task_t console_task = {"console", console_run,    CONSOLE_PERIOD, CONSOLE_PERIOD, 3};
+
+// RX interrupt: a command line is queued
+void console_ready(void)
+{
+    sched_post(&console_task);
 }
 
 //---------------------------------------------------------------------
@@ -801,52 +902,72 @@ int main(void)
     USART_DeInit(USART1);
     USART_Printf_Init(115200);
 #endif
-    printf("SystemClk:%d\r\n", SystemCoreClock);
-    printf("ChipID:%08x\r\n", DBGMCU_GetCHIPID() );
+    fmt_print("SystemClk:");
+    fmt_print_dec(SystemCoreClock, 0);
+    fmt_print("\r\nChipID:");
+    fmt_print_hex(DBGMCU_GetCHIPID(), 8);
+    fmt_print("\r\n");
 
     // init SPWM waveform
     // (psc, arr*2 , ccp) for 15.0KHz PWM / 62 Step =120Hz
     TIM_DeInit(TIM1);
     TIM1_PWMOut_Init(TIM1_ARR, TIM1_PSC, 0);
 
-    // Sine PWM to CH1, CH1N,
-    DMA_DeInit(DMA1_Channel5);
-    TIM1_DMA_Init(DMA1_Channel5, (u32)TIM1_CH1CVR_ADDRESS, (u32)sine_fdb, buf_size);
-    //TIM1_DMA_Init(DMA1_Channel5, (u32)TIM1_CH2CVR_ADDRESS, (u32)sine_fdb buf_size);
-
-    TIM_DMACmd(TIM1, TIM_DMA_Update, ENABLE);   // Start TIM1_DMA
+    // Sine PWM to CH1, CH1N (0~180deg) and CH2, CH2N (180~360deg)
+    // by TIM1 DMA burst, circular DMA1-CH6 over the full cycle
+    spwm_init(SPWM_AMPLITUDE, SPWM_FREQ);
+    cmd_init(SPWM_FREQ);
     TIM_Cmd(TIM1, ENABLE);  //  Start TIM1
 
-    ADC_DeInit(ADC1);
-    init_ADC();
+    // ADC1-CH7 sampled once per PWM period by TIM1 TRGO
+    adc_init();
 
-    DMA_DeInit(DMA1_Channel3);
-    init_DMA();
+    // Regulate the SPWM amplitude to ADC1-CH7 at each half cycle
+    control_init(VOUT_TARGET, SPWM_AMPLITUDE);
+
+    // Outputs off by the ADC analog watchdog on overvoltage
+    protect_init(0, VOUT_TRIP, TRIP_RETRY, TRIP_RETRIES);
+
+#if (SDI_PRINT != SDI_PR_OPEN) && UART_CONSOLE
+    // Command console on USART1 RX, PD6 taken back from the ADC
+    uart_rx_init();
+    console_init(commands, sizeof(commands) / sizeof(commands[0]), console_ready);
+#endif
 
     // Init ST7735 TFT LCD
+    DMA_DeInit(DMA1_Channel3);
     SPI_I2S_DeInit(SPI1);
     tft_init();
-    Delay_Ms(100);
 
-    // End of Hardware Setup
+#if (PRINT_TARGET == PRINT_TARGET_TFT)
+    // Print output goes to the LCD text console, log ADC1-CH7 and time
+    tft_console_init();
+    fmt_print("SystemClk:");
+    fmt_print_dec(SystemCoreClock, 0);
+    fmt_print("\r\nChipID:");
+    fmt_print_hex(DBGMCU_GetCHIPID(), 8);
+    fmt_print("\r\n");
+#else
+    // Status line below the demo area, then the demos from the menu
+    tft_fill_rect(0, 0, ILI9341_WIDTH, DEMO_HEIGHT, BLACK);
+    disp_status();
+    sched_add(&lcd_task);
+#if DEMO_SUITE
+    sched_add(&demo_task);
+    sched_post(&demo_task);
+#else
+    tft_set_cursor(0, 0);   // Title only, disp_status() left the colors
+    tft_print("CH32V003 DMA-TIM1-SPWM, DMA-SPI-ILI9341");
+#endif
+#endif
+    sched_add(&control_task);
+    sched_add(&adc_task);
+    sched_add(&console_task);
+
+    // End of Hardware Setup, tasks run from here
     while(1)
     {
-        //tft_fill_rect(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, BLACK);
-        disp_MENU();
-
-        // user interval timer =TIM2 clock =1ms
-        TIM2_INT_Init(10000, 24000);   // ARR =5sec
-        while(timer2_flag)
-        {
-            // Dispaly ADC-CH7 (0~1023) and TIM2-CNT (0~9999)
-            disp_ADC();     // Read ADC binary and display [mV]
-            disp_TIM2();    // Display timer2 [ms]
-
-            Delay_Ms(25);   // Display time =25ms
-        }
-        
-        demo_LCD();     // Display graphic demo
-        // end user code
+        sched_run();
     }
 }   // End of main()
 //---------------------------------------------------------------------
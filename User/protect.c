@@ -0,0 +1,138 @@
+/// \brief Output Protection by the ADC1 Analog Watchdog
+/// \details The watchdog interrupt is disabled at the trip so a fault
+/// which lasts does not interrupt every sweep, and enabled again with
+/// the outputs.
+
+#include "protect.h"
+#include "adc.h"
+#include "ch32v00x_misc.h"
+#include "ch32v00x_tim.h"
+
+static uint16_t _protect_low, _protect_high;
+static uint16_t _protect_retry_periods;
+static uint8_t _protect_retries;
+
+static uint16_t _protect_bdtr;          // MOE and AOE as configured
+static volatile uint8_t _protect_tripped;
+static uint8_t _protect_left;           // retries left
+static uint16_t _protect_wait;          // PWM periods to the next retry
+static volatile protect_fault_t _protect_fault;
+
+// Outputs and watchdog on
+static void _protect_enable(void)
+{
+    _protect_tripped = 0;
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    ADC_ITConfig(ADC1, ADC_IT_AWD, ENABLE);
+    TIM1->BDTR |= _protect_bdtr;
+}
+
+// ADC hook, every ADC_BUF_LEN /2 sweeps
+static void _protect_half(void)
+{
+    adc_sample_t s;
+    uint16_t v;
+
+    if (!_protect_tripped || !_protect_left) return;
+
+    if (_protect_wait > ADC_BUF_LEN / 2)
+    {
+        _protect_wait -= ADC_BUF_LEN / 2;
+        return;
+    }
+
+    // Still outside the window, wait again
+    adc_get_sample(&s);
+    v = ((uint16_t*)&s)[PROTECT_RANK];
+    if (v < _protect_low || v > _protect_high)
+    {
+        _protect_wait = _protect_retry_periods;
+        return;
+    }
+
+    _protect_left--;
+    _protect_enable();
+}
+
+/// \brief Arm the analog watchdog
+/// \param low Trip below, 0 ~ 1023
+/// \param high Trip above, 0 ~ 1023
+/// \param retry_periods PWM periods to wait before a retry, 15000 =1s at 120Hz
+/// \param retries Automatic retries, 0 =latch at the first trip
+void protect_init(uint16_t low, uint16_t high, uint16_t retry_periods, uint8_t retries)
+{
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+    _protect_low = low;
+    _protect_high = high;
+    _protect_retry_periods = retry_periods;
+    _protect_retries = retries;
+    _protect_left = retries;
+    _protect_bdtr = TIM1->BDTR & (TIM_MOE | TIM_AOE);
+    _protect_fault.trips = 0;
+
+    ADC_AnalogWatchdogThresholdsConfig(ADC1, high, low);
+    ADC_AnalogWatchdogSingleChannelConfig(ADC1, PROTECT_CHANNEL);
+    ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_SingleRegEnable);
+
+    NVIC_InitStructure.NVIC_IRQChannel = ADC_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    adc_set_hook(_protect_half);
+    _protect_enable();
+}
+
+/// \brief Check if the outputs are off by a trip
+uint8_t protect_tripped(void)
+{
+    return _protect_tripped;
+}
+
+/// \brief Copy the last trip record
+void protect_get_fault(protect_fault_t* fault)
+{
+    __disable_irq();
+    *fault = *(protect_fault_t*)&_protect_fault;
+    __enable_irq();
+}
+
+/// \brief Clear a trip and enable the outputs, retries start again
+void protect_reset(void)
+{
+    __disable_irq();
+    _protect_left = _protect_retries;
+    _protect_enable();
+    __enable_irq();
+}
+
+//---------------------------------------------------------------------
+// interrupt of the Analog Watchdog, the only ADC1 interrupt enabled
+//---------------------------------------------------------------------
+void ADC1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void ADC1_IRQHandler(void)
+{
+    uint16_t cnt, ccr4;
+
+    // Outputs inactive first, no automatic enable at the next update
+    TIM1->BDTR &= ~(TIM_MOE | TIM_AOE);
+    cnt = TIM1->CNT;
+
+    // Next rank is still converting, RDATAR holds the tripping sample
+    _protect_fault.value = ADC1->RDATAR;
+    ADC_ITConfig(ADC1, ADC_IT_AWD, DISABLE);
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+
+    // Sweep started at CCR4, the counter may have passed the update
+    ccr4 = TIM1->CH4CVR;
+    if (cnt < ccr4) cnt += TIM1->ATRLR + 1;
+    _protect_fault.latency = cnt - ccr4;
+    _protect_fault.psc = TIM1->PSC;
+    _protect_fault.sweep = adc_count();
+    _protect_fault.trips++;
+
+    _protect_wait = _protect_retry_periods;
+    _protect_tripped = 1;
+}
@@ -0,0 +1,55 @@
+/// \brief Output Protection by the ADC1 Analog Watchdog
+/// \details The analog watchdog checks PROTECT_CHANNEL at every ADC sweep.
+/// Its interrupt, preemption 0 above all others, clears MOE and AOE of
+/// TIM1 as the first instruction: CH1/CH2 and CH1N/CH2N go inactive and
+/// the update event does not enable them again (AOE would).
+///
+/// Trip latency is measured from the start of the sweep (CNT =CCR4) to
+/// the MOE clear, in TIM1 counts of (PSC +1) /48MHz:
+///  - Vout conversion  26 ADCCLK = 2.2us
+///  - interrupt entry and MOE clear, about 20 cycles = 0.4us
+/// The host model (test/test_protect.c, 0.5us interrupt entry) gives
+/// 2.7us, 9 counts of 13 HCLK at 120Hz; not measured on the chip.
+///
+/// Auto-retry runs from the ADC DMA interrupt: after retry_periods PWM
+/// periods with the channel back inside the window, the outputs are
+/// enabled again, up to retries times. Then the fault stays latched
+/// until protect_reset.
+
+#ifndef __PROTECT_H__
+#define __PROTECT_H__
+
+#include "ch32v00x.h"
+#include "ch32v00x_adc.h"
+
+#define PROTECT_CHANNEL ADC_Channel_7   // Vout, PD4
+#define PROTECT_RANK    0               // field of adc_sample_t
+
+/// \brief Last trip
+typedef struct
+{
+    uint32_t sweep;     // adc_count() at the trip
+    uint16_t value;     // watched channel, the sample which tripped
+    uint16_t latency;   // TIM1 counts from the sweep start to the MOE clear
+    uint16_t psc;       // TIM1 prescaler -1 at the trip
+    uint16_t trips;     // since protect_init
+} protect_fault_t;
+
+/// \brief Arm the analog watchdog
+/// \param low Trip below, 0 ~ 1023
+/// \param high Trip above, 0 ~ 1023
+/// \param retry_periods PWM periods to wait before a retry, 15000 =1s at 120Hz
+/// \param retries Automatic retries, 0 =latch at the first trip
+/// \details TIM1 and the ADC scan must be running.
+void protect_init(uint16_t low, uint16_t high, uint16_t retry_periods, uint8_t retries);
+
+/// \brief Check if the outputs are off by a trip
+uint8_t protect_tripped(void);
+
+/// \brief Copy the last trip record
+void protect_get_fault(protect_fault_t* fault);
+
+/// \brief Clear a trip and enable the outputs, retries start again
+void protect_reset(void);
+
+#endif  // __PROTECT_H__
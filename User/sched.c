@@ -0,0 +1,162 @@
+/// \brief Cooperative Run-to-completion Scheduler
+/// \details The table is sorted by priority when a task is added, the
+/// first ready task of a scan runs. After each run the scan starts over,
+/// so a task released meanwhile at a higher priority goes next.
+///
+/// ready is a byte store, posting from the TIM2 interrupt and the main
+/// loop needs no lock. Periodic releases come from one 1ms timer for all
+/// tasks: its callback runs in the TIM2 interrupt, compares the low half
+/// of now_ms() with the next release of each periodic task and only sets
+/// ready, the task runs in the main loop. A task is found by a scan of
+/// the table, SCHED_TASKS entries at most.
+
+#include "sched.h"
+
+// Table entry, the RAM part of a task
+typedef struct
+{
+    const task_t* task;
+    task_stats_t stats;
+    uint16_t release;       // now_ms() of the release, low half
+    uint16_t next;          // now_ms() of the next periodic release, low half
+    volatile uint8_t ready;
+} sched_entry_t;
+
+static sched_entry_t _sched_table[SCHED_TASKS];
+static uint8_t _sched_count;
+static tb_timer_t _sched_timer;
+
+// Entry of a task, 0 =not in the table
+static sched_entry_t* _sched_find(const task_t* task)
+{
+    for (uint8_t i = 0; i < _sched_count; i++)
+    {
+        if (_sched_table[i].task == task) return &_sched_table[i];
+    }
+    return 0;
+}
+
+static void _sched_post(sched_entry_t* e, uint16_t now)
+{
+    if (e->ready) return;
+    e->release = now;
+    e->ready = 1;
+}
+
+// 1ms timer callback: release the periodic tasks which are due
+static void _sched_tick(void* arg)
+{
+    uint16_t now = now_ms();
+
+    (void)arg;
+    for (uint8_t i = 0; i < _sched_count; i++)
+    {
+        sched_entry_t* e = &_sched_table[i];
+        uint16_t period = e->task->period_ms;
+
+        if (!period || (int16_t)(now - e->next) < 0) continue;
+
+        e->next += period;
+        if (e->ready) e->stats.overruns++;
+        else _sched_post(e, now);
+    }
+}
+
+/// \brief Add a task to the table, in priority order
+/// \param task Task, periodic tasks are first released one period later
+uint8_t sched_add(const task_t* task)
+{
+    sched_entry_t* e;
+    uint8_t i;
+
+    if (_sched_count >= SCHED_TASKS) return 0;
+
+    // After the tasks of the same priority, in order of addition.
+    // Entries move: the tick and sched_post must not see them meanwhile
+    __disable_irq();
+    for (i = _sched_count; i > 0 && _sched_table[i - 1].task->prio > task->prio; i--)
+    {
+        _sched_table[i] = _sched_table[i - 1];
+    }
+    e = &_sched_table[i];
+    e->task = task;
+    e->stats = (task_stats_t){0};
+    e->ready = 0;
+    e->next = now_ms() + task->period_ms;
+    _sched_count++;
+    __enable_irq();
+
+    if (task->period_ms && !_sched_timer.active)
+    {
+        timer_start(&_sched_timer, 1, 1, _sched_tick, 0);
+    }
+    return 1;
+}
+
+/// \brief Release a task, safe in interrupts
+/// \param task Task of the table
+void sched_post(const task_t* task)
+{
+    sched_entry_t* e = _sched_find(task);
+
+    if (e) _sched_post(e, now_ms());
+}
+
+/// \brief Run the ready task of the highest priority to completion
+uint8_t sched_run(void)
+{
+    sched_entry_t* e;
+    uint32_t us;
+    uint16_t ms, release;
+
+    for (uint8_t i = 0; i < _sched_count; i++)
+    {
+        e = &_sched_table[i];
+        if (!e->ready) continue;
+
+        // Cleared first: a post during the run releases it again and
+        // sets a new release, this run is timed from its own
+        release = e->release;
+        e->ready = 0;
+        us = now_us();
+        e->task->run();
+        us = now_us() - us;
+        ms = (uint16_t)now_ms() - release;
+
+        e->stats.runs++;
+        if (us > e->stats.wcet_us) e->stats.wcet_us = us;
+        if (ms > e->stats.response_ms) e->stats.response_ms = ms;
+        if (e->task->deadline_ms && ms > e->task->deadline_ms) e->stats.misses++;
+        return 1;
+    }
+    return 0;
+}
+
+/// \brief Number of tasks in the table
+uint8_t sched_count(void)
+{
+    return _sched_count;
+}
+
+/// \brief Task of the table, in priority order
+/// \param index 0 ~ sched_count() -1
+const task_t* sched_task(uint8_t index)
+{
+    return _sched_table[index].task;
+}
+
+/// \brief Run statistics of a task of the table
+/// \param index 0 ~ sched_count() -1
+const task_stats_t* sched_stats(uint8_t index)
+{
+    return &_sched_table[index].stats;
+}
+
+/// \brief Clear the run statistics of all tasks
+void sched_clear(void)
+{
+    for (uint8_t i = 0; i < _sched_count; i++)
+    {
+        _sched_table[i].stats = (task_stats_t){0};
+    }
+}
@@ -0,0 +1,76 @@
+/// \brief Cooperative Run-to-completion Scheduler
+/// \details Tasks are functions which return, the main loop calls
+/// sched_run() which runs the ready task of the highest priority, one at a
+/// time, never preempted by another task. Interrupts still preempt tasks.
+/// A task is released:
+///  - every period_ms by the 1ms timer of the scheduler (TIM2 timebase), or
+///  - by sched_post(), from a task, a timer callback or an interrupt
+/// Each run is timed by now_us(). The scheduler keeps per task the
+/// longest run (WCET), the longest release to finish time, the periods
+/// lost while the task was still ready and the runs finished after the
+/// deadline. A task which runs long delays all the others: split long
+/// work into steps which post their own task again.
+///
+/// task_t is const and stays in flash, only the ready flag, the release
+/// times and the statistics of each table entry are in RAM.
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "ch32v00x.h"
+#include "timebase.h"
+
+#define SCHED_TASKS     5   // tasks in the table
+
+typedef void (*task_fn_t)(void);
+
+/// \brief Task, const: the configuration stays in flash
+typedef struct
+{
+    const char* name;
+    task_fn_t run;
+    uint16_t period_ms;     // 0 =released by sched_post only, else <32768
+    uint16_t deadline_ms;   // from the release, 0 =none
+    uint8_t  prio;          // 0 =highest
+} task_t;
+
+/// \brief Run statistics of a task, kept by the scheduler in RAM
+typedef struct
+{
+    uint32_t runs;
+    uint32_t wcet_us;       // longest run
+    uint16_t response_ms;   // longest release to finish
+    uint16_t overruns;      // periods lost, the task was still ready
+    uint16_t misses;        // finished after the deadline
+} task_stats_t;
+
+/// \brief Add a task to the table, in priority order
+/// \param task Task, periodic tasks are first released one period later
+/// \details Returns 0 when the table is full.
+uint8_t sched_add(const task_t* task);
+
+/// \brief Release a task, safe in interrupts
+/// \param task Task of the table
+/// \details Posts coalesce while the task is ready, the release time
+/// of the first one is kept.
+void sched_post(const task_t* task);
+
+/// \brief Run the ready task of the highest priority to completion
+/// \details Returns 0 when no task was ready.
+uint8_t sched_run(void);
+
+/// \brief Number of tasks in the table
+uint8_t sched_count(void);
+
+/// \brief Task of the table, in priority order
+/// \param index 0 ~ sched_count() -1
+const task_t* sched_task(uint8_t index);
+
+/// \brief Run statistics of a task of the table
+/// \param index 0 ~ sched_count() -1
+const task_stats_t* sched_stats(uint8_t index);
+
+/// \brief Clear the run statistics of all tasks
+void sched_clear(void);
+
+#endif  // __SCHED_H__
@@ -0,0 +1,232 @@
+/// \brief Full Cycle Sine PWM on TIM1 CH1/CH2 by DMA Burst
+/// \details The table holds bytes, DMA1-CH6 reads bytes and writes
+/// halfwords, zero extended, to TIM1->DMAADR: 248 bytes for a cycle.
+///
+/// The table is not double buffered, each half is its own shadow:
+///  - HT: DMA plays 180~360deg, latch spwm_set, rewrite the 0~180deg half
+///  - TC: last period of the cycle, load PSC/ARR, rewrite 180~360deg half
+/// PSC and ARR are preloaded and take effect at the update which starts
+/// the new cycle. A half rewrite is 62 shift-add products, about 70us,
+/// and is skipped when the peak of that half does not change.
+
+#include "spwm.h"
+#include "ch32v00x_dma.h"
+#include "ch32v00x_gpio.h"
+#include "ch32v00x_misc.h"
+#include "ch32v00x_rcc.h"
+#include "ch32v00x_tim.h"
+
+#define SPWM_LED GPIO_Pin_1     // PC1, on for 0~180deg
+
+// Half sine, sin(pi *(k +1) /62) *255, k =0~61
+static const uint8_t _sine_q8[SPWM_STEPS] = {
+     13,  26,  39,  51,  64,  76,  89, 101, 112, 124,
+    135, 146, 156, 166, 176, 185, 193, 202, 209, 216,
+    223, 229, 234, 239, 243, 247, 250, 252, 254, 255,
+    255, 255, 254, 252, 250, 247, 243, 239, 234, 229,
+    223, 216, 209, 202, 193, 185, 176, 166, 156, 146,
+    135, 124, 112, 101,  89,  76,  64,  51,  39,  26,
+     13,   0
+};
+
+// TIM1 timing and sine amplitude of one cycle
+typedef struct
+{
+    uint16_t psc;           // TIM1 prescaler -1
+    uint16_t amplitude;     // Q15 of the TIM1 period
+    uint8_t  arr;           // TIM1 period -1
+} spwm_param_t;
+
+// Interleaved CCR1, CCR2 of one full cycle
+static uint8_t _spwm_table[SPWM_TABLE_LEN];
+
+static volatile spwm_param_t _spwm_next;    // written by spwm_set
+static volatile uint8_t _spwm_request;      // _spwm_next is complete
+static spwm_param_t _spwm_now;              // latched at HT, finished at TC
+static volatile uint8_t _spwm_latched;
+static volatile uint16_t _spwm_amplitude;   // of the next rewritten half
+static uint16_t _spwm_peak[2];              // peak in each half of the table
+static spwm_hook_t _spwm_hook;
+
+// a *b with shifts and adds, the core has no multiplier
+static uint32_t _spwm_mul(uint32_t a, uint16_t b)
+{
+    uint32_t r = 0;
+
+    for (; b; b >>= 1, a <<= 1)
+    {
+        if (b & 1) r += a;
+    }
+    return r;
+}
+
+// Fill one half cycle of the table at the present amplitude,
+// leg 0 = CCR1 (0~180deg), 1 = CCR2 (180~360deg)
+static void _spwm_fill_half(uint8_t leg)
+{
+    uint8_t* p = &_spwm_table[leg ? SPWM_TABLE_LEN / 2 : 0];
+    uint8_t peak = _spwm_mul(_spwm_now.arr, _spwm_amplitude) >> 15;
+
+    if (peak == _spwm_peak[leg]) return;
+    _spwm_peak[leg] = peak;
+
+    for (uint8_t k = 0; k < SPWM_STEPS; k++, p += 2)
+    {
+        p[leg]     = _spwm_mul(peak, _sine_q8[k]) >> 8;
+        p[leg ^ 1] = 0;
+    }
+}
+
+// TIM1 clocks per PWM period =HCLK /(freq *124), split into
+// prescaler and a period of at most 256 counts (byte table)
+static void _spwm_param(spwm_param_t* p, uint16_t amplitude_q15, uint16_t freq_hz)
+{
+    uint32_t clocks, div, period;
+
+    if (freq_hz < SPWM_FREQ_MIN) freq_hz = SPWM_FREQ_MIN;
+    if (freq_hz > SPWM_FREQ_MAX) freq_hz = SPWM_FREQ_MAX;
+    if (amplitude_q15 > SPWM_Q15_ONE) amplitude_q15 = SPWM_Q15_ONE;
+
+    clocks = SystemCoreClock / _spwm_mul(freq_hz, SPWM_STEPS * 2);
+    div = ((clocks - 1) >> 8) + 1;
+    period = clocks / div;
+
+    p->psc = div - 1;
+    p->arr = period - 1;
+    p->amplitude = amplitude_q15;
+}
+
+/// \brief Start the Sine PWM
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+/// \param freq_hz Sine frequency, SPWM_FREQ_MIN ~ SPWM_FREQ_MAX
+void spwm_init(uint16_t amplitude_q15, uint16_t freq_hz)
+{
+    DMA_InitTypeDef DMA_InitStructure = {0};
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+    TIM_OCInitTypeDef TIM_OCInitStructure = {0};
+
+    _spwm_param(&_spwm_now, amplitude_q15, freq_hz);
+    _spwm_amplitude = _spwm_now.amplitude;
+    _spwm_peak[0] = _spwm_peak[1] = 0xFFFF; // force both fills
+    _spwm_fill_half(0);
+    _spwm_fill_half(1);
+    _spwm_request = 0;
+    _spwm_latched = 0;
+
+    TIM_PrescalerConfig(TIM1, _spwm_now.psc, TIM_PSCReloadMode_Immediate);
+    TIM_SetAutoreload(TIM1, _spwm_now.arr);
+
+    // CH3 compare, no output: the DMA request just after the update
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStructure.TIM_OutputNState = TIM_OutputNState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = SPWM_DMA_DELAY;
+    TIM_OC3Init(TIM1, &TIM_OCInitStructure);
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    // DMA1-CH6 =TIM1_CH3, byte table to 16-bit DMAADR, whole cycle
+    DMA_DeInit(DMA1_Channel6);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&TIM1->DMAADR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)_spwm_table;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = SPWM_TABLE_LEN;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(DMA1_Channel6, &DMA_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel6_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 2;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    DMA_ITConfig(DMA1_Channel6, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA1_Channel6, ENABLE);
+
+    // Each CC3 event writes CCR1 and CCR2 through DMAADR
+    TIM_DMAConfig(TIM1, TIM_DMABase_CCR1, TIM_DMABurstLength_2Transfers);
+    TIM_DMACmd(TIM1, TIM_DMA_CC3, ENABLE);
+}
+
+/// \brief Change amplitude and frequency at the next cycle boundary
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+/// \param freq_hz Sine frequency, SPWM_FREQ_MIN ~ SPWM_FREQ_MAX
+void spwm_set(uint16_t amplitude_q15, uint16_t freq_hz)
+{
+    spwm_param_t p;
+
+    _spwm_param(&p, amplitude_q15, freq_hz);
+
+    // HT skips a request which is being written
+    _spwm_request = 0;
+    _spwm_next = p;
+    _spwm_request = 1;
+}
+
+/// \brief Check if the last spwm_set is still waiting for its cycle
+uint8_t spwm_pending(void)
+{
+    return _spwm_request | _spwm_latched;
+}
+
+/// \brief Change amplitude from the next half cycle, safe in the hook
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+void spwm_set_amplitude(uint16_t amplitude_q15)
+{
+    if (amplitude_q15 > SPWM_Q15_ONE) amplitude_q15 = SPWM_Q15_ONE;
+    _spwm_amplitude = amplitude_q15;
+}
+
+/// \brief Function called by the DMA interrupt at each half cycle
+/// \param hook Function, NULL to remove
+void spwm_set_hook(spwm_hook_t hook)
+{
+    _spwm_hook = hook;
+}
+
+//--------------------------------------------------------
+// interrupt for Half and End of the Sine Cycle
+//--------------------------------------------------------
+void DMA1_Channel6_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel6_IRQHandler(void)
+{
+    // 180~360deg is playing, the 0~180deg half is free
+    if (DMA_GetITStatus(DMA1_IT_HT6) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_HT6);
+        GPIO_ResetBits(GPIOC, SPWM_LED);
+
+        if (_spwm_request)
+        {
+            _spwm_now = _spwm_next;
+            _spwm_amplitude = _spwm_now.amplitude;
+            _spwm_request = 0;
+            _spwm_latched = 1;
+        }
+        if (_spwm_hook) _spwm_hook();
+        _spwm_fill_half(0);
+    }
+
+    // Last period of the cycle, the next update starts 0~180deg
+    if (DMA_GetITStatus(DMA1_IT_TC6) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_TC6);
+        GPIO_SetBits(GPIOC, SPWM_LED);
+
+        if (_spwm_latched)
+        {
+            // Preloaded, used from the update which starts the new cycle
+            TIM1->PSC = _spwm_now.psc;
+            TIM1->ATRLR = _spwm_now.arr;
+            _spwm_latched = 0;
+        }
+        if (_spwm_hook) _spwm_hook();
+        _spwm_fill_half(1);
+    }
+}
@@ -0,0 +1,56 @@
+/// \brief Full Cycle Sine PWM on TIM1 CH1/CH2 by DMA Burst
+/// \details TIM1 CC3 requests a 2-transfer DMA burst through DMAADR,
+/// writing CCR1 then CCR2 from an interleaved table. CCR3 is a fixed
+/// compare SPWM_DMA_DELAY counts after the update, CH3 has no output.
+/// DMA1-CH6 runs the whole sine cycle in circular mode, DMA1-CH5 (TIM1_UP)
+/// is left to USART1 RX.
+///  - 0~180deg:   CCR1 = sine, CCR2 = 0 (CH1/CH1N leg)
+///  - 180~360deg: CCR1 = 0, CCR2 = sine (CH2/CH2N leg)
+///
+/// Amplitude and frequency changes are latched at the half-transfer
+/// interrupt and finished at transfer complete, so every output cycle is
+/// made of one parameter set only. spwm_set_amplitude is for a control
+/// loop: it is applied to each half as it is rewritten.
+
+#ifndef __SPWM_H__
+#define __SPWM_H__
+
+#include "ch32v00x.h"
+
+#define SPWM_STEPS      62                  // PWM periods per half cycle
+#define SPWM_TABLE_LEN  (SPWM_STEPS * 2 * 2) // CCR1/CCR2 pairs of a full cycle
+
+#define SPWM_DMA_DELAY  1       // TIM1 counts from the update to the burst
+
+#define SPWM_FREQ_MIN   10      // Hz
+#define SPWM_FREQ_MAX   400     // Hz, TIM1 period stays >=150 counts
+#define SPWM_Q15_ONE    32768   // Amplitude =100% of TIM1 period
+
+/// \brief Start the Sine PWM
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+/// \param freq_hz Sine frequency, SPWM_FREQ_MIN ~ SPWM_FREQ_MAX
+/// \details TIM1 must be configured for PWM on CH1/CH2 (TIM1_PWMOut_Init),
+/// its prescaler and period are replaced to suit freq_hz.
+void spwm_init(uint16_t amplitude_q15, uint16_t freq_hz);
+
+/// \brief Change amplitude and frequency at the next cycle boundary
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+/// \param freq_hz Sine frequency, SPWM_FREQ_MIN ~ SPWM_FREQ_MAX
+/// \details Returns at once, the new table is written by the DMA interrupt.
+/// A later call before the boundary replaces an earlier one.
+void spwm_set(uint16_t amplitude_q15, uint16_t freq_hz);
+
+/// \brief Check if the last spwm_set is still waiting for its cycle
+uint8_t spwm_pending(void);
+
+/// \brief Change amplitude from the next half cycle, safe in the hook
+/// \param amplitude_q15 Sine peak, 0 ~ SPWM_Q15_ONE of the TIM1 period
+void spwm_set_amplitude(uint16_t amplitude_q15);
+
+/// \brief Function called by the DMA interrupt at each half cycle
+/// \details Runs at 0deg and 180deg, before the free half is rewritten,
+/// NULL to remove. Keep it short: it adds to the interrupt time.
+typedef void (*spwm_hook_t)(void);
+void spwm_set_hook(spwm_hook_t hook);
+
+#endif  // __SPWM_H__
@@ -0,0 +1,184 @@
+/// \brief Free-running Timebase and Software Timer Wheel on TIM2
+/// \details Each slot holds the timers whose expiry ms has those low
+/// bits; a tick only walks the slot of now_ms(), timers of later rounds
+/// in that slot are skipped by comparing expire. Expiry is compared as
+/// signed difference, so the 32 bit ms wraparound is harmless.
+
+#include "timebase.h"
+#include "ch32v00x_misc.h"
+#include "ch32v00x_rcc.h"
+#include "ch32v00x_tim.h"
+
+#define TB_TICK_US  1000
+
+static volatile uint32_t _tb_high;      // TIM2 overflows <<16
+static volatile uint32_t _tb_ms;
+static tb_timer_t* _tb_wheel[TIMER_WHEEL_SLOTS];
+
+/// \brief Start TIM2, nothing is done when it already runs
+void timebase_init(void)
+{
+    TIM_TimeBaseInitTypeDef TIMBase_InitStruct = {0};
+    NVIC_InitTypeDef NVIC_InitStruct = {0};
+
+    if (TIM2->CTLR1 & TIM_CEN) return;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+    TIM_DeInit(TIM2);
+    TIMBase_InitStruct.TIM_Period = 0xFFFF;
+    TIMBase_InitStruct.TIM_CounterMode = TIM_CounterMode_Up;
+    TIMBase_InitStruct.TIM_Prescaler = SystemCoreClock / 1000000 - 1;
+    TIMBase_InitStruct.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInit(TIM2, &TIMBase_InitStruct);
+    TIM_ClearFlag(TIM2, TIM_FLAG_Update);
+
+    // CC1 as 1ms tick, compare only, no output
+    TIM_SetCompare1(TIM2, TB_TICK_US);
+    _tb_high = 0;
+    _tb_ms = 0;
+    TIM_ITConfig(TIM2, TIM_IT_Update | TIM_IT_CC1, ENABLE);
+
+    NVIC_InitStruct.NVIC_IRQChannel = TIM2_IRQn;
+    NVIC_InitStruct.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStruct.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStruct);
+    TIM_Cmd(TIM2, ENABLE);
+}
+
+/// \brief Milliseconds since timebase_init, wraps after 49 days
+uint32_t now_ms(void)
+{
+    return _tb_ms;
+}
+
+/// \brief Microseconds since timebase_init, wraps after 71 minutes
+uint32_t now_us(void)
+{
+    uint32_t high;
+    uint16_t cnt, pending;
+
+    // Retry if the overflow interrupt ran in between
+    do
+    {
+        high = _tb_high;
+        cnt = TIM2->CNT;
+        pending = TIM2->INTFR & TIM_UIF;
+    } while (high != _tb_high);
+
+    // Called with the overflow not handled yet (interrupt or masked):
+    // a low count is after the wrap
+    if (pending && cnt < 0x8000) high += 0x10000;
+
+    return high | cnt;
+}
+
+// Add to the slot of its expiry, interrupts off or in the TIM2 interrupt
+static void _tb_insert(tb_timer_t* t)
+{
+    tb_timer_t** slot = &_tb_wheel[t->expire & (TIMER_WHEEL_SLOTS - 1)];
+
+    t->next = *slot;
+    *slot = t;
+    t->active = 1;
+}
+
+// Remove from its slot, interrupts off or in the TIM2 interrupt
+static void _tb_remove(tb_timer_t* t)
+{
+    tb_timer_t** pp = &_tb_wheel[t->expire & (TIMER_WHEEL_SLOTS - 1)];
+
+    for (; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == t)
+        {
+            *pp = t->next;
+            break;
+        }
+    }
+    t->active = 0;
+}
+
+/// \brief Start or restart a timer
+/// \param timer Timer
+/// \param delay_ms First call after delay_ms, at least 1ms
+/// \param period_ms Then every period_ms, 0 =one-shot
+/// \param callback Function called in the TIM2 interrupt
+/// \param arg Argument of the callback
+void timer_start(tb_timer_t* timer, uint32_t delay_ms, uint32_t period_ms,
+                 timer_cb_t callback, void* arg)
+{
+    if (delay_ms == 0) delay_ms = 1;
+
+    __disable_irq();
+    if (timer->active) _tb_remove(timer);
+    timer->expire = _tb_ms + delay_ms;
+    timer->period = period_ms;
+    timer->callback = callback;
+    timer->arg = arg;
+    _tb_insert(timer);
+    __enable_irq();
+}
+
+/// \brief Stop a timer, nothing is done when it does not run
+void timer_stop(tb_timer_t* timer)
+{
+    __disable_irq();
+    if (timer->active) _tb_remove(timer);
+    __enable_irq();
+}
+
+// 1ms tick: call the timers due now in the slot of now_ms()
+static void _tb_tick(void)
+{
+    uint32_t now = ++_tb_ms;
+    tb_timer_t** pp = &_tb_wheel[now & (TIMER_WHEEL_SLOTS - 1)];
+
+    while (*pp)
+    {
+        tb_timer_t* t = *pp;
+
+        if ((int32_t)(now - t->expire) < 0)
+        {
+            pp = &t->next;      // a later round
+            continue;
+        }
+
+        *pp = t->next;
+        t->active = 0;
+        if (t->period)
+        {
+            t->expire += t->period;
+            _tb_insert(t);
+        }
+        t->callback(t->arg);
+
+        // The callback may have started or stopped timers of this slot
+        pp = &_tb_wheel[now & (TIMER_WHEEL_SLOTS - 1)];
+    }
+}
+
+//---------------------------------------------------------------------
+// TIM2 interrupt: overflow and 1ms compare
+//---------------------------------------------------------------------
+void TIM2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void TIM2_IRQHandler(void)
+{
+    if (TIM2->INTFR & TIM_UIF)
+    {
+        TIM2->INTFR = (uint16_t)~TIM_UIF;
+        _tb_high += 0x10000;
+    }
+
+    // Catch up if a tick was held off longer than 1ms
+    if (TIM2->INTFR & TIM_CC1IF)
+    {
+        do
+        {
+            TIM2->INTFR = (uint16_t)~TIM_CC1IF;
+            TIM2->CH1CVR = (uint16_t)(TIM2->CH1CVR + TB_TICK_US);
+            _tb_tick();
+        } while ((int16_t)(TIM2->CNT - TIM2->CH1CVR) >= 0);
+    }
+}
@@ -0,0 +1,52 @@
+/// \brief Free-running Timebase and Software Timer Wheel on TIM2
+/// \details TIM2 counts 1us steps from 0 to 0xFFFF and never stops:
+///  - update interrupt extends the counter to 32 bit microseconds
+///  - CC1 interrupt every 1ms advances now_ms() and the timer wheel
+/// Timers are owned by the caller, any number may run at once. Callbacks
+/// run in the TIM2 interrupt: keep them short, setting a flag is typical.
+/// Nothing else uses TIM2, Delay_Us/Delay_Ms wait on now_us(). SysTick is
+/// left free, glyph_bench counts HCLK cycles with it.
+
+#ifndef __TIMEBASE_H__
+#define __TIMEBASE_H__
+
+#include "ch32v00x.h"
+
+#define TIMER_WHEEL_SLOTS   8   // power of two, timers hashed by expiry ms
+
+typedef void (*timer_cb_t)(void* arg);
+
+/// \brief Software timer, keep it alive while it runs
+typedef struct tb_timer
+{
+    struct tb_timer* next;  // slot list
+    uint32_t expire;        // now_ms() of the next call
+    uint32_t period;        // ms, 0 =one-shot
+    timer_cb_t callback;
+    void* arg;
+    uint8_t active;
+} tb_timer_t;
+
+/// \brief Start TIM2, nothing is done when it already runs
+void timebase_init(void);
+
+/// \brief Milliseconds since timebase_init, wraps after 49 days
+uint32_t now_ms(void);
+
+/// \brief Microseconds since timebase_init, wraps after 71 minutes
+/// \details Safe in interrupts, also when the TIM2 overflow is pending.
+uint32_t now_us(void);
+
+/// \brief Start or restart a timer
+/// \param timer Timer
+/// \param delay_ms First call after delay_ms, at least 1ms
+/// \param period_ms Then every period_ms, 0 =one-shot
+/// \param callback Function called in the TIM2 interrupt
+/// \param arg Argument of the callback
+void timer_start(tb_timer_t* timer, uint32_t delay_ms, uint32_t period_ms,
+                 timer_cb_t callback, void* arg);
+
+/// \brief Stop a timer, nothing is done when it does not run
+void timer_stop(tb_timer_t* timer);
+
+#endif  // __TIMEBASE_H__
@@ -8,6 +8,31 @@
 ********************************************************/
 
 #include "uart.h"
+#include "ch32v00x_misc.h"
+
+#if UART_TX_DMA
+//Ring of free-running indexes: the ring holds head - tail bytes.
+//The DMA sends a chunk copied out of the ring, so the ring is free to
+//take new bytes, or to lose its oldest ones, while the chunk is sent.
+static volatile uint8_t _tx_ring[UART_TX_SIZE];
+static uint8_t _tx_dma[UART_TX_CHUNK];
+static volatile uint16_t _tx_head;		// written by uart_write only
+static volatile uint16_t _tx_tail;		// written with interrupts off or in the TC interrupt
+static volatile uint8_t _tx_busy;		// DMA1 Channel 4 is sending _tx_dma
+static uint8_t _tx_policy = UART_TX_POLICY;
+#endif
+static volatile uart_tx_stats_t _tx_stats;
+
+//RX: the DMA writes _rx_ring round and round, the interrupts count the
+//bytes it wrote into _rx_head. HT and TC come every half of the ring, so
+//the DMA cannot lap _rx_pos between two interrupts. The reader owns
+//_rx_tail and finds lost bytes itself, no lock is needed.
+static volatile uint8_t _rx_ring[UART_RX_SIZE];
+static uint16_t _rx_pos;				// DMA position at the last interrupt
+static volatile uint16_t _rx_head;		// bytes received, written in the interrupts only
+static volatile uint16_t _rx_tail;		// bytes read, written by uart_read only
+static volatile uint32_t _rx_lost;
+static uart_rx_hook_t _rx_hook;
 
 void uart_init(void)
 {
@@ -25,24 +50,264 @@ void uart_init(void)
 	
 	//Enable USART1
 	USART1->CTLR1 |= USART_CTLR1_UE;
+	uart_tx_init();
+	uart_rx_init();
 }
 
 void uart_send_ch(char data)
 {
-	while((USART1->STATR & USART_STATR_TC) != USART_STATR_TC) {};
-	USART1->DATAR = data;	
+	uart_write(&data, 1);
 }
 void uart_send_str(char *data)
 {	
-	while(*data) {
-		uart_send_ch(*data++);
-	}
+	uint16_t len = 0;
+
+	while(data[len]) len++;
+	uart_write(data, len);
 }
 
 char uart_recv_ch(void)
 {
-	if ((USART1->STATR & USART_STATR_RXNE) == USART_STATR_RXNE) {
-		return (char)(USART1->DATAR);
+	char data = 0;
+
+	uart_read(&data, 1);
+	return data;
+}
+
+#if UART_TX_DMA
+//Start the next chunk, interrupts off or in the TC interrupt
+static void _uart_tx_next(void)
+{
+	uint16_t n = _tx_head - _tx_tail;
+	uint16_t tail = _tx_tail;
+
+	if (n == 0) {
+		_tx_busy = 0;
+		return;
+	}
+	if (n > UART_TX_CHUNK) n = UART_TX_CHUNK;
+	for (uint16_t i = 0; i < n; i++) {
+		_tx_dma[i] = _tx_ring[tail++ & (UART_TX_SIZE - 1)];
+	}
+	_tx_tail = tail;
+
+	DMA1_Channel4->CFGR &= ~DMA_CFGR1_EN;
+	DMA1_Channel4->CNTR = n;
+	DMA1_Channel4->CFGR |= DMA_CFGR1_EN;
+	_tx_busy = 1;
+}
+
+void uart_tx_init(void)
+{
+	NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+	RCC->AHBPCENR |= RCC_DMA1EN;
+	_tx_head = _tx_tail = 0;
+	_tx_busy = 0;
+
+	//DMA1 Channel 4 = USART1_TX, memory to DATAR, bytes, TC interrupt
+	DMA1_Channel4->CFGR = 0;
+	DMA1_Channel4->PADDR = (uint32_t)&USART1->DATAR;
+	DMA1_Channel4->MADDR = (uint32_t)_tx_dma;
+	DMA1_Channel4->CFGR = DMA_CFGR1_DIR | DMA_CFGR1_MINC | DMA_CFGR1_TCIE;
+	DMA1->INTFCR = DMA_CGIF4;
+
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART1->CTLR3 |= USART_CTLR3_DMAT;
+}
+
+uint16_t uart_write(const char *buf, uint16_t len)
+{
+	uint16_t n = 0;
+	uint16_t head = _tx_head;
+	uint16_t room;
+
+	while (n < len) {
+		room = UART_TX_SIZE - (uint16_t)(head - _tx_tail);
+		if (room == 0) {
+			if (_tx_policy == UART_TX_BLOCK) {
+				//The TC interrupt takes a chunk, but not while this runs in
+				//an interrupt handler: the flag is taken here
+				__disable_irq();
+				if (DMA1->INTFR & DMA_TCIF4) {
+					DMA1->INTFCR = DMA_CTCIF4;
+					_uart_tx_next();
+				}
+				__enable_irq();
+				continue;
+			}
+			if (_tx_policy == UART_TX_DROP) {
+				_tx_stats.dropped += len - n;
+				break;
+			}
+			__disable_irq();
+			if ((uint16_t)(head - _tx_tail) == UART_TX_SIZE) {
+				_tx_tail++;
+				_tx_stats.overwritten++;
+			}
+			__enable_irq();
+			continue;
+		}
+		if (room > len - n) room = len - n;
+		n += room;
+
+		//Free bytes of the ring, not read before head moves
+		while (room--) _tx_ring[head++ & (UART_TX_SIZE - 1)] = *buf++;
+		_tx_head = head;
+
+		__disable_irq();
+		if (!_tx_busy) _uart_tx_next();
+		__enable_irq();
+	}
+	_tx_stats.queued += n;
+	return n;
+}
+
+void uart_tx_flush(void)
+{
+	while (_tx_busy) {};
+	while((USART1->STATR & USART_STATR_TC) != USART_STATR_TC) {};
+}
+
+//Chunk sent to DATAR, the next one from the ring
+void DMA1_Channel4_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel4_IRQHandler(void)
+{
+	DMA1->INTFCR = DMA_CTCIF4;
+	_uart_tx_next();
+}
+#else
+//No ring, the CPU waits for each byte
+void uart_tx_init(void)
+{
+	USART1->CTLR1 |= USART_CTLR1_TE;
+}
+
+uint16_t uart_write(const char *buf, uint16_t len)
+{
+	for (uint16_t i = 0; i < len; i++) {
+		while ((USART1->STATR & USART_STATR_TXE) != USART_STATR_TXE) {};
+		USART1->DATAR = buf[i];
+	}
+	_tx_stats.queued += len;
+	return len;
+}
+
+void uart_tx_flush(void)
+{
+	while((USART1->STATR & USART_STATR_TC) != USART_STATR_TC) {};
+}
+#endif
+
+void uart_tx_policy(uint8_t policy)
+{
+#if UART_TX_DMA
+	_tx_policy = policy;
+#else
+	(void)policy;
+#endif
+}
+
+void uart_tx_stats(uart_tx_stats_t *stats)
+{
+	stats->queued = _tx_stats.queued;
+	stats->dropped = _tx_stats.dropped;
+	stats->overwritten = _tx_stats.overwritten;
+}
+
+void uart_rx_init(void)
+{
+	NVIC_InitTypeDef NVIC_InitStructure = {0};
+
+	RCC->AHBPCENR |= RCC_DMA1EN;
+	RCC->APB2PCENR |= RCC_IOPDEN;
+	_rx_pos = 0;
+	_rx_head = _rx_tail = 0;
+
+	//PD6(RX) input with pull-up, the ADC scan still converts it as Iout
+	GPIOD->CFGLR = (GPIOD->CFGLR & ~(GPIO_CFGLR_CNF6 | GPIO_CFGLR_MODE6)) | GPIO_CFGLR_CNF6_1;
+	GPIOD->BSHR = GPIO_BSHR_BS6;
+
+	//DMA1 Channel 5 = USART1_RX, DATAR to the ring, bytes, circular
+	DMA1_Channel5->CFGR = 0;
+	DMA1_Channel5->PADDR = (uint32_t)&USART1->DATAR;
+	DMA1_Channel5->MADDR = (uint32_t)_rx_ring;
+	DMA1_Channel5->CNTR = UART_RX_SIZE;
+	DMA1->INTFCR = DMA_CGIF5;
+	DMA1_Channel5->CFGR = DMA_CFGR1_MINC | DMA_CFGR1_CIRC | DMA_CFGR1_HTIE | DMA_CFGR1_TCIE
+						| DMA_CFGR1_PL_1 | DMA_CFGR1_EN;
+
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel5_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
+	NVIC_Init(&NVIC_InitStructure);
+
+	USART1->CTLR3 |= USART_CTLR3_DMAR;
+	USART1->CTLR1 |= USART_CTLR1_RE | USART_CTLR1_IDLEIE;
+}
+
+void uart_rx_hook(uart_rx_hook_t hook)
+{
+	_rx_hook = hook;
+}
+
+uint16_t uart_read(char *buf, uint16_t len)
+{
+	uint16_t n = 0;
+	uint16_t tail = _rx_tail;
+	uint16_t head = _rx_head;
+
+	//The DMA came round over bytes not read yet, keep the newest ring
+	if ((uint16_t)(head - tail) > UART_RX_SIZE) {
+		_rx_lost += (uint16_t)(head - tail) - UART_RX_SIZE;
+		tail = head - UART_RX_SIZE;
+	}
+	while (n < len && tail != head) {
+		buf[n++] = _rx_ring[tail++ & (UART_RX_SIZE - 1)];
+	}
+	_rx_tail = tail;
+	return n;
+}
+
+uint32_t uart_rx_lost(void)
+{
+	return _rx_lost;
+}
+
+//Count the bytes the DMA wrote since the last interrupt
+static void _uart_rx_event(void)
+{
+	uint16_t pos = (UART_RX_SIZE - DMA1_Channel5->CNTR) & (UART_RX_SIZE - 1);
+	uint16_t n = (pos - _rx_pos) & (UART_RX_SIZE - 1);
+
+	if (n == 0) return;
+	_rx_pos = pos;
+	_rx_head += n;
+	if (_rx_hook) _rx_hook();
+}
+
+//Half and end of the RX ring
+void DMA1_Channel5_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel5_IRQHandler(void)
+{
+	DMA1->INTFCR = DMA_CHTIF5 | DMA_CTCIF5;
+	_uart_rx_event();
+}
+
+//Line idle for a frame after the last byte, cleared by STATR then DATAR
+void USART1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void USART1_IRQHandler(void)
+{
+	if (USART1->STATR & USART_STATR_IDLE) {
+		(void)USART1->DATAR;
+		_uart_rx_event();
 	}
-	return 0;
 }
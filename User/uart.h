@@ -20,10 +20,59 @@
 #define UART_BAUD_57600		(FCLK / (16 * 57600))
 #define UART_BAUD_9600		(FCLK / (16 * 9600))
 
+//TX ring, drained by DMA1 Channel 4 in chunks, re-armed from its TC interrupt.
+//0 = no ring: uart_write waits for TXE byte by byte, saves 86 bytes of RAM
+#ifndef UART_TX_DMA
+#define UART_TX_DMA			1
+#endif
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE		64		// bytes, power of two, a full printf line
+#endif
+#define UART_TX_CHUNK		16		// bytes per DMA transfer, 1.4ms at 115200
+
+//What uart_write does when the ring is full
+#define UART_TX_DROP		0		// the new bytes are lost
+#define UART_TX_BLOCK		1		// wait for the DMA, also in an interrupt
+#define UART_TX_OVERWRITE	2		// the oldest bytes in the ring are lost
+#ifndef UART_TX_POLICY
+#define UART_TX_POLICY		UART_TX_BLOCK
+#endif
+
+//RX ring, written by DMA1 Channel 5 in circular mode, never stopped
+#ifndef UART_RX_SIZE
+#define UART_RX_SIZE		32		// bytes, power of two, an interrupt every half
+#endif
+
+//Without UART_TX_DMA only queued counts, the bytes sent
+typedef struct {
+	uint32_t queued;		// bytes put in the ring
+	uint32_t dropped;		// new bytes lost, UART_TX_DROP
+	uint32_t overwritten;	// old bytes lost, UART_TX_OVERWRITE
+} uart_tx_stats_t;
+
 void uart_init(void);
 void uart_send_ch(char data);
 void uart_send_str(char *data);
 char uart_recv_ch(void);
 
+//USART1 must be configured for TX, uart_init and USART_Printf_Init call it
+void uart_tx_init(void);
+//Returns at once unless UART_TX_BLOCK and the ring is full, returns the bytes queued
+uint16_t uart_write(const char *buf, uint16_t len);
+void uart_tx_policy(uint8_t policy);
+void uart_tx_stats(uart_tx_stats_t *stats);
+//Wait until the ring is empty and the last byte is sent
+void uart_tx_flush(void);
+
+//RX on PD6 by DMA1 Channel 5 (USART1_RX), after USART_Printf_Init and adc_init
+void uart_rx_init(void);
+//Called by the USART1 idle line and DMA1 Channel 5 interrupts when bytes arrived
+typedef void (*uart_rx_hook_t)(void);
+void uart_rx_hook(uart_rx_hook_t hook);
+//Returns at once, the bytes copied, from the hook or the main loop but not both
+uint16_t uart_read(char *buf, uint16_t len);
+//Bytes lost because they were not read before the DMA came round again
+uint32_t uart_rx_lost(void);
+
 
 #endif	/* __UART_H */ 
@@ -5,27 +5,54 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../User/adc.c \
 ../User/ch32v00x_it.c \
+../User/cmd.c \
+../User/console.c \
+../User/control.c \
 ../User/delay.c \
+../User/fmt.c \
 ../User/ili9341.c \
 ../User/main.c \
+../User/protect.c \
+../User/sched.c \
+../User/spwm.c \
 ../User/system_ch32v00x.c \
+../User/timebase.c \
 ../User/uart.c 
 
 C_DEPS += \
+./User/adc.d \
 ./User/ch32v00x_it.d \
+./User/cmd.d \
+./User/console.d \
+./User/control.d \
 ./User/delay.d \
+./User/fmt.d \
 ./User/ili9341.d \
 ./User/main.d \
+./User/protect.d \
+./User/sched.d \
+./User/spwm.d \
 ./User/system_ch32v00x.d \
+./User/timebase.d \
 ./User/uart.d 
 
 OBJS += \
+./User/adc.o \
 ./User/ch32v00x_it.o \
+./User/cmd.o \
+./User/console.o \
+./User/control.o \
 ./User/delay.o \
+./User/fmt.o \
 ./User/ili9341.o \
 ./User/main.o \
+./User/protect.o \
+./User/sched.o \
+./User/spwm.o \
 ./User/system_ch32v00x.o \
+./User/timebase.o \
 ./User/uart.o 
 
 
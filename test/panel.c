@@ -0,0 +1,134 @@
+/// \brief ILI9341 Model for Host Tests
+
+#include <string.h>
+
+#include "ili9341.h"
+#include "panel.h"
+
+panel_t panel;
+
+static uint8_t  _cmd;       // Last command
+static uint8_t  _arg;       // Parameter bytes after the command
+static uint16_t _word;      // Parameter being assembled
+static uint8_t  _ramwr;     // Memory write is open
+static uint8_t  _half;      // 8-bit frames: high byte of a pixel is waiting
+static uint16_t _hi;
+
+static void _pixel(uint16_t color)
+{
+    if (panel.x < PANEL_WIDTH && panel.y < PANEL_HEIGHT)
+    {
+        panel.fb[panel.y][panel.x] = color;
+    }
+    else
+    {
+        panel.outside++;
+    }
+    panel.pixels++;
+
+    if (panel.x < panel.xe)
+    {
+        panel.x++;
+        return;
+    }
+    panel.x = panel.xs;
+    panel.y = (panel.y < panel.ye) ? panel.y + 1 : panel.ys;
+}
+
+static void _param(uint8_t byte)
+{
+    _word = (_word << 8) | byte;
+    _arg++;
+
+    if (_cmd == ILI9341_CASET)
+    {
+        if (_arg == 2) panel.xs = _word;
+        if (_arg == 4) panel.xe = _word;
+    }
+    else if (_cmd == ILI9341_RASET)
+    {
+        if (_arg == 2) panel.ys = _word;
+        if (_arg == 4) panel.ye = _word;
+    }
+    else if (_cmd == ILI9341_VSCRDEF)
+    {
+        if (_arg == 2) panel.tfa = _word;
+        if (_arg == 4) panel.vsa = _word;
+        if (_arg == 6) panel.bfa = _word;
+    }
+    else if (_cmd == ILI9341_VSCRSADD)
+    {
+        if (_arg == 2) panel.vsp = _word;
+    }
+}
+
+static void _frame(const sim_frame_t* f)
+{
+    if (f->flags & SIM_CS)
+    {
+        panel.deselected++;
+        return;
+    }
+
+    if (!(f->flags & SIM_DC))
+    {
+        _cmd = f->data;
+        _arg = 0;
+        _word = 0;
+        _half = 0;
+        _ramwr = (_cmd == ILI9341_RAMWR);
+        panel.commands[_cmd]++;
+        if (_ramwr)
+        {
+            panel.x = panel.xs;
+            panel.y = panel.ys;
+        }
+        return;
+    }
+
+    if (!_ramwr)
+    {
+        if (f->flags & SIM_16BIT)
+        {
+            _param(f->data >> 8);
+            _param(f->data);
+        }
+        else
+        {
+            _param(f->data);
+        }
+        return;
+    }
+
+    if (f->flags & SIM_16BIT)
+    {
+        _pixel(f->data);
+    }
+    else if (_half)
+    {
+        _half = 0;
+        _pixel((_hi << 8) | (f->data & 0xFF));
+    }
+    else
+    {
+        _half = 1;
+        _hi = f->data & 0xFF;
+    }
+}
+
+void panel_attach(void)
+{
+    memset(&panel, 0, sizeof(panel));
+    _cmd = 0;
+    _arg = 0;
+    _ramwr = 0;
+    _half = 0;
+    sim_spi_sink = _frame;
+}
+
+uint16_t panel_line(uint16_t line)
+{
+    if (!panel.vsa || line < panel.tfa || line >= panel.tfa + panel.vsa) return line;
+
+    return panel.tfa + (line - panel.tfa + panel.vsp - panel.tfa) % panel.vsa;
+}
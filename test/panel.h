@@ -0,0 +1,45 @@
+/// \brief ILI9341 Model for Host Tests
+/// \details Decodes the SPI frames logged by sim.c the way the panel does:
+/// DC low is a command byte, DC high its parameters or memory data.
+/// CASET/RASET set the window, RAMWR writes 16-bit pixels from the window
+/// start, left to right and top to bottom, back to the start after the
+/// last pixel. Any other command ends the memory write. Frames sent while
+/// CS is high are ignored and counted. MADCTL is not modelled, the frame
+/// memory is kept in the coordinates the driver sends: 320x240 after
+/// tft_init(), 240x320 in portrait. VSCRDEF and VSCRSADD are recorded,
+/// panel_line() maps a panel line to the memory line it shows.
+
+#ifndef __PANEL_H__
+#define __PANEL_H__
+
+#include <stdint.h>
+#include "sim.h"
+
+#define PANEL_WIDTH  320
+#define PANEL_HEIGHT 320
+
+typedef struct
+{
+    uint16_t fb[PANEL_HEIGHT][PANEL_WIDTH];     // Frame memory
+    uint16_t xs, xe, ys, ye;                    // Window
+    uint16_t x, y;                              // Next memory address
+    uint16_t tfa, vsa, bfa;                     // Vertical scrolling definition, vsa 0 = none
+    uint16_t vsp;                               // Vertical scrolling start address
+    uint32_t commands[256];                     // Command bytes seen, per code
+    uint32_t pixels;                            // Pixels written
+    uint32_t deselected;                        // Frames with CS high
+    uint32_t outside;                           // Pixels outside the frame memory
+} panel_t;
+
+extern panel_t panel;
+
+/// \brief Clear the model and decode the SPI log from now on
+void panel_attach(void);
+
+/// \brief Memory Line Shown on a Panel Line
+/// \param line Panel line 0 ~ PANEL_HEIGHT -1, along the scroll axis
+/// \return Memory line: fixed areas show their own line, the scrolling
+/// area shows the start address on its first line and wraps within it
+uint16_t panel_line(uint16_t line);
+
+#endif  // __PANEL_H__
@@ -0,0 +1,962 @@
+/// \brief CH32V003 Register Model for Host Tests
+/// \details See sim.h. The register pages are mapped twice from one memfd:
+/// read only at the real address for the code under test, read/write at
+/// an alias for the model.
+
+#define _GNU_SOURCE
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "ch32v00x.h"
+#include "sim.h"
+
+#define SIM_PERIPH      0x40000000u
+#define SIM_PERIPH_LEN  0x24000u
+#define SIM_CORE        0xE000E000u     // PFIC and SysTick
+#define SIM_CORE_LEN    0x2000u
+#define SIM_PAGE        4096u
+#define SIM_STACK       (1u << 20)
+#define SIM_NEVER       UINT64_MAX
+#define SIM_TICK_US     50              // Spin detection period
+
+static uint8_t* _periph;    // Read/write alias of the peripheral space
+static uint8_t* _core;      // Read/write alias of PFIC and SysTick
+
+//-------------------------------------------------------------
+// Model state
+//-------------------------------------------------------------
+typedef struct
+{
+    uint8_t  on;        // EN seen, the transfer runs
+    uint8_t  hold;      // Background transfer kept from finishing
+    uint16_t reload;    // CNTR when enabled, for circular mode and HT
+    uint32_t mem;       // Memory address of the next element
+    uint32_t mem0;      // MADDR when enabled
+    uint64_t t_end;     // Background transfer finishes, 0 =none
+} sim_dma_t;
+
+typedef struct
+{
+    uint64_t t;
+    void (*fn)(void);
+} sim_event_t;
+
+static volatile uint64_t _now;
+static sim_dma_t   _dma[8];
+static sim_event_t _events[SIM_EVENTS];
+static uint64_t    _pend;           // Pending interrupts, set by an edge
+static uint64_t    _en;             // PFIC IENR
+static uint64_t    _pend_t[64];     // Time an interrupt became pending
+static uint8_t     _irq_on;         // mstatus MIE
+static uint8_t     _pins;           // SIM_DC | SIM_CS
+static uint8_t     _in_events;      // sim_at() callback runs
+
+// USART1 RX line
+static uint8_t  _rx_q[4096];
+static uint32_t _rx_head, _rx_tail;
+static uint64_t _rx_t;              // Next byte complete, 0 =line idle
+static uint64_t _rx_free;           // End of the last byte
+static uint64_t _rx_idle_t;         // Idle frame detected, 0 =none
+
+// Signal handling
+static volatile uintptr_t _fault;   // Write let through by the trap flag
+static volatile uint8_t   _in_write;
+static volatile uint32_t  _writes;
+static volatile uint32_t  _progress;
+static volatile uint8_t   _lock;    // Model runs outside a signal handler
+static volatile uint8_t   _running;
+static pthread_t          _main;
+static uint32_t           _writes_seen;
+
+sim_frame_t sim_spi[SIM_SPI_LOG];
+uint32_t    sim_spi_len;
+uint32_t    sim_spi_lost;
+void (*sim_spi_sink)(const sim_frame_t* frame);
+
+char     sim_uart_tx[65536];
+uint32_t sim_uart_tx_len;
+
+uint32_t sim_dma_arms[8];
+uint32_t sim_irq_count[64];
+uint64_t sim_irq_latency[64];
+uint8_t  sim_isr;
+void (*sim_on_write)(uint32_t addr);
+uint32_t sim_failures;
+
+//-------------------------------------------------------------
+// Interrupt vectors, the handlers the test links in
+//-------------------------------------------------------------
+#define SIM_VECTOR(name) extern void name(void) __attribute__((weak));
+SIM_VECTOR(SysTick_Handler)
+SIM_VECTOR(EXTI7_0_IRQHandler)
+SIM_VECTOR(DMA1_Channel1_IRQHandler)
+SIM_VECTOR(DMA1_Channel2_IRQHandler)
+SIM_VECTOR(DMA1_Channel3_IRQHandler)
+SIM_VECTOR(DMA1_Channel4_IRQHandler)
+SIM_VECTOR(DMA1_Channel5_IRQHandler)
+SIM_VECTOR(DMA1_Channel6_IRQHandler)
+SIM_VECTOR(DMA1_Channel7_IRQHandler)
+SIM_VECTOR(ADC1_IRQHandler)
+SIM_VECTOR(USART1_IRQHandler)
+SIM_VECTOR(SPI1_IRQHandler)
+SIM_VECTOR(TIM1_BRK_IRQHandler)
+SIM_VECTOR(TIM1_UP_IRQHandler)
+SIM_VECTOR(TIM1_CC_IRQHandler)
+SIM_VECTOR(TIM2_IRQHandler)
+
+static void (*_vector(uint8_t irq))(void)
+{
+    switch (irq)
+    {
+    case SysTick_IRQn:       return SysTick_Handler;
+    case EXTI7_0_IRQn:       return EXTI7_0_IRQHandler;
+    case DMA1_Channel1_IRQn: return DMA1_Channel1_IRQHandler;
+    case DMA1_Channel2_IRQn: return DMA1_Channel2_IRQHandler;
+    case DMA1_Channel3_IRQn: return DMA1_Channel3_IRQHandler;
+    case DMA1_Channel4_IRQn: return DMA1_Channel4_IRQHandler;
+    case DMA1_Channel5_IRQn: return DMA1_Channel5_IRQHandler;
+    case DMA1_Channel6_IRQn: return DMA1_Channel6_IRQHandler;
+    case DMA1_Channel7_IRQn: return DMA1_Channel7_IRQHandler;
+    case ADC_IRQn:           return ADC1_IRQHandler;
+    case USART1_IRQn:        return USART1_IRQHandler;
+    case SPI1_IRQn:          return SPI1_IRQHandler;
+    case TIM1_BRK_IRQn:      return TIM1_BRK_IRQHandler;
+    case TIM1_UP_IRQn:       return TIM1_UP_IRQHandler;
+    case TIM1_CC_IRQn:       return TIM1_CC_IRQHandler;
+    case TIM2_IRQn:          return TIM2_IRQHandler;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------
+// Checks
+//-------------------------------------------------------------
+void sim_fail(const char* file, int line, const char* what)
+{
+    fprintf(stderr, "%s:%d: %s\n", file, line, what);
+    sim_failures++;
+}
+
+// The code under test broke a rule of the hardware
+static void _violation(const char* what)
+{
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s, t=%lluns%s", what, (unsigned long long)_now,
+             sim_isr ? " in an interrupt" : "");
+    sim_fail("sim", 0, msg);
+}
+
+void* sim_alias(uintptr_t addr)
+{
+    if (addr - SIM_PERIPH < SIM_PERIPH_LEN) return _periph + (addr - SIM_PERIPH);
+    if (addr - SIM_CORE < SIM_CORE_LEN) return _core + (addr - SIM_CORE);
+    fprintf(stderr, "sim: %#lx is not a register\n", (unsigned long)addr);
+    abort();
+}
+
+#define _REG32(addr) (*(volatile uint32_t*)sim_alias(addr))
+#define _REG16(addr) (*(volatile uint16_t*)sim_alias(addr))
+
+static inline DMA_Channel_TypeDef* _dma_ch(uint8_t ch)
+{
+    return (DMA_Channel_TypeDef*)(uintptr_t)(DMA1_Channel1_BASE + (ch - 1) * 0x14);
+}
+
+static inline uint8_t _size(uint32_t bits)
+{
+    return 1 << (bits & 3);
+}
+
+static uint32_t _mem_read(uintptr_t addr, uint8_t size)
+{
+    if (size == 1) return *(volatile uint8_t*)addr;
+    if (size == 2) return *(volatile uint16_t*)addr;
+    return *(volatile uint32_t*)addr;
+}
+
+static void _mem_write(uintptr_t addr, uint32_t v, uint8_t size)
+{
+    if (size == 1) *(volatile uint8_t*)addr = v;
+    else if (size == 2) *(volatile uint16_t*)addr = v;
+    else *(volatile uint32_t*)addr = v;
+}
+
+//-------------------------------------------------------------
+// Interrupts
+//-------------------------------------------------------------
+static uint8_t _dma_level(uint8_t ch)
+{
+    uint32_t flags = (_REG32((uintptr_t)&DMA1->INTFR) >> ((ch - 1) * 4)) & 0x0F;
+    uint32_t cfgr  = SIM_REG(_dma_ch(ch)->CFGR);
+
+    return ((flags & 0x02) && (cfgr & DMA_CFGR1_TCIE)) ||
+           ((flags & 0x04) && (cfgr & DMA_CFGR1_HTIE)) ||
+           ((flags & 0x08) && (cfgr & DMA_CFGR1_TEIE));
+}
+
+static uint8_t _pending(uint8_t irq)
+{
+    if ((_pend >> irq) & 1) return 1;
+    if (irq >= DMA1_Channel1_IRQn && irq <= DMA1_Channel7_IRQn)
+    {
+        return _dma_level(irq - DMA1_Channel1_IRQn + 1);
+    }
+    return 0;
+}
+
+static void _raise(uint8_t irq)
+{
+    if (!_pending(irq)) _pend_t[irq] = _now;
+    _pend |= 1ull << irq;
+}
+
+static void _advance(uint64_t t);
+
+// Run the pending handlers, highest PFIC priority first
+static void _deliver(void)
+{
+    if (!_irq_on || sim_isr || _in_events) return;
+
+    for (uint32_t guard = 0; ; guard++)
+    {
+        int best = -1;
+        for (int n = 0; n < 64; n++)
+        {
+            if (!((_en >> n) & 1) || !_pending(n)) continue;
+            if (best < 0 || _core[0x400 + n] < _core[0x400 + best]) best = n;
+        }
+        if (best < 0) return;
+
+        if (guard == 100000)
+        {
+            fprintf(stderr, "sim: interrupt %d is never acknowledged\n", best);
+            abort();
+        }
+
+        void (*handler)(void) = _vector(best);
+        if (!handler)
+        {
+            _violation("interrupt enabled without a handler");
+            _en &= ~(1ull << best);
+            continue;
+        }
+
+        uint64_t latency = _now - _pend_t[best];
+        if (latency > sim_irq_latency[best]) sim_irq_latency[best] = latency;
+        _pend &= ~(1ull << best);
+
+        // The model is consistent here: a handler run from the test
+        // thread may spin on memory, the host timer moves time meanwhile
+        uint8_t lock = _lock;
+        sim_isr = best;
+        _irq_on = 0;
+        _advance(_now + SIM_ISR_NS / 2);
+        _lock = 0;
+        handler();
+        _lock = lock;
+        _advance(_now + SIM_ISR_NS / 2);
+        sim_isr = 0;
+        _irq_on = 1;
+        sim_irq_count[best]++;
+
+        // The handler reads STATR then DATAR, which clears these on the chip
+        if (best == USART1_IRQn)
+        {
+            SIM_REG(USART1->STATR) &= ~(USART_STATR_IDLE | USART_STATR_RXNE);
+        }
+    }
+}
+
+void sim_irq(uint8_t on)
+{
+    _lock++;
+    _irq_on = on;
+    if (on) _deliver();
+    _lock--;
+}
+
+void sim_irq_raise(uint8_t irq)
+{
+    _lock++;
+    _raise(irq);
+    _deliver();
+    _lock--;
+}
+
+//-------------------------------------------------------------
+// SPI1, USART1 and pins
+//-------------------------------------------------------------
+static void _spi_log(uint16_t data, uint8_t flags, uint64_t t)
+{
+    sim_frame_t frame = {t, data, flags};
+
+    // No malloc, this runs in the signal handlers
+    if (sim_spi_len < SIM_SPI_LOG)
+    {
+        sim_spi[sim_spi_len++] = frame;
+    }
+    else
+    {
+        sim_spi_lost++;
+    }
+    if (sim_spi_sink && !(flags & SIM_PIN)) sim_spi_sink(&frame);
+}
+
+uint32_t sim_spi_frames(void)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sim_spi_len; i++) n += !(sim_spi[i].flags & SIM_PIN);
+    return n;
+}
+
+static inline uint64_t _frame_ns(uint8_t is16)
+{
+    return (is16 ? 16 : 8) * SIM_SPI_BIT_NS;
+}
+
+static void _gpio(GPIO_TypeDef* port, uintptr_t reg)
+{
+    uint32_t out = SIM_REG(port->OUTDR);
+
+    if (reg == (uintptr_t)&port->BSHR)
+    {
+        uint32_t v = SIM_REG(port->BSHR);
+        out = (out & ~(v >> 16)) | (v & 0xFFFF);
+    }
+    else if (reg == (uintptr_t)&port->BCR)
+    {
+        out &= ~(SIM_REG(port->BCR) & 0xFFFF);
+    }
+    SIM_REG(port->OUTDR) = out;
+
+    if (port != GPIOC) return;
+
+    uint8_t pins = ((out & GPIO_Pin_3) ? SIM_DC : 0) | ((out & GPIO_Pin_4) ? SIM_CS : 0);
+    if (pins == _pins) return;
+    if (_dma[3].t_end) _violation("CS/DC changed while DMA1-CH3 sends");
+    _pins = pins;
+    _spi_log(pins, SIM_PIN | (sim_isr ? SIM_ISR : 0), _now);
+}
+
+static void _spi_write(void)
+{
+    uint8_t  is16 = (SIM_REG(SPI1->CTLR1) & SPI_CTLR1_DFF) != 0;
+    uint16_t data = SIM_REG(SPI1->DATAR);
+
+    if (_dma[3].t_end) _violation("CPU frame while DMA1-CH3 sends");
+    _spi_log(is16 ? data : data & 0xFF,
+             _pins | (is16 ? SIM_16BIT : 0) | (sim_isr ? SIM_ISR : 0), _now);
+    _advance(_now + _frame_ns(is16));   // Polled, the CPU waits for BSY
+}
+
+static void _uart_tx(uint8_t byte)
+{
+    if (sim_uart_tx_len < sizeof(sim_uart_tx) - 1)
+    {
+        sim_uart_tx[sim_uart_tx_len++] = byte;
+        sim_uart_tx[sim_uart_tx_len] = 0;
+    }
+}
+
+//-------------------------------------------------------------
+// DMA1
+//-------------------------------------------------------------
+static void _dma_flags(uint8_t ch, uint32_t flags)
+{
+    uint8_t irq = DMA1_Channel1_IRQn + ch - 1;
+    uint8_t was = _pending(irq);
+
+    SIM_REG(DMA1->INTFR) |= (flags | 0x01) << ((ch - 1) * 4);   // GIF with any flag
+    if (!was && _pending(irq)) _pend_t[irq] = _now;
+}
+
+// Channels with a free running request: SPI1 TX and USART1 TX are ready
+// for the next data as soon as the last one left, the whole block goes
+// out back to back and completes in the background.
+static uint8_t _dma_free_running(uint8_t ch)
+{
+    if (ch == 3) return (SIM_REG(SPI1->CTLR2) & SPI_CTLR2_TXDMAEN) != 0;
+    if (ch == 4) return (SIM_REG(USART1->CTLR3) & USART_CTLR3_DMAT) != 0;
+    return 0;
+}
+
+static void _dma_burst(uint8_t ch)
+{
+    DMA_Channel_TypeDef* c = _dma_ch(ch);
+    sim_dma_t* d = &_dma[ch];
+    uint32_t cfgr = SIM_REG(c->CFGR);
+    uint16_t n    = SIM_REG(c->CNTR);
+    uint8_t  size = _size(cfgr >> 10);
+    uint64_t t    = _now;
+
+    if (n == 0) return;
+
+    for (uint16_t i = 0; i < n; i++)
+    {
+        uint32_t v = _mem_read(d->mem, size);
+        if (cfgr & DMA_CFGR1_MINC) d->mem += size;
+
+        if (ch == 3)
+        {
+            uint8_t is16 = (SIM_REG(SPI1->CTLR1) & SPI_CTLR1_DFF) != 0;
+            _spi_log(is16 ? v & 0xFFFF : v & 0xFF,
+                     _pins | SIM_DMA | (is16 ? SIM_16BIT : 0) | (sim_isr ? SIM_ISR : 0), t);
+            t += _frame_ns(is16);
+        }
+        else
+        {
+            _uart_tx(v);
+            t += SIM_UART_BYTE_NS;
+        }
+    }
+    SIM_REG(c->CNTR) = 0;
+    d->t_end = t;
+}
+
+static void _dma_cfgr(uint8_t ch)
+{
+    DMA_Channel_TypeDef* c = _dma_ch(ch);
+    sim_dma_t* d = &_dma[ch];
+
+    if (!(SIM_REG(c->CFGR) & DMA_CFGR1_EN))
+    {
+        d->on = 0;
+        d->t_end = 0;   // An aborted transfer
+        return;
+    }
+    if (d->on) return;
+
+    d->on = 1;
+    d->reload = SIM_REG(c->CNTR);
+    d->mem = d->mem0 = SIM_REG(c->MADDR);
+    sim_dma_arms[ch]++;
+    if (_dma_free_running(ch)) _dma_burst(ch);
+}
+
+static void _reg_write(uintptr_t addr);
+
+// One request of a paced channel
+static void _dma_request(uint8_t ch)
+{
+    DMA_Channel_TypeDef* c = _dma_ch(ch);
+    sim_dma_t* d = &_dma[ch];
+    uint32_t cfgr  = SIM_REG(c->CFGR);
+    uint16_t n     = SIM_REG(c->CNTR);
+    uint8_t  psize = _size(cfgr >> 8);
+    uint8_t  msize = _size(cfgr >> 10);
+    uintptr_t pa   = SIM_REG(c->PADDR);
+
+    if (!d->on || n == 0) return;
+
+    if (cfgr & DMA_CFGR1_DIR)
+    {
+        uint32_t v = _mem_read(d->mem, msize);
+        if (psize == 1) *(volatile uint8_t*)sim_alias(pa) = v;
+        else if (psize == 2) _REG16(pa) = v;
+        else _REG32(pa) = v;
+        _reg_write(pa);
+    }
+    else
+    {
+        uint32_t v = (psize == 1) ? *(volatile uint8_t*)sim_alias(pa)
+                   : (psize == 2) ? _REG16(pa) : _REG32(pa);
+        _mem_write(d->mem, v, msize);
+    }
+    if (cfgr & DMA_CFGR1_MINC) d->mem += msize;
+
+    SIM_REG(c->CNTR) = --n;
+    if (n == d->reload / 2) _dma_flags(ch, 0x04);
+    if (n == 0)
+    {
+        _dma_flags(ch, 0x02);
+        if (cfgr & DMA_CFGR1_CIRC)
+        {
+            SIM_REG(c->CNTR) = d->reload;
+            d->mem = d->mem0;
+        }
+    }
+}
+
+void sim_dma_request(uint8_t ch)
+{
+    _lock++;
+    _dma_request(ch);
+    _deliver();
+    _lock--;
+}
+
+void sim_dma_hold(uint8_t ch, uint8_t hold)
+{
+    _lock++;
+    _dma[ch].hold = hold;
+    if (!hold)
+    {
+        _advance(_now);
+        _deliver();
+    }
+    _lock--;
+}
+
+//-------------------------------------------------------------
+// USART1 RX line
+//-------------------------------------------------------------
+void sim_uart_rx(uint8_t byte)
+{
+    _lock++;
+    if (_rx_head - _rx_tail == sizeof(_rx_q))
+    {
+        _violation("sim_uart_rx queue full");
+    }
+    else
+    {
+        _rx_q[_rx_head++ & (sizeof(_rx_q) - 1)] = byte;
+        if (!_rx_t)
+        {
+            uint64_t start = (_now > _rx_free) ? _now : _rx_free;
+            _rx_t = start + SIM_UART_BYTE_NS;
+            if (_rx_idle_t && start < _rx_idle_t) _rx_idle_t = 0;
+        }
+    }
+    _lock--;
+}
+
+uint32_t sim_uart_rx_pending(void)
+{
+    return _rx_head - _rx_tail;
+}
+
+static void _rx_byte(void)
+{
+    SIM_REG(USART1->DATAR) = _rx_q[_rx_tail++ & (sizeof(_rx_q) - 1)];
+    SIM_REG(USART1->STATR) |= USART_STATR_RXNE;
+    if (SIM_REG(USART1->CTLR3) & USART_CTLR3_DMAR) _dma_request(5);
+
+    _rx_free = _rx_t;
+    if (_rx_head != _rx_tail)
+    {
+        _rx_t += SIM_UART_BYTE_NS;
+    }
+    else
+    {
+        _rx_t = 0;
+        _rx_idle_t = _rx_free + SIM_UART_BYTE_NS;
+    }
+}
+
+static void _rx_idle(void)
+{
+    _rx_idle_t = 0;
+    SIM_REG(USART1->STATR) |= USART_STATR_IDLE;
+    if (SIM_REG(USART1->CTLR1) & USART_CTLR1_IDLEIE) _raise(USART1_IRQn);
+}
+
+//-------------------------------------------------------------
+// Events and time
+//-------------------------------------------------------------
+static uint64_t _next(void)
+{
+    uint64_t t = SIM_NEVER;
+
+    for (uint8_t ch = 1; ch < 8; ch++)
+    {
+        if (_dma[ch].t_end && !_dma[ch].hold && _dma[ch].t_end < t) t = _dma[ch].t_end;
+    }
+    if (_rx_t && _rx_t < t) t = _rx_t;
+    if (_rx_idle_t && _rx_idle_t < t) t = _rx_idle_t;
+    for (uint8_t i = 0; i < SIM_EVENTS; i++)
+    {
+        if (_events[i].fn && _events[i].t < t) t = _events[i].t;
+    }
+    return t;
+}
+
+// Run the events up to `t`, the handlers run later at an instruction boundary
+static void _advance(uint64_t t)
+{
+    for (;;)
+    {
+        uint64_t e = _next();
+        if (e > t) break;
+        if (e > _now) _now = e;
+        _progress++;
+
+        for (uint8_t ch = 1; ch < 8; ch++)
+        {
+            sim_dma_t* d = &_dma[ch];
+            if (d->t_end && !d->hold && d->t_end <= _now)
+            {
+                d->t_end = 0;
+                _dma_flags(ch, 0x06);
+            }
+        }
+        if (_rx_t && _rx_t <= _now) _rx_byte();
+        if (_rx_idle_t && _rx_idle_t <= _now) _rx_idle();
+        for (uint8_t i = 0; i < SIM_EVENTS; i++)
+        {
+            if (_events[i].fn && _events[i].t <= _now)
+            {
+                void (*fn)(void) = _events[i].fn;
+                _events[i].fn = 0;
+                _in_events++;
+                fn();
+                _in_events--;
+            }
+        }
+    }
+    if (t > _now) _now = t;
+}
+
+void sim_at(uint64_t t, void (*fn)(void))
+{
+    _lock++;
+    for (uint8_t i = 0; i < SIM_EVENTS; i++)
+    {
+        if (!_events[i].fn)
+        {
+            _events[i].t = t;
+            _events[i].fn = fn;
+            _lock--;
+            return;
+        }
+    }
+    fprintf(stderr, "sim: more than %d events\n", SIM_EVENTS);
+    abort();
+}
+
+uint64_t sim_now(void)
+{
+    return _now;
+}
+
+void sim_wait_until(uint64_t t)
+{
+    _lock++;
+    while (_now < t)
+    {
+        uint64_t e = _next();
+        _advance(e < t ? e : t);
+        _deliver();
+    }
+    _deliver();
+    _lock--;
+}
+
+void sim_idle(void)
+{
+    _lock++;
+    for (uint32_t guard = 0; guard < 10000000; guard++)
+    {
+        uint8_t busy = _rx_t || _rx_idle_t;
+        for (uint8_t ch = 1; ch < 8; ch++) busy |= _dma[ch].t_end && !_dma[ch].hold;
+        if (!busy) break;
+
+        _advance(_next());
+        _deliver();
+    }
+    _lock--;
+}
+
+// The firmware delays, debug.c polls SysTick
+void Delay_Us(uint32_t n)
+{
+    sim_wait_until(_now + n * 1000ull);
+}
+
+void Delay_Ms(uint32_t n)
+{
+    sim_wait_until(_now + n * 1000000ull);
+}
+
+// The printf target of debug.c, straight to the USART1 TX log. A test
+// linking uart.c overrides it with uart_write().
+__attribute__((weak)) int _write(int fd, char* buf, int size)
+{
+    (void)fd;
+    for (int i = 0; i < size; i++) _uart_tx(buf[i]);
+    return size;
+}
+
+//-------------------------------------------------------------
+// Register writes
+//-------------------------------------------------------------
+static void _reg_write(uintptr_t addr)
+{
+    uintptr_t reg = addr & ~(uintptr_t)3;
+
+    if (reg == (uintptr_t)&GPIOA->BSHR || reg == (uintptr_t)&GPIOA->BCR || reg == (uintptr_t)&GPIOA->OUTDR)
+        _gpio(GPIOA, reg);
+    else if (reg == (uintptr_t)&GPIOC->BSHR || reg == (uintptr_t)&GPIOC->BCR || reg == (uintptr_t)&GPIOC->OUTDR)
+        _gpio(GPIOC, reg);
+    else if (reg == (uintptr_t)&GPIOD->BSHR || reg == (uintptr_t)&GPIOD->BCR || reg == (uintptr_t)&GPIOD->OUTDR)
+        _gpio(GPIOD, reg);
+    else if (reg == (uintptr_t)&SPI1->DATAR)
+        _spi_write();
+    else if (reg == (uintptr_t)&USART1->DATAR)
+        _uart_tx(SIM_REG(USART1->DATAR));
+    else if (reg == (uintptr_t)&DMA1->INTFCR)
+    {
+        uint32_t clear = SIM_REG(DMA1->INTFCR);
+        for (uint8_t ch = 0; ch < 7; ch++)
+        {
+            if (clear & (1u << (ch * 4))) clear |= 0x0Fu << (ch * 4);  // CGIFx clears all
+        }
+        SIM_REG(DMA1->INTFR) &= ~clear;
+    }
+    else if (reg >= DMA1_Channel1_BASE && reg < DMA1_Channel1_BASE + 7 * 0x14)
+    {
+        if ((reg - DMA1_Channel1_BASE) % 0x14 == 0) _dma_cfgr((reg - DMA1_Channel1_BASE) / 0x14 + 1);
+    }
+    else if (reg >= SIM_CORE + 0x100 && reg < SIM_CORE + 0x300)
+    {
+        uint8_t  word = (reg & 0x1F) >> 2;
+        uint64_t bits = (uint64_t)_REG32(reg) << (32 * word);
+        if (word > 1) bits = 0;
+
+        switch ((reg - SIM_CORE) & ~0x7Fu)
+        {
+        case 0x100: _en |= bits; break;                 // IENR
+        case 0x180: _en &= ~bits; break;                // IRER
+        case 0x200:                                     // IPSR
+            for (uint8_t n = 0; n < 64; n++) if ((bits >> n) & 1) _raise(n);
+            break;
+        case 0x280: _pend &= ~bits; break;              // IPRR
+        }
+    }
+
+    if (sim_on_write) sim_on_write(addr);
+}
+
+//-------------------------------------------------------------
+// Write trapping
+//-------------------------------------------------------------
+static inline uint8_t _is_reg(uintptr_t a)
+{
+    return a - SIM_PERIPH < SIM_PERIPH_LEN || a - SIM_CORE < SIM_CORE_LEN;
+}
+
+static inline void* _page(uintptr_t a)
+{
+    return (void*)(a & ~(uintptr_t)(SIM_PAGE - 1));
+}
+
+static void _segv(int sig, siginfo_t* si, void* ctx)
+{
+    ucontext_t* uc = ctx;
+    uintptr_t a = (uintptr_t)si->si_addr;
+
+    (void)sig;
+    if (!_is_reg(a) || _in_write)
+    {
+        fprintf(stderr, "sim: segmentation fault at %p\n", si->si_addr);
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    _fault = a;
+    _in_write = 1;
+    mprotect(_page(a), SIM_PAGE, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= 0x100;    // Trap after the write
+}
+
+static void _trap(int sig, siginfo_t* si, void* ctx)
+{
+    ucontext_t* uc = ctx;
+    uintptr_t a = _fault;
+
+    (void)sig;
+    (void)si;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+    if (!_in_write) return;
+
+    mprotect(_page(a), SIM_PAGE, PROT_READ);
+    _in_write = 0;
+    _writes++;
+    _progress++;
+
+    _reg_write(a);
+    _advance(_now + SIM_WRITE_NS);
+    _deliver();
+}
+
+// The code under test spins on memory: let time run to the next event
+static void _tick(int sig)
+{
+    (void)sig;
+    if (!_running || _lock || _in_write) return;
+    if (_writes != _writes_seen)
+    {
+        _writes_seen = _writes;
+        return;
+    }
+
+    uint64_t e = _next();
+    if (e == SIM_NEVER) return;
+    _advance(e);
+    _deliver();
+}
+
+// Where the code under test is stuck
+static void _stuck(int sig)
+{
+    void* trace[32];
+
+    (void)sig;
+    fprintf(stderr, "sim: no progress for 5s at t=%lluns, interrupts %s, handler %d\n",
+            (unsigned long long)_now, _irq_on ? "on" : "off", sim_isr);
+    backtrace_symbols_fd(trace, backtrace(trace, 32), 2);
+    _exit(2);
+}
+
+static void* _watchdog(void* arg)
+{
+    uint32_t last = 0, still = 0;
+
+    (void)arg;
+    for (;;)
+    {
+        sleep(1);
+        if (!_running || _progress != last)
+        {
+            last = _progress;
+            still = 0;
+            continue;
+        }
+        if (++still == 5) pthread_kill(_main, SIGUSR1);
+    }
+    return 0;
+}
+
+static uint8_t* _map(uint32_t base, uint32_t len)
+{
+    int fd = memfd_create("sim", 0);
+    if (fd < 0 || ftruncate(fd, len) < 0) abort();
+
+    void* ro = mmap((void*)(uintptr_t)base, len, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    void* rw = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ro != (void*)(uintptr_t)base || rw == MAP_FAILED)
+    {
+        fprintf(stderr, "sim: cannot map %#x\n", base);
+        abort();
+    }
+    return rw;
+}
+
+void sim_init(void)
+{
+    struct sigaction sa;
+    pthread_t thread;
+
+    _periph = _map(SIM_PERIPH, SIM_PERIPH_LEN);
+    _core   = _map(SIM_CORE, SIM_CORE_LEN);
+
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIGALRM);
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;  // Handlers write registers too
+    sa.sa_sigaction = _segv;
+    sigaction(SIGSEGV, &sa, 0);
+    sa.sa_sigaction = _trap;
+    sigaction(SIGTRAP, &sa, 0);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _tick;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &sa, 0);
+    sa.sa_handler = _stuck;
+    sigaction(SIGUSR1, &sa, 0);
+
+    // The watchdog thread must not take the timer signal
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    _main = pthread_self();
+    pthread_create(&thread, 0, _watchdog, 0);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    struct itimerval tick = {{0, SIM_TICK_US}, {0, SIM_TICK_US}};
+    setitimer(ITIMER_REAL, &tick, 0);
+    setvbuf(stdout, 0, _IOLBF, 0);
+}
+
+void sim_reset(void)
+{
+    _lock++;
+    memset(_periph, 0, SIM_PERIPH_LEN);
+    memset(_core, 0, SIM_CORE_LEN);
+    SIM_REG(SPI1->STATR)   = SPI_STATR_TXE;
+    SIM_REG(USART1->STATR) = USART_STATR_TXE | USART_STATR_TC;
+
+    memset(_dma, 0, sizeof(_dma));
+    memset(_events, 0, sizeof(_events));
+    memset(_pend_t, 0, sizeof(_pend_t));
+    memset(sim_dma_arms, 0, sizeof(sim_dma_arms));
+    memset(sim_irq_count, 0, sizeof(sim_irq_count));
+    memset(sim_irq_latency, 0, sizeof(sim_irq_latency));
+    _pend = _en = 0;
+    _irq_on = 1;
+    sim_isr = 0;
+    _pins = 0;
+    _now = 0;
+    _rx_head = _rx_tail = 0;
+    _rx_t = _rx_free = _rx_idle_t = 0;
+    sim_spi_len = 0;
+    sim_spi_lost = 0;
+    sim_uart_tx_len = 0;
+    sim_uart_tx[0] = 0;
+    sim_spi_sink = 0;
+    sim_on_write = 0;
+    _lock--;
+}
+
+//-------------------------------------------------------------
+// Test runner
+//-------------------------------------------------------------
+static ucontext_t _main_ctx, _body_ctx;
+static void (*_body)(void);
+
+static void _trampoline(void)
+{
+    _body();
+}
+
+void sim_run(void (*body)(void))
+{
+    static void* stack;
+
+    if (!stack)
+    {
+        stack = mmap(0, SIM_STACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+        if (stack == MAP_FAILED) abort();
+    }
+    _body = body;
+    getcontext(&_body_ctx);
+    _body_ctx.uc_stack.ss_sp = stack;
+    _body_ctx.uc_stack.ss_size = SIM_STACK;
+    _body_ctx.uc_link = &_main_ctx;
+    makecontext(&_body_ctx, _trampoline, 0);
+
+    _running = 1;
+    swapcontext(&_main_ctx, &_body_ctx);
+    _running = 0;
+}
+
+void sim_test(const char* name, void (*body)(void))
+{
+    uint32_t failures = sim_failures;
+
+    sim_reset();
+    sim_run(body);
+    printf("%-40s %s\n", name, sim_failures == failures ? "ok" : "FAIL");
+}
+
+int sim_done(void)
+{
+    printf("%u failure%s\n", sim_failures, sim_failures == 1 ? "" : "s");
+    return sim_failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/// \brief CH32V003 Register Model for Host Tests
+/// \details The firmware sources are compiled for the host and run against
+/// a model of the peripherals they touch. The peripheral space and the
+/// PFIC/SysTick pages are mapped at their real addresses, read only, so
+/// every register write of the code under test faults. The fault handler
+/// lets the one instruction through (x86 trap flag) and the model then
+/// reacts to the written register:
+///  - GPIOx BSHR/BCR/OUTDR: pin levels, the CS (PC4) and DC (PC3) edges
+///  - SPI1 DATAR: one frame on the wire, 8 or 16 bits by CTLR1 DFF
+///  - DMA1 CHx CFGR EN: a transfer, to SPI1 and USART1 at their line rate,
+///    or one element per sim_dma_request() for paced channels
+///  - DMA1 INTFCR: flags cleared
+///  - PFIC IENR/IRER/IPSR/IPRR: enabled and pending interrupts
+///  - USART1 DATAR: one byte on the TX line
+/// Other writes only land in the register memory, a test sees them with
+/// sim_on_write().
+///
+/// Time is model time in ns. It moves by SIM_WRITE_NS per register write,
+/// by the frame time of polled SPI frames, and to the next event while the
+/// code under test spins on memory (a 50us host timer finds the spin).
+/// DMA transfers run in the background and finish by their own event.
+///
+/// Interrupt handlers run one at a time, between two instructions of the
+/// code under test, while interrupts are enabled (__enable_irq) and no
+/// handler runs. The PFIC priority decides which pending one runs first,
+/// there is no preemption. A handler run by sim_irq_raise() may spin on
+/// memory like the main code, e.g. for a DMA flag.
+///
+/// x86-64 Linux only. Build with -no-pie, 32-bit DMA addresses must reach
+/// the static data, and run the code under test with sim_run().
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_WRITE_NS    100     // CPU time of one register write
+#define SIM_ISR_NS      1000    // Entry and exit of an interrupt handler
+#define SIM_SPI_BIT_NS  42      // SPI1 at HCLK/2 = 24MHz
+#define SIM_UART_BYTE_NS 86806  // 10 bits at 115200
+
+// sim_frame_t.flags
+#define SIM_DC      0x01    // DC high (data) when the frame was sent
+#define SIM_CS      0x02    // CS high (deselected) when the frame was sent
+#define SIM_16BIT   0x04    // 16-bit frame
+#define SIM_DMA     0x08    // Sent by DMA1-CH3, else by the CPU
+#define SIM_ISR     0x10    // Started while an interrupt handler ran
+#define SIM_PIN     0x20    // Not a frame: CS/DC changed, data = new SIM_DC|SIM_CS
+
+typedef struct
+{
+    uint64_t t;         // model time, ns
+    uint16_t data;
+    uint8_t  flags;     // SIM_xxx
+} sim_frame_t;
+
+/// \brief Map the registers and install the handlers, once per process
+void sim_init(void);
+
+/// \brief Reset the model: registers, pins, DMA, interrupts, logs and time
+/// \details Interrupts are enabled, as after the startup code.
+void sim_reset(void);
+
+/// \brief Run a test body on a stack below 4GB
+void sim_run(void (*body)(void));
+
+// Time
+uint64_t sim_now(void);
+/// \brief Let time pass to `t` or later: events run and handlers are called
+void sim_wait_until(uint64_t t);
+/// \brief Run events until no DMA transfer is on the way
+void sim_idle(void);
+/// \brief Call `fn` from the event loop at model time `t`, e.g. a timer
+/// the test models itself. Up to SIM_EVENTS at a time.
+#define SIM_EVENTS 8
+void sim_at(uint64_t t, void (*fn)(void));
+
+// SPI1 log, every frame and every CS/DC change, the first SIM_SPI_LOG
+#define SIM_SPI_LOG (1u << 20)
+extern sim_frame_t sim_spi[SIM_SPI_LOG];
+extern uint32_t    sim_spi_len;
+extern uint32_t    sim_spi_lost;    // Not logged, the log was full
+/// \brief Frames without pin events
+uint32_t sim_spi_frames(void);
+/// \brief Called for each SPI frame, e.g. the panel model, 0 =none
+extern void (*sim_spi_sink)(const sim_frame_t* frame);
+
+// USART1 TX log
+extern char     sim_uart_tx[];
+extern uint32_t sim_uart_tx_len;
+/// \brief Queue a byte on the RX line, it arrives one frame after the last one
+void sim_uart_rx(uint8_t byte);
+/// \brief Bytes still on the RX line
+uint32_t sim_uart_rx_pending(void);
+
+// DMA1
+/// \brief Arms of the channel since the reset (EN 0 -> 1)
+extern uint32_t sim_dma_arms[8];
+/// \brief Keep a running transfer of the channel from finishing, 0 =release
+void sim_dma_hold(uint8_t ch, uint8_t hold);
+/// \brief One peripheral request of a paced channel, e.g. a timer update
+void sim_dma_request(uint8_t ch);
+
+// Interrupts
+/// \brief Pend an interrupt, e.g. a timer update the test models itself
+void sim_irq_raise(uint8_t irq);
+/// \brief Global interrupt enable, the host __enable_irq/__disable_irq
+void sim_irq(uint8_t on);
+/// \brief Handlers run since the reset, per interrupt number
+extern uint32_t sim_irq_count[64];
+/// \brief Longest time an interrupt was pending before its handler ran, ns
+extern uint64_t sim_irq_latency[64];
+/// \brief Handler running now, 0 =none
+extern uint8_t  sim_isr;
+
+/// \brief Called after the model handled a register write, 0 =none
+extern void (*sim_on_write)(uint32_t addr);
+
+/// \brief Register memory behind the read only mapping, for the model
+/// and the tests: set status bits, read what the firmware wrote
+#define SIM_REG(reg) (*(volatile __typeof__(reg)*)sim_alias((uintptr_t)&(reg)))
+void* sim_alias(uintptr_t addr);
+
+// Checks
+extern uint32_t sim_failures;
+void sim_fail(const char* file, int line, const char* what);
+#define CHECK(cond) do { if (!(cond)) sim_fail(__FILE__, __LINE__, #cond); } while (0)
+#define CHECK_EQ(a, b) do { long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { char _m[160]; snprintf(_m, sizeof(_m), "%s == %s (%lld != %lld)", #a, #b, _a, _b); \
+    sim_fail(__FILE__, __LINE__, _m); } } while (0)
+
+/// \brief Run one test case with a fresh model, prints its name
+#define TEST(fn) sim_test(#fn, fn)
+void sim_test(const char* name, void (*body)(void));
+/// \brief Summary line, returns the exit code
+int sim_done(void);
+
+#endif  // __SIM_H__
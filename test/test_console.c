@@ -0,0 +1,421 @@
+/// \brief Host Tests of the USART1 RX Ring and the Command Console
+/// \details uart.c and console.c run against the register model: the
+/// bytes arrive on the RX line at 115200, DMA1-CH5 writes them into the
+/// circular ring and the HT/TC and idle line interrupts run the console
+/// hook. The LCD keeps SPI1 busy meanwhile with small windowed fills, so
+/// the DMA1-CH3 handler sends CASET/RASET/RAMWR by the CPU between the
+/// RX interrupts, as in the demos of main.c. The SPWM commands of cmd.c
+/// run on the same console against fakes of the modules they drive.
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "../User/sched.h"
+#include "cmd.h"
+#include "console.h"
+#include "ili9341.h"
+#include "sim.h"
+#include "control.h"
+#include "protect.h"
+#include "spwm.h"
+#include "uart.h"
+
+#define RAN_LEN     128
+#define HALF_RING_NS ((uint64_t)UART_RX_SIZE / 2 * SIM_UART_BYTE_NS)
+
+typedef struct
+{
+    uint8_t  argc;
+    uint32_t argv[CONSOLE_ARGS];
+} ran_t;
+
+static ran_t    _ran[RAN_LEN];
+static uint32_t _nran;
+static volatile uint8_t _readies;
+
+// DMA1-CH3 handler time, from its first to its last register write
+static uint32_t _ch3_calls;
+static uint64_t _ch3_first, _ch3_max;
+
+static void _cmd_set(uint8_t argc, const uint32_t* argv)
+{
+    if (_nran < RAN_LEN)
+    {
+        _ran[_nran].argc = argc;
+        memcpy(_ran[_nran].argv, argv, argc * sizeof(argv[0]));
+    }
+    _nran++;
+}
+
+static const console_cmd_t _cmds[] =
+{
+    {"set",   "<a> [b]", _cmd_set},
+    {"amp",   "<a>",     cmd_amp},
+    {"freq",  "<hz>",    cmd_freq},
+    {"vout",  "<adc>",   cmd_vout},
+    {"stats", "",        cmd_stats},
+};
+
+//-------------------------------------------------------------
+// spwm.c, control.c, protect.c and sched.c as seen by cmd.c
+//-------------------------------------------------------------
+static char     _calls[256];    // "fn args;" of each call since _start()
+static uint16_t _control_amp;
+static protect_fault_t _fault;
+static uint8_t  _tripped;
+static const task_t _tasks[] =
+{
+    {"control", 0, 10, 10, 0},
+    {"adc",     0, 25, 25, 1},
+};
+static task_stats_t _task_stats[2];
+
+static void _call(const char* fmt, ...)
+{
+    size_t  n = strlen(_calls);
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(_calls + n, sizeof(_calls) - n, fmt, ap);
+    va_end(ap);
+}
+
+void spwm_set(uint16_t amplitude_q15, uint16_t freq_hz)
+{
+    _call("spwm_set %u %u;", amplitude_q15, freq_hz);
+}
+
+void control_init(uint16_t target, uint16_t amplitude_q15)
+{
+    _call("control_init %u %u;", target, amplitude_q15);
+}
+
+void control_stop(void)
+{
+    _call("control_stop;");
+}
+
+uint16_t control_amplitude(void)
+{
+    return _control_amp;
+}
+
+uint8_t protect_tripped(void)
+{
+    return _tripped;
+}
+
+void protect_get_fault(protect_fault_t* fault)
+{
+    *fault = _fault;
+}
+
+uint8_t sched_count(void)
+{
+    return 2;
+}
+
+const task_t* sched_task(uint8_t index)
+{
+    return &_tasks[index];
+}
+
+const task_stats_t* sched_stats(uint8_t index)
+{
+    return &_task_stats[index];
+}
+
+// The printf target of debug.c: the TX ring, as in the firmware
+int _write(int fd, char* buf, int size)
+{
+    (void)fd;
+    return uart_write(buf, size);
+}
+
+static void _ready(void)
+{
+    CHECK(sim_isr);
+    _readies++;
+}
+
+static void _ch3_write(uint32_t addr)
+{
+    (void)addr;
+    if (sim_isr != DMA1_Channel3_IRQn) return;
+    if (_ch3_calls != sim_irq_count[DMA1_Channel3_IRQn])
+    {
+        _ch3_calls = sim_irq_count[DMA1_Channel3_IRQn];
+        _ch3_first = sim_now();
+    }
+    if (sim_now() - _ch3_first > _ch3_max) _ch3_max = sim_now() - _ch3_first;
+}
+
+// USART1 RX running, the console on it
+static void _start(void)
+{
+    _nran = 0;
+    _readies = 0;
+    _calls[0] = 0;
+    uart_init();
+    console_init(_cmds, sizeof(_cmds) / sizeof(_cmds[0]), _ready);
+}
+
+static void _send(const char* str)
+{
+    while (*str) sim_uart_rx(*str++);
+}
+
+// Model time all bytes on the line are received and the line is idle
+static uint64_t _line_done(void)
+{
+    return sim_now() + (sim_uart_rx_pending() + 2) * SIM_UART_BYTE_NS;
+}
+
+// The main loop until `t`: 16x8 fills, each at a new window with the
+// job queue kept full, and the console task between them once posted
+static uint32_t _main_loop_until(uint64_t t)
+{
+    uint32_t n = 0;
+
+    while (sim_now() < t)
+    {
+        tft_fill_rect((n * 37) % 300, (n * 13) % 230, 16, 8, n);
+        n++;
+        if (_readies)
+        {
+            _readies = 0;
+            console_poll();
+        }
+    }
+    tft_dma_wait();
+    console_poll();
+    return n;
+}
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// 60ms of commands back to back on the line while the main loop draws:
+// the RX interrupts only wait for a DMA1-CH3 handler, no byte and no
+// line is lost, the commands run in order
+static void console_spi_busy(void)
+{
+    char line[16];
+    uint32_t lines = 0;
+    uint32_t bytes = 0;
+
+    tft_init();
+    sim_idle();
+    _start();
+    memset(sim_irq_latency, 0, sizeof(sim_irq_latency));
+    _ch3_calls = sim_irq_count[DMA1_Channel3_IRQn] - 1;    // The next call is a new one
+    _ch3_max = 0;
+    sim_on_write = _ch3_write;
+
+    while (bytes * SIM_UART_BYTE_NS < 60000000 && lines < RAN_LEN)
+    {
+        char* p = line;
+        p += sprintf(p, "set %u", lines * 7919 % 100000);
+        if (lines & 1) p += sprintf(p, " %u", lines);
+        *p++ = '\r';
+        *p = 0;
+        _send(line);
+        bytes += p - line;
+        lines++;
+    }
+    uint32_t fills = _main_loop_until(_line_done() + 1000000);
+
+    CHECK(fills > 500);
+    CHECK(tft_stats.windows >= fills);
+    CHECK_EQ(uart_rx_lost(), 0);
+    CHECK_EQ(console_lost(), 0);
+    CHECK_EQ(_nran, lines);
+    for (uint32_t i = 0; i < lines && i < _nran; i++)
+    {
+        CHECK_EQ(_ran[i].argc, 1 + (i & 1));
+        CHECK_EQ(_ran[i].argv[0], i * 7919 % 100000);
+        if (i & 1) CHECK_EQ(_ran[i].argv[1], i);
+    }
+
+    printf("  %u lines, %u bytes, %u fills: DMA1-CH3 handler up to %lluns,\n"
+           "  latency DMA1-CH5 %lluns, USART1 %lluns, half ring %lluns\n",
+           lines, bytes, fills, (unsigned long long)_ch3_max,
+           (unsigned long long)sim_irq_latency[DMA1_Channel5_IRQn],
+           (unsigned long long)sim_irq_latency[USART1_IRQn],
+           (unsigned long long)HALF_RING_NS);
+
+    // The window of a job: CASET, RASET, RAMWR and 8 bytes by the CPU
+    CHECK(_ch3_max < 10000);
+    CHECK(sim_irq_latency[DMA1_Channel5_IRQn] < _ch3_max + SIM_ISR_NS);
+    CHECK(sim_irq_latency[USART1_IRQn] < _ch3_max + SIM_ISR_NS);
+}
+
+// Lines past the FIFO and too long lines are counted and skipped up to
+// their end, the line after them runs; backspace edits the line
+static void console_lost_lines(void)
+{
+    _start();
+
+    // 9 lines of 7 fill the FIFO but for the terminator room, the 10th
+    // and 11th do not fit
+    for (uint8_t i = 0; i < 11; i++) _send("set 10\r");
+    sim_wait_until(_line_done());
+    CHECK_EQ(console_lost(), 2);
+    console_poll();
+    CHECK_EQ(_nran, 9);
+
+    _send("set 1234567890123456789012345678901\r");
+    _send("sex\bt 7\x7f" "8 9\n");
+    sim_wait_until(_line_done());
+    console_poll();
+
+    CHECK_EQ(console_lost(), 3);
+    CHECK_EQ(_nran, 10);
+    CHECK_EQ(_ran[9].argc, 2);
+    CHECK_EQ(_ran[9].argv[0], 8);
+    CHECK_EQ(_ran[9].argv[1], 9);
+    CHECK_EQ(uart_rx_lost(), 0);
+}
+
+// Without the hook the main loop reads late: the DMA came round, the
+// newest ring is kept and the rest counted
+static void uart_read_lapped(void)
+{
+    char buf[64];
+
+    _start();
+    uart_rx_hook(0);
+
+    for (uint8_t i = 0; i < UART_RX_SIZE + 10; i++) sim_uart_rx('a' + i % 26);
+    sim_wait_until(_line_done());
+
+    uint16_t n = uart_read(buf, sizeof(buf));
+    CHECK_EQ(n, UART_RX_SIZE);
+    CHECK_EQ(uart_rx_lost(), 10);
+    CHECK_EQ(buf[0], 'a' + 10);
+    CHECK_EQ(buf[n - 1], 'a' + (UART_RX_SIZE + 9) % 26);
+}
+
+// Run one command line, the calls it made are `want`
+static void _expect_calls(const char* file, int line, const char* cmd, const char* want)
+{
+    char msg[384];
+
+    _calls[0] = 0;
+    _send(cmd);
+    sim_wait_until(_line_done());
+    console_poll();
+    if (strcmp(_calls, want) == 0) return;
+    snprintf(msg, sizeof(msg), "%s-> \"%s\" != \"%s\"", cmd, _calls, want);
+    sim_fail(file, line, msg);
+}
+
+#define CHECK_CALLS(cmd, want) _expect_calls(__FILE__, __LINE__, (cmd), (want))
+
+// amp stops the regulation and sets the sine peak, freq keeps the peak
+// of now, vout starts the regulation from it; out of range or a wrong
+// count of numbers does nothing
+static void console_spwm_commands(void)
+{
+    uint16_t lost;
+
+    _start();
+    lost = console_lost();
+    cmd_init(120);
+    _control_amp = 16000;
+
+    CHECK_CALLS("freq 200\r", "spwm_set 16000 200;");
+    CHECK_CALLS("amp 20000\r", "control_stop;spwm_set 20000 200;");
+    _control_amp = 12345;
+    CHECK_CALLS("freq 50\r", "spwm_set 20000 50;");
+    CHECK_CALLS("vout 500\r", "control_init 500 20000;");
+    CHECK_CALLS("freq 60\r", "spwm_set 12345 60;");
+
+    // The edges of the ranges
+    CHECK_CALLS("freq 10\r", "spwm_set 12345 10;");
+    CHECK_CALLS("freq 400\r", "spwm_set 12345 400;");
+    CHECK_CALLS("amp 32768\r", "control_stop;spwm_set 32768 400;");
+    CHECK_CALLS("vout 1023\r", "control_init 1023 32768;");
+    CHECK_CALLS("amp 0\r", "control_stop;spwm_set 0 400;");
+    CHECK_CALLS("vout 0\r", "control_init 0 0;");
+
+    CHECK_CALLS("amp 32769\r", "");
+    CHECK_CALLS("freq 9\r", "");
+    CHECK_CALLS("freq 401\r", "");
+    CHECK_CALLS("vout 1024\r", "");
+    CHECK_CALLS("amp\r", "");
+    CHECK_CALLS("freq 100 2\r", "");
+    CHECK_CALLS("vout\r", "");
+    CHECK_CALLS("vout 5 6\r", "");
+    CHECK_CALLS("amp 1 2\r", "");
+
+    // Nothing was taken from the rejected lines
+    _control_amp = 777;
+    CHECK_CALLS("freq 120\r", "spwm_set 777 120;");
+    CHECK_EQ(console_lost(), lost);
+}
+
+// stats: a line per task, the trip line after the first trip, then the
+// UART counters, TX as it was after the lines before them
+static void console_stats(void)
+{
+    char want[512];
+    char* p = want;
+    uart_tx_stats_t tx;
+    uint32_t at;
+    uint16_t lost;
+
+    _start();
+    uart_tx_policy(UART_TX_BLOCK);
+    _task_stats[0] = (task_stats_t){1234, 56, 3, 0, 1};
+    _task_stats[1] = (task_stats_t){7, 890, 25, 2, 0};
+    _fault = (protect_fault_t){0};
+
+    _send("set 1234567890123456789012345678901\r");    // Lost, too long
+    _send("stats\r");
+    sim_wait_until(_line_done());
+    lost = console_lost();
+    uart_tx_flush();
+    at = sim_uart_tx_len;
+    uart_tx_stats(&tx);
+    console_poll();
+    uart_tx_flush();
+
+    p += sprintf(p, "control: 1234 runs, WCET 56 us, response 3 ms, overruns 0, misses 1\r\n"
+                    "adc: 7 runs, WCET 890 us, response 25 ms, overruns 2, misses 0\r\n");
+    sprintf(p, "TX %u bytes, dropped 0, overwritten 0\r\nRX lost %u bytes, %u lines\r\n> ",
+            (unsigned)(tx.queued + (p - want)), (unsigned)uart_rx_lost(), lost);
+    CHECK(!strcmp(sim_uart_tx + at, want));
+
+    // A trip, the outputs off
+    _fault = (protect_fault_t){99, 612, 35, 0, 3};
+    _tripped = 1;
+    _send("stats\r");
+    sim_wait_until(_line_done());
+    uart_tx_flush();
+    at = sim_uart_tx_len;
+    uart_tx_stats(&tx);
+    console_poll();
+    uart_tx_flush();
+
+    p = want + strlen("control: 1234 runs, WCET 56 us, response 3 ms, overruns 0, misses 1\r\n"
+                      "adc: 7 runs, WCET 890 us, response 25 ms, overruns 2, misses 0\r\n");
+    p += sprintf(p, "trip 3 (off): ADC 612, latency 35 counts of 1 /48 us\r\n");
+    sprintf(p, "TX %u bytes, dropped 0, overwritten 0\r\nRX lost %u bytes, %u lines\r\n> ",
+            (unsigned)(tx.queued + (p - want)), (unsigned)uart_rx_lost(), lost);
+    CHECK(!strcmp(sim_uart_tx + at, want));
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(console_spi_busy);
+    TEST(console_lost_lines);
+    TEST(uart_read_lapped);
+    TEST(console_spwm_commands);
+    TEST(console_stats);
+
+    return sim_done();
+}
@@ -0,0 +1,325 @@
+/// \brief Host Tests of the Output Voltage Regulation
+/// \details control.c runs against a plant model instead of spwm.c and
+/// adc.c. Per PWM period the bridge puts duty *Vdc on a second order
+/// filter: L (choke and transformer leakage) and C, referred to the
+/// primary, loaded by the secondary load through the turns ratio. The
+/// feedback is the rectified secondary through an RC, sampled once per
+/// period and averaged over 8 sweeps like adc_get_average.
+///
+/// The hook runs at each half cycle and its amplitude is used for the
+/// half after the one starting, as in spwm.c where the free half of the
+/// table is rewritten. The duty is quantized like the table: the peak to
+/// ARR counts, each step by the 8-bit sine.
+
+#include <math.h>
+#include <string.h>
+
+#include "adc.h"
+#include "control.h"
+#include "protect.h"
+#include "sim.h"
+#include "spwm.h"
+
+// Plant, 120Hz sine at 3225 clocks per PWM period (see test_spwm.c)
+#define ARR         247
+#define T_PWM       (3225 / 48e6)
+#define SUBSTEPS    8
+#define L_H         100e-6      // Choke + leakage, primary
+#define R_L         0.05        // Winding and switch resistance
+#define C_F         100e-6      // Filter C referred to the primary
+#define TURNS       10.0        // Secondary / primary
+#define R_LOAD      1000.0      // Secondary load, ohm
+#define TAU_SENSE   10e-3       // Feedback RC, see control.h
+#define K_ADC       10.5        // ADC counts per V of the rectified secondary
+
+#define TARGET      450         // VOUT_TARGET of main.c
+#define SETTLED     5           // counts around the target
+
+typedef struct
+{
+    double vdc, r_load;
+    double i, vc, vf;           // Choke current, C voltage, feedback
+    uint16_t adc[ADC_BUF_LEN];
+    uint8_t  adc_n;
+    uint16_t average;           // adc_get_average
+    uint16_t table[2];          // Amplitude each table half was written with
+    double   t, t_update;       // Time, next control_update
+} plant_t;
+
+static plant_t _plant;
+static spwm_hook_t _hook;
+static uint16_t _amplitude;     // From the hook, for the next rewritten half
+static uint8_t  _tripped;
+static uint8_t  _sine[SPWM_STEPS];
+
+//-------------------------------------------------------------
+// spwm.c, adc.c and protect.c as seen by control.c
+//-------------------------------------------------------------
+void spwm_set_hook(spwm_hook_t hook)
+{
+    _hook = hook;
+}
+
+void spwm_set_amplitude(uint16_t amplitude_q15)
+{
+    CHECK(amplitude_q15 <= SPWM_Q15_ONE);
+    _amplitude = amplitude_q15;
+}
+
+uint16_t adc_get_average(void)
+{
+    return _plant.average;
+}
+
+uint8_t protect_tripped(void)
+{
+    return _tripped;
+}
+
+//-------------------------------------------------------------
+// Plant
+//-------------------------------------------------------------
+static void _plant_reset(uint16_t amplitude_q15)
+{
+    memset(&_plant, 0, sizeof(_plant));
+    _plant.vdc = 12.0;
+    _plant.r_load = R_LOAD;
+    _plant.table[0] = _plant.table[1] = amplitude_q15;
+    _plant.t_update = 10e-3;
+    _hook = 0;
+    _amplitude = amplitude_q15;
+    _tripped = 0;
+}
+
+// One PWM period of the bridge at `duty` (signed, of Vdc), then one sweep
+static void _plant_period(double duty)
+{
+    plant_t* p = &_plant;
+    double dt = T_PWM / SUBSTEPS;
+    double r = p->r_load / (TURNS * TURNS);
+
+    for (uint8_t s = 0; s < SUBSTEPS; s++)
+    {
+        p->i  += dt / L_H * (duty * p->vdc - p->vc - R_L * p->i);
+        p->vc += dt / C_F * (p->i - p->vc / r);
+        p->vf += dt / TAU_SENSE * (fabs(TURNS * p->vc) - p->vf);
+    }
+    p->t += T_PWM;
+
+    long count = lround(p->vf * K_ADC);
+    p->adc[p->adc_n++ % ADC_BUF_LEN] = count > 1023 ? 1023 : count;
+
+    // Published every half of adc_BUF
+    if (p->adc_n % (ADC_BUF_LEN / 2) == 0)
+    {
+        uint16_t sum = 0;
+        for (uint8_t k = 0; k < ADC_BUF_LEN; k++) sum += p->adc[k];
+        p->average = sum >> ADC_BUF_SHIFT;
+    }
+
+    // The 10ms task of main.c
+    if (p->t >= p->t_update)
+    {
+        p->t_update += 10e-3;
+        control_update();
+    }
+}
+
+// Half cycle `leg`: the hook, the other half of the table rewritten,
+// then SPWM_STEPS periods out of this half
+static void _plant_half(uint8_t leg)
+{
+    plant_t* p = &_plant;
+
+    if (_hook) _hook();
+    p->table[leg ^ 1] = _amplitude;
+
+    uint32_t peak = ((uint32_t)ARR * p->table[leg]) >> 15;
+    for (uint8_t k = 0; k < SPWM_STEPS; k++)
+    {
+        double duty = (double)((peak * _sine[k]) >> 8) / (ARR + 1);
+        _plant_period(leg ? -duty : duty);
+    }
+}
+
+// Extremes of the ADC average at the half cycles of a run
+typedef struct
+{
+    uint16_t min, max;
+    double   settle;        // Last time outside TARGET +-SETTLED, from the start of the run
+} run_t;
+
+static run_t _plant_run(double seconds)
+{
+    run_t r = {1023, 0, 0};
+    double t0 = _plant.t;
+
+    while (_plant.t - t0 < seconds)
+    {
+        for (uint8_t leg = 0; leg < 2; leg++)
+        {
+            _plant_half(leg);
+            uint16_t a = _plant.average;
+            if (a + SETTLED < TARGET || a > TARGET + SETTLED) r.settle = _plant.t - t0;
+            if (a < r.min) r.min = a;
+            if (a > r.max) r.max = a;
+        }
+    }
+    return r;
+}
+
+static void _report(const char* what, run_t r)
+{
+    printf("  %-24s %4u ~ %4u counts, settled in %4.0fms\n", what, r.min, r.max, r.settle * 1e3);
+}
+
+// Steady state after a run: 0.5s more inside TARGET +-3, the ripple of
+// the feedback at the two sampling points of a cycle included
+static void _check_steady(void)
+{
+    run_t r = _plant_run(0.5);
+
+    _report("  steady", r);
+    CHECK(r.min >= TARGET - 3 && r.max <= TARGET + 3);
+    CHECK(control_amplitude() > 4096 && control_amplitude() < SPWM_Q15_ONE);
+}
+
+// Plant at rest, soft start to TARGET
+static run_t _start(void)
+{
+    _plant_reset(16384);
+    control_init(TARGET, 16384);
+    return _plant_run(1.5);
+}
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// From 0V: the reference ramps at 4 counts per 10ms, Vout follows it
+// without overshoot and settles
+static void control_soft_start(void)
+{
+    run_t r = _start();
+
+    _report("soft start 0 -> 450", r);
+    CHECK(r.max <= TARGET + SETTLED);
+    CHECK(r.settle < 1.25);
+    _check_steady();
+}
+
+// Load step, a fifth of the load resistance, and back
+static void control_load_step(void)
+{
+    _start();
+
+    _plant.r_load = R_LOAD / 5;
+    run_t r = _plant_run(0.5);
+    _report("load 1000 -> 200 ohm", r);
+    CHECK(r.min >= TARGET - 40);
+    CHECK(r.settle < 0.2);
+    _check_steady();
+
+    _plant.r_load = R_LOAD;
+    r = _plant_run(0.5);
+    _report("load 200 -> 1000 ohm", r);
+    CHECK(r.max <= TARGET + 40);
+    CHECK(r.settle < 0.2);
+    _check_steady();
+}
+
+// Line step, the DC bus drops 12 -> 10V and comes back
+static void control_line_step(void)
+{
+    _start();
+
+    _plant.vdc = 10.0;
+    run_t r = _plant_run(0.5);
+    _report("Vdc 12 -> 10V", r);
+    CHECK(r.min >= TARGET - 90);
+    CHECK(r.settle < 0.3);
+    _check_steady();
+
+    _plant.vdc = 12.0;
+    r = _plant_run(0.5);
+    _report("Vdc 10 -> 12V", r);
+    CHECK(r.max <= TARGET + 90);
+    CHECK(r.settle < 0.3);
+    _check_steady();
+}
+
+// Tripped: the hook holds the amplitude, the integrator does not wind up,
+// the retry ramps up from the collapsed Vout
+static void control_trip_holds(void)
+{
+    _start();
+    uint16_t held = control_amplitude();
+
+    _tripped = 1;
+    _plant.vdc = 0;                 // Outputs off
+    _plant_run(0.2);
+    CHECK_EQ(control_amplitude(), held);
+    CHECK_EQ(_amplitude, held);
+    CHECK(_plant.average < 20);
+
+    _plant.vdc = 12.0;
+    _tripped = 0;
+    run_t r = _plant_run(1.5);
+    _report("retry after a trip", r);
+    CHECK(r.max <= TARGET + SETTLED);
+    CHECK(r.settle < 1.25);
+    _check_steady();
+}
+
+// The time bound of the hook: |e| < 1024 keeps each product at 10
+// iterations, and the output stays inside 0 ~ SPWM_Q15_ONE, for every
+// reference and ADC count at both integrator limits
+static void control_hook_bounds(void)
+{
+    static const uint16_t refs[] = {0, 1, 512, 1022, 1023};
+
+    for (uint8_t n = 0; n < sizeof(refs) / sizeof(refs[0]); n++)
+    {
+        for (uint16_t adc = 0; adc < 1024; adc += 31)
+        {
+            for (uint8_t start = 0; start < 2; start++)
+            {
+                _plant_reset(0);
+                _plant.average = refs[n];       // The reference starts here
+                control_init(TARGET, start ? SPWM_Q15_ONE : 0);
+                _plant.average = adc;
+                for (uint8_t k = 0; k < 4; k++) _hook();
+                CHECK(control_amplitude() <= SPWM_Q15_ONE);
+                CHECK_EQ(control_amplitude(), _amplitude);
+            }
+        }
+    }
+    _plant.average = 0;
+    control_init(0, SPWM_Q15_ONE);
+    _plant.average = 1023;
+    for (uint16_t k = 0; k < 1000; k++) _hook();
+    CHECK_EQ(control_amplitude(), 0);
+    _plant.average = 1023;
+    control_init(1023, 0);
+    _plant.average = 0;
+    for (uint16_t k = 0; k < 1000; k++) _hook();
+    CHECK_EQ(control_amplitude(), SPWM_Q15_ONE);
+    control_stop();
+    CHECK(_hook == 0);
+}
+
+int main(void)
+{
+    sim_init();
+
+    // The table of spwm.c, sin(pi *(k +1) /62) *255
+    for (uint8_t k = 0; k < SPWM_STEPS; k++) _sine[k] = lround(sin(M_PI * (k + 1) / SPWM_STEPS) * 255);
+
+    TEST(control_soft_start);
+    TEST(control_load_step);
+    TEST(control_line_step);
+    TEST(control_trip_holds);
+    TEST(control_hook_bounds);
+
+    return sim_done();
+}
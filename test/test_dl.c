@@ -0,0 +1,220 @@
+/// \brief Host Tests of the Display List
+/// \details The same scene is drawn directly and rendered from the display
+/// list, the frame memory of the panel model must match pixel for pixel.
+
+#include <string.h>
+
+#include "ili9341.h"
+#include "panel.h"
+#include "sim.h"
+
+#define W 320
+#define H 240
+
+static uint16_t _ref[H][W];     // Scene drawn directly
+static uint8_t  _bitmap[9 * 7 * 2];
+
+// Panel initialized, logs and counters cleared
+static void _tft_start(void)
+{
+    tft_init();
+    sim_idle();
+    panel_attach();
+    sim_spi_len = 0;
+    memset(sim_dma_arms, 0, sizeof(sim_dma_arms));
+    memset(&tft_stats, 0, sizeof(tft_stats));
+}
+
+// The scene crosses the left, top, right and bottom edges, overlaps
+// items and has a text with an opaque background
+static void _scene_direct(void)
+{
+    tft_fill_rect(0, 0, W, H, NAVY);
+    tft_fill_rect(0, 20, 50, 30, RED);              // Starts at x = -10
+    tft_fill_circle(50, 40, 25, GREEN);
+    tft_fill_circle(160, 5, 12, MAGENTA);           // Cut by the top edge
+    tft_set_color(WHITE);
+    tft_set_background_color(BLACK);
+    tft_set_cursor(30, 35);
+    tft_print("Hi dl!");
+    tft_draw_bitmap(70, 10, 9, 7, _bitmap);
+    tft_fill_rect(300, 230, 20, 10, YELLOW);        // Cut by the right and bottom edges
+    tft_dma_wait();
+}
+
+static void _scene_list(void)
+{
+    tft_dl_clear();
+    CHECK_EQ(tft_dl_rect(-10, 20, 60, 30, RED), 0);
+    CHECK_EQ(tft_dl_circle(50, 40, 25, GREEN), 1);
+    CHECK_EQ(tft_dl_circle(160, 5, 12, MAGENTA), 2);
+    CHECK_EQ(tft_dl_text(30, 35, "Hi dl!", WHITE, BLACK), 3);
+    CHECK_EQ(tft_dl_bitmap(70, 10, 9, 7, _bitmap), 4);
+    CHECK_EQ(tft_dl_rect(300, 230, 40, 40, YELLOW), 5);
+}
+
+// Render an area and compare it with the reference, nothing outside
+// the area may be written, every pixel goes out once
+static void _render_compare(int16_t x, int16_t y, int16_t width, int16_t height)
+{
+    _tft_start();
+    _scene_list();
+    tft_dl_render(x, y, width, height, NAVY);
+    tft_dma_wait();
+
+    int16_t x0 = (x < 0) ? 0 : x, y0 = (y < 0) ? 0 : y;
+    int16_t x1 = (x + width > W) ? W : x + width;
+    int16_t y1 = (y + height > H) ? H : y + height;
+
+    uint32_t wrong = 0;
+    for (int16_t r = 0; r < PANEL_HEIGHT; r++)
+    {
+        for (int16_t c = 0; c < PANEL_WIDTH; c++)
+        {
+            uint8_t inside = r >= y0 && r < y1 && c >= x0 && c < x1;
+            wrong += panel.fb[r][c] != (inside ? _ref[r][c] : 0);
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(panel.pixels, (uint32_t)(x1 - x0) * (y1 - y0));
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 1);
+    CHECK_EQ(panel.outside, 0);
+    CHECK_EQ(tft_stats.bytes, 11 + 2 * panel.pixels);
+}
+
+//-------------------------------------------------------------
+// Display list against direct drawing
+//-------------------------------------------------------------
+
+// The scene drawn directly, kept as the reference
+static void dl_reference(void)
+{
+    _tft_start();
+    _scene_direct();
+    for (uint16_t r = 0; r < H; r++) memcpy(_ref[r], panel.fb[r], sizeof(_ref[r]));
+
+    CHECK_EQ(_ref[0][0], NAVY);
+    CHECK_EQ(_ref[20][0], RED);
+    CHECK_EQ(_ref[60][50], GREEN);
+    CHECK_EQ(_ref[0][160], MAGENTA);
+    CHECK_EQ(_ref[239][319], YELLOW);
+}
+
+// Wide area: bands are slices of one row
+static void dl_full_screen(void)
+{
+    _render_compare(0, 0, W, H);
+}
+
+// Narrow areas: bands hold several rows and split rows at odd places
+static void dl_narrow_area(void)
+{
+    _render_compare(20, 15, 60, 40);
+    _render_compare(33, 30, 13, 21);
+    _render_compare(160, 0, 1, 18);
+}
+
+// Areas clipped by the screen edges
+static void dl_clipped_area(void)
+{
+    _render_compare(-5, 200, 40, 100);
+    _render_compare(290, -20, 100, 40);
+    _render_compare(300, 235, 50, 50);
+}
+
+// Transparent text keeps the items below, like text printed with their color as background
+static void dl_transparent_text(void)
+{
+    _tft_start();
+    tft_fill_rect(0, 0, 100, 20, RED);
+    tft_set_color(WHITE);
+    tft_set_background_color(RED);
+    tft_set_cursor(3, 5);
+    tft_print("Wq|");
+    tft_dma_wait();
+    for (uint16_t r = 0; r < 20; r++) memcpy(_ref[r], panel.fb[r], sizeof(_ref[r]));
+
+    _tft_start();
+    tft_dl_clear();
+    tft_dl_rect(0, 0, 100, 20, RED);
+    tft_dl_text(3, 5, "Wq|", WHITE, ILI9341_TRANSPARENT);
+    tft_dl_render(0, 0, 100, 20, BLACK);
+    tft_dma_wait();
+
+    uint32_t wrong = 0;
+    for (uint16_t r = 0; r < 20; r++)
+    {
+        for (uint16_t c = 0; c < 100; c++) wrong += panel.fb[r][c] != _ref[r][c];
+    }
+    CHECK_EQ(wrong, 0);
+}
+
+// A full list of spans over rectangles, later items on top, spans cut
+// by the left and right edges: the same pixels as direct drawing, each sent once, fewer
+// bytes on the wire than the overdraw of the direct path
+static void dl_spans_bytes(void)
+{
+    uint32_t direct;
+
+    _tft_start();
+    tft_fill_rect(0, 0, W, H, BLACK);
+    tft_fill_rect(40, 40, 200, 120, BLUE);
+    tft_fill_rect(100, 80, 200, 120, RED);
+    for (int16_t y = 0; y < H; y += 27) tft_draw_line(y - 60, y, y + 90, y, (y & 8) ? WHITE : GREEN);
+    tft_draw_line(250, 100, W + 40, 100, YELLOW);
+    tft_dma_wait();
+    direct = tft_stats.bytes;
+    for (uint16_t r = 0; r < H; r++) memcpy(_ref[r], panel.fb[r], sizeof(_ref[r]));
+
+    _tft_start();
+    tft_dl_clear();
+    tft_dl_rect(40, 40, 200, 120, BLUE);
+    tft_dl_rect(100, 80, 200, 120, RED);
+    for (int16_t y = 0; y < H; y += 27) CHECK(tft_dl_span(y - 60, y, 151, (y & 8) ? WHITE : GREEN) >= 0);
+    CHECK_EQ(tft_dl_span(250, 100, W + 40 - 250 + 1, YELLOW), TFT_DL_LEN - 1);
+    tft_dl_render(0, 0, W, H, BLACK);
+    tft_dma_wait();
+
+    uint32_t wrong = 0;
+    for (uint16_t r = 0; r < H; r++)
+    {
+        for (uint16_t c = 0; c < W; c++) wrong += panel.fb[r][c] != _ref[r][c];
+    }
+    printf("  direct %u bytes, display list %u bytes\n", direct, tft_stats.bytes);
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(panel.pixels, W * H);
+    CHECK_EQ(tft_stats.bytes, 11 + 2 * W * H);
+    CHECK(tft_stats.bytes < direct);
+}
+
+// Nothing sent for an area off the screen, a full list refuses items
+static void dl_limits(void)
+{
+    _tft_start();
+    _scene_list();
+    tft_dl_render(W, 0, 10, 10, NAVY);
+    tft_dl_render(0, -10, 10, 10, NAVY);
+    tft_dma_wait();
+    CHECK_EQ(sim_spi_len, 0);
+
+    for (uint8_t i = 6; i < TFT_DL_LEN; i++) CHECK_EQ(tft_dl_span(0, i, 5, RED), i);
+    CHECK_EQ(tft_dl_span(0, 0, 5, RED), -1);
+    CHECK_EQ(tft_dl_rect(0, 0, 0, 5, RED), -1);    // Empty box
+}
+
+int main(void)
+{
+    sim_init();
+
+    for (uint16_t i = 0; i < sizeof(_bitmap); i++) _bitmap[i] = i * 37 + 11;
+
+    TEST(dl_reference);
+    TEST(dl_full_screen);
+    TEST(dl_narrow_area);
+    TEST(dl_clipped_area);
+    TEST(dl_transparent_text);
+    TEST(dl_spans_bytes);
+    TEST(dl_limits);
+
+    return sim_done();
+}
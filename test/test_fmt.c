@@ -0,0 +1,158 @@
+/// \brief Host Tests of the Division-free Formatter
+/// \details fmt.c at the edges of its range: 0, the powers of 10, the
+/// largest values, field widths narrower and wider than the number and
+/// the decimals from none to 9. No character past FMT_LEN is written.
+
+#include <string.h>
+
+#include "fmt.h"
+#include "sim.h"
+
+#define GUARD 4
+
+static char _buf[FMT_LEN + GUARD];
+
+static char* _clear(void)
+{
+    memset(_buf, '#', sizeof(_buf));
+    return _buf;
+}
+
+// The formatted characters are `want`, the guard after the buffer is kept
+static void _expect(const char* file, int line, uint8_t n, const char* want)
+{
+    char msg[96];
+
+    if (n == strlen(want) && !memcmp(_buf, want, n))
+    {
+        for (uint8_t i = FMT_LEN; i < sizeof(_buf); i++)
+        {
+            if (_buf[i] != '#') sim_fail(file, line, "wrote past FMT_LEN");
+        }
+        return;
+    }
+    snprintf(msg, sizeof(msg), "\"%.*s\" != \"%s\"", n < FMT_LEN + GUARD ? n : FMT_LEN + GUARD, _buf, want);
+    sim_fail(file, line, msg);
+}
+
+#define CHECK_FMT(call, want) _expect(__FILE__, __LINE__, (call), (want))
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+static void fmt_dec_edges(void)
+{
+    char     want[16];
+    uint32_t pow = 1;
+
+    CHECK_FMT(fmt_dec(_clear(), 0, 0, ' '), "0");
+    CHECK_FMT(fmt_dec(_clear(), UINT32_MAX, 0, ' '), "4294967295");
+
+    // Both sides of each power of 10
+    for (uint8_t i = 0; i < 10; i++, pow *= 10)
+    {
+        sprintf(want, "%u", pow);
+        CHECK_FMT(fmt_dec(_clear(), pow, 0, ' '), want);
+        sprintf(want, "%u", pow - 1);
+        CHECK_FMT(fmt_dec(_clear(), pow - 1, 0, ' '), want);
+    }
+
+    CHECK_FMT(fmt_dec(_clear(), 42, 5, ' '), "   42");
+    CHECK_FMT(fmt_dec(_clear(), 42, 5, '0'), "00042");
+    CHECK_FMT(fmt_dec(_clear(), 0, 3, '0'), "000");
+    CHECK_FMT(fmt_dec(_clear(), 123456, 3, ' '), "123456");   // Narrower: all digits
+    CHECK_FMT(fmt_dec(_clear(), UINT32_MAX, 10, ' '), "4294967295");
+    CHECK_FMT(fmt_dec(_clear(), UINT32_MAX, 40, ' '), "  4294967295");  // Up to FMT_LEN
+    CHECK_FMT(fmt_dec(_clear(), 7, 255, ' '), "           7");
+}
+
+static void fmt_int_edges(void)
+{
+    CHECK_FMT(fmt_int(_clear(), 0, 0), "0");
+    CHECK_FMT(fmt_int(_clear(), -1, 0), "-1");
+    CHECK_FMT(fmt_int(_clear(), INT32_MAX, 0), "2147483647");
+    CHECK_FMT(fmt_int(_clear(), INT32_MIN, 0), "-2147483648");
+    CHECK_FMT(fmt_int(_clear(), INT32_MIN + 1, 0), "-2147483647");
+    CHECK_FMT(fmt_int(_clear(), -42, 5), "  -42");
+    CHECK_FMT(fmt_int(_clear(), -42, 2), "-42");               // Narrower: sign and digits
+    CHECK_FMT(fmt_int(_clear(), 42, 1), "42");
+    CHECK_FMT(fmt_int(_clear(), INT32_MIN, 11), "-2147483648");
+    CHECK_FMT(fmt_int(_clear(), INT32_MIN, 40), " -2147483648");   // Up to FMT_LEN
+}
+
+static void fmt_fixed_edges(void)
+{
+    CHECK_FMT(fmt_fixed(_clear(), 0, 0, 1), "0.0");
+    CHECK_FMT(fmt_fixed(_clear(), 5, 0, 3), "0.005");
+    CHECK_FMT(fmt_fixed(_clear(), 12345, 0, 3), "12.345");
+    CHECK_FMT(fmt_fixed(_clear(), 12345, 8, 2), "  123.45");
+    CHECK_FMT(fmt_fixed(_clear(), 12345, 3, 2), "123.45");     // Narrower: all digits
+
+    // No decimals: an integer, no point
+    CHECK_FMT(fmt_fixed(_clear(), 0, 0, 0), "0");
+    CHECK_FMT(fmt_fixed(_clear(), 1234, 6, 0), "  1234");
+    CHECK_FMT(fmt_fixed(_clear(), UINT32_MAX, 0, 0), "4294967295");
+
+    // 9 decimals, the most
+    CHECK_FMT(fmt_fixed(_clear(), 0, 0, 9), "0.000000000");
+    CHECK_FMT(fmt_fixed(_clear(), 1, 0, 9), "0.000000001");
+    CHECK_FMT(fmt_fixed(_clear(), 999999999, 0, 9), "0.999999999");
+    CHECK_FMT(fmt_fixed(_clear(), 1000000000, 0, 9), "1.000000000");
+    CHECK_FMT(fmt_fixed(_clear(), UINT32_MAX, 0, 9), "4.294967295");
+    CHECK_FMT(fmt_fixed(_clear(), UINT32_MAX, 0, 1), "429496729.5");
+    CHECK_FMT(fmt_fixed(_clear(), UINT32_MAX, 40, 1), " 429496729.5");  // Up to FMT_LEN
+}
+
+static void fmt_fixed_negative(void)
+{
+    CHECK_FMT(fmt_fixed_int(_clear(), -5, 0, 2), "-0.05");
+    CHECK_FMT(fmt_fixed_int(_clear(), -5, 7, 2), "  -0.05");
+    CHECK_FMT(fmt_fixed_int(_clear(), -12345, 0, 3), "-12.345");
+    CHECK_FMT(fmt_fixed_int(_clear(), -12345, 4, 3), "-12.345"); // Narrower: all of it
+    CHECK_FMT(fmt_fixed_int(_clear(), -7, 0, 0), "-7");
+    CHECK_FMT(fmt_fixed_int(_clear(), 5, 6, 2), "  0.05");
+    CHECK_FMT(fmt_fixed_int(_clear(), 0, 0, 1), "0.0");
+    CHECK_FMT(fmt_fixed_int(_clear(), -1, 0, 9), "-0.000000001");
+    CHECK_FMT(fmt_fixed_int(_clear(), INT32_MIN, 0, 9), "-2.147483648");
+    CHECK_FMT(fmt_fixed_int(_clear(), INT32_MIN, 0, 1), "-214748364.8");
+    CHECK_FMT(fmt_fixed_int(_clear(), INT32_MAX, 0, 3), "2147483.647");
+}
+
+static void fmt_hex_edges(void)
+{
+    CHECK_FMT(fmt_hex(_clear(), 0, 1), "0");
+    CHECK_FMT(fmt_hex(_clear(), 0, 8), "00000000");
+    CHECK_FMT(fmt_hex(_clear(), UINT32_MAX, 8), "FFFFFFFF");
+    CHECK_FMT(fmt_hex(_clear(), 0x89ABCDEF, 8), "89ABCDEF");
+    CHECK_FMT(fmt_hex(_clear(), 0x0A, 4), "000A");
+    CHECK_FMT(fmt_hex(_clear(), 0x1234, 2), "34");             // Narrower: the low digits
+    CHECK_FMT(fmt_hex(_clear(), 0x12345678, 12), "12345678");  // At most 8
+}
+
+// The print helpers go to _write, the USART1 TX log of the model
+static void fmt_print_target(void)
+{
+    fmt_print("v=");
+    fmt_print_dec(1234, 6);
+    fmt_print(" id=");
+    fmt_print_hex(0xBEEF, 6);
+    fmt_print("");
+
+    CHECK_EQ(sim_uart_tx_len, strlen("v=  1234 id=00BEEF"));
+    CHECK(!strcmp(sim_uart_tx, "v=  1234 id=00BEEF"));
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(fmt_dec_edges);
+    TEST(fmt_int_edges);
+    TEST(fmt_fixed_edges);
+    TEST(fmt_fixed_negative);
+    TEST(fmt_hex_edges);
+    TEST(fmt_print_target);
+
+    return sim_done();
+}
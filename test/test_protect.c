@@ -0,0 +1,209 @@
+/// \brief Host Tests of the Output Protection
+/// \details protect.c runs with stand-ins for adc.c. The test models
+/// the TIM1 counter and the ADC sweep: an update at t0, the sweep at
+/// CNT =CCR4, the analog watchdog when the Vout conversion is done, 26
+/// ADCCLK later. CNT is set from the model time when the handler clears
+/// MOE, just before it reads CNT, so the latency in the fault record is
+/// the one of the model: conversion, interrupt entry (SIM_ISR_NS /2) and
+/// the register writes before the MOE clear.
+
+#include <string.h>
+
+#include "adc.h"
+#include "ch32v00x.h"
+#include "ch32v00x_tim.h"
+#include "protect.h"
+#include "sim.h"
+
+#define TIM1_PSC    12          // 120Hz sine: 13 *248 clocks per period
+#define TIM1_ARR    247
+#define TICK_NS     ((TIM1_PSC + 1) * 1000.0 / 48)
+#define CONV_NS     (26 * 1000 / 12)    // Vout conversion, 26 ADCCLK at 12MHz
+#define HIGH        700
+#define RETRY       40          // PWM periods
+
+static adc_hook_t   _hook;
+static adc_sample_t _sample;
+static uint32_t     _count;
+static uint64_t     _t_update;  // Model time of the last TIM1 update
+static uint64_t     _t_moe;     // MOE cleared, 0 =not yet
+static uint32_t     _writes;    // Register writes of the handler before the MOE clear
+
+//-------------------------------------------------------------
+// adc.c as seen by protect.c
+//-------------------------------------------------------------
+void adc_set_hook(adc_hook_t hook)
+{
+    _hook = hook;
+}
+
+uint32_t adc_count(void)
+{
+    return _count;
+}
+
+void adc_get_sample(adc_sample_t* sample)
+{
+    *sample = _sample;
+}
+
+//-------------------------------------------------------------
+// TIM1 counter and the ADC sweep
+//-------------------------------------------------------------
+static void _tim1_write(uint32_t addr)
+{
+    if (!sim_isr || _t_moe) return;
+    if (addr == (uintptr_t)&TIM1->BDTR && !(SIM_REG(TIM1->BDTR) & TIM_MOE))
+    {
+        _t_moe = sim_now();
+        SIM_REG(TIM1->CNT) = (uint16_t)((_t_moe - _t_update) / TICK_NS) % (TIM1_ARR + 1);
+    }
+    else
+    {
+        _writes++;
+    }
+}
+
+static void _watchdog(void)
+{
+    sim_irq_raise(ADC_IRQn);
+}
+
+// TIM1 running with the outputs on, protect_init as in main.c
+static void _start(uint8_t retries)
+{
+    _hook = 0;
+    _count = 0;
+    _t_moe = 0;
+    _writes = 0;
+    memset(&_sample, 0, sizeof(_sample));
+
+    SIM_REG(TIM1->PSC) = TIM1_PSC;
+    SIM_REG(TIM1->ATRLR) = TIM1_ARR;
+    SIM_REG(TIM1->CH4CVR) = ADC_TRIG_DELAY;
+    SIM_REG(TIM1->BDTR) = TIM_MOE | TIM_AOE | 200;
+    protect_init(0, HIGH, RETRY, retries);
+    sim_on_write = _tim1_write;
+}
+
+// A sweep which trips: the update at `t_update`, the sample `value`,
+// the watchdog `delay_ns` after the conversion
+static void _trip(uint16_t value, uint64_t t_update, uint64_t delay_ns)
+{
+    _t_update = t_update;
+    _t_moe = 0;
+    _writes = 0;
+    _count += ADC_BUF_LEN / 2;
+    SIM_REG(ADC1->RDATAR) = value;
+    sim_at(t_update + ADC_TRIG_DELAY * TICK_NS + CONV_NS + delay_ns, _watchdog);
+    sim_wait_until(t_update + 1000 * TICK_NS);
+}
+
+// The ADC DMA interrupt, `halves` times, the sweeps at `value`
+static void _sweeps(uint16_t value, uint16_t halves)
+{
+    _sample.vout = value;
+    for (uint16_t n = 0; n < halves; n++)
+    {
+        _count += ADC_BUF_LEN / 2;
+        if (_hook) _hook();
+    }
+}
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// MOE and AOE cleared by the first register write of the handler, the
+// latency from the sweep start recorded in TIM1 counts
+static void protect_trip_latency(void)
+{
+    protect_fault_t f;
+
+    _start(0);
+    _trip(HIGH + 20, sim_now() + 10000, 0);
+
+    CHECK(protect_tripped());
+    CHECK_EQ(SIM_REG(TIM1->BDTR) & (TIM_MOE | TIM_AOE), 0);
+    CHECK_EQ(SIM_REG(TIM1->BDTR) & 0xFF, 200);     // Dead time kept
+    CHECK_EQ(_writes, 0);
+
+    protect_get_fault(&f);
+    uint64_t sweep = _t_update + ADC_TRIG_DELAY * TICK_NS;
+    uint64_t latency = _t_moe - sweep;
+    printf("  trip: MOE clear %lluns after the sweep start, %u counts of %u /48 us recorded\n",
+           (unsigned long long)latency, f.latency, f.psc + 1);
+
+    CHECK(latency < 3000);
+    CHECK_EQ(f.latency, (uint16_t)((_t_moe - _t_update) / TICK_NS) - ADC_TRIG_DELAY);
+    CHECK(f.latency * TICK_NS >= latency - TICK_NS && f.latency * TICK_NS <= latency + TICK_NS);
+    CHECK_EQ(f.psc, TIM1_PSC);
+    CHECK_EQ(f.value, HIGH + 20);
+    CHECK_EQ(f.sweep, ADC_BUF_LEN / 2);
+    CHECK_EQ(f.trips, 1);
+    CHECK_EQ(sim_irq_count[ADC_IRQn], 1);
+}
+
+// The handler ran after the next update, CNT below CCR4: one period added
+static void protect_trip_wraps(void)
+{
+    protect_fault_t f;
+
+    // MOE cleared at CNT =1 of the next period
+    uint64_t t_moe = (TIM1_ARR + 2 - ADC_TRIG_DELAY) * TICK_NS;
+    _start(0);
+    _trip(HIGH + 1, sim_now() + 10000, t_moe - CONV_NS - SIM_ISR_NS / 2);
+    protect_get_fault(&f);
+
+    uint16_t cnt = (uint16_t)((_t_moe - _t_update) / TICK_NS) % (TIM1_ARR + 1);
+    CHECK(cnt < ADC_TRIG_DELAY);
+    CHECK_EQ(f.latency, cnt + TIM1_ARR + 1 - ADC_TRIG_DELAY);
+    CHECK(f.latency > TIM1_ARR - ADC_TRIG_DELAY - 4);
+}
+
+// Retries after RETRY periods back inside the window, then latched
+// until protect_reset
+static void protect_retry(void)
+{
+    _start(1);
+    _trip(HIGH + 50, sim_now() + 10000, 0);
+    CHECK(protect_tripped());
+
+    // Still over: the wait starts again
+    _sweeps(HIGH + 10, RETRY / (ADC_BUF_LEN / 2));
+    CHECK(protect_tripped());
+
+    // Inside, outputs on after RETRY periods
+    _sweeps(100, RETRY / (ADC_BUF_LEN / 2) - 1);
+    CHECK(protect_tripped());
+    _sweeps(100, 1);
+    CHECK(!protect_tripped());
+    CHECK_EQ(SIM_REG(TIM1->BDTR) & (TIM_MOE | TIM_AOE), TIM_MOE | TIM_AOE);
+    CHECK(SIM_REG(ADC1->CTLR1) & (uint8_t)ADC_IT_AWD);
+
+    // No retry left
+    _trip(HIGH + 50, sim_now() + 10000, 0);
+    _sweeps(100, 10 * RETRY);
+    CHECK(protect_tripped());
+    CHECK_EQ(SIM_REG(TIM1->BDTR) & (TIM_MOE | TIM_AOE), 0);
+    CHECK_EQ(SIM_REG(ADC1->CTLR1) & (uint8_t)ADC_IT_AWD, 0);
+
+    protect_fault_t f;
+    protect_get_fault(&f);
+    CHECK_EQ(f.trips, 2);
+
+    protect_reset();
+    CHECK(!protect_tripped());
+    CHECK_EQ(SIM_REG(TIM1->BDTR) & (TIM_MOE | TIM_AOE), TIM_MOE | TIM_AOE);
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(protect_trip_latency);
+    TEST(protect_trip_wraps);
+    TEST(protect_retry);
+
+    return sim_done();
+}
@@ -0,0 +1,349 @@
+/// \brief Host Tests of the Sine PWM
+/// \details The test models TIM1 itself: an update per PWM period loads
+/// PSC and ATRLR from the registers (both preloaded), the CC3 event just
+/// after it asks DMA1-CH6 for the burst, and the DMAADR writes go to the
+/// registers DMACFGR points at. Each period is logged with the timing and
+/// the CCR1/CCR2 it ran with, the expected duty is computed from the sine.
+/// control.c runs on it as in the firmware, with the ADC and the
+/// protection faked.
+
+#include <math.h>
+#include <string.h>
+
+#include "ch32v00x.h"
+#include "ch32v00x_dma.h"
+#include "adc.h"
+#include "control.h"
+#include "protect.h"
+#include "sim.h"
+#include "spwm.h"
+
+#define PERIODS_PER_CYCLE (SPWM_STEPS * 2)
+#define LOG_CYCLES  8
+
+uint32_t SystemCoreClock = 48000000;
+
+typedef struct
+{
+    uint16_t psc;
+    uint16_t arr;
+    uint16_t ccr1;
+    uint16_t ccr2;
+    uint16_t amp;   // control_amplitude(), of the interrupts before the period
+} period_t;
+
+static period_t _log[PERIODS_PER_CYCLE * LOG_CYCLES];
+static uint32_t _periods;       // Periods started
+static uint8_t  _burst;         // DMAADR writes of this CC3 event
+static uint16_t _psc, _arr;     // Shadow registers of the running period
+static int32_t  _psc_written;   // Period of the last PSC write in a handler, -1 =none
+static uint32_t _cpu_writes;    // CPU writes to the CCRs, the burst or DMA1-CH6 setup
+static uint8_t  _sine[SPWM_STEPS];
+static uint16_t _adc_average;
+static uint32_t _adc_reads, _adc_reads_isr;
+
+//-------------------------------------------------------------
+// adc.c and protect.c as seen by control.c
+//-------------------------------------------------------------
+uint16_t adc_get_average(void)
+{
+    _adc_reads++;
+    if (sim_isr == DMA1_Channel6_IRQn) _adc_reads_isr++;
+    return _adc_average;
+}
+
+uint8_t protect_tripped(void)
+{
+    return 0;
+}
+
+//-------------------------------------------------------------
+// TIM1 model
+//-------------------------------------------------------------
+
+// DMA burst: DMAADR writes go to DBA, DBA +1 ... of the TIM1 registers
+static void _tim1_write(uint32_t addr)
+{
+    if (addr == (uintptr_t)&TIM1->DMAADR)
+    {
+        uint16_t cfg = SIM_REG(TIM1->DMACFGR);
+        uintptr_t reg = (uintptr_t)&TIM1->CTLR1 + ((cfg & 0x1F) + _burst) * 4;
+
+        CHECK(_burst <= (cfg >> 8 & 0x1F));
+        *(volatile uint16_t*)sim_alias(reg) = SIM_REG(TIM1->DMAADR);
+        _burst++;
+    }
+    else if (addr == (uintptr_t)&TIM1->PSC && sim_isr)
+    {
+        _psc_written = _periods - 1;
+    }
+
+    if (addr == (uintptr_t)&TIM1->CH1CVR || addr == (uintptr_t)&TIM1->CH2CVR ||
+        addr == (uintptr_t)&TIM1->DMACFGR || addr == (uintptr_t)&TIM1->DMAINTENR ||
+        (addr >= (uintptr_t)DMA1_Channel6 && addr < (uintptr_t)DMA1_Channel6 + sizeof(*DMA1_Channel6)))
+    {
+        _cpu_writes++;
+    }
+}
+
+static void _tim1_period_end(void);
+
+// Update: the preloaded PSC/ATRLR are used from here, CC3 follows
+// SPWM_DMA_DELAY counts later, the CCRs are not preloaded
+static void _tim1_update(void)
+{
+    _psc = SIM_REG(TIM1->PSC);
+    _arr = SIM_REG(TIM1->ATRLR);
+
+    _burst = 0;
+    if (SIM_REG(TIM1->DMAINTENR) & TIM_DMA_CC3)
+    {
+        sim_dma_request(6);
+        sim_dma_request(6);
+    }
+    CHECK_EQ(_burst, 2);
+
+    if (_periods < sizeof(_log) / sizeof(_log[0]))
+    {
+        period_t* p = &_log[_periods];
+        p->psc  = _psc;
+        p->arr  = _arr;
+        p->ccr1 = SIM_REG(TIM1->CH1CVR);
+        p->ccr2 = SIM_REG(TIM1->CH2CVR);
+        p->amp  = control_amplitude();
+    }
+    _periods++;
+
+    uint64_t clocks = (uint64_t)(_psc + 1) * (_arr + 1);
+    sim_at(sim_now() + clocks * 1000 / 48, _tim1_period_end);
+}
+
+static void _tim1_period_end(void)
+{
+    _tim1_update();
+}
+
+// spwm_init done, TIM_Cmd: the first update now
+static void _tim1_start(void)
+{
+    memset(_log, 0, sizeof(_log));
+    _periods = 0;
+    _psc_written = -1;
+    _cpu_writes = 0;
+    sim_on_write = _tim1_write;
+    sim_at(sim_now(), _tim1_update);
+}
+
+// Let the PWM run until `n` periods are logged
+static void _run_periods(uint32_t n)
+{
+    while (_periods < n) sim_wait_until(sim_now() + 10000);
+}
+
+//-------------------------------------------------------------
+// Expected duty
+//-------------------------------------------------------------
+
+// Periods of a half cycle which do not match the table for arr, amplitude
+static uint32_t _half_errors(uint32_t cycle, uint8_t leg, uint16_t psc, uint16_t arr, uint16_t amplitude)
+{
+    uint32_t peak = ((uint32_t)arr * amplitude) >> 15;
+    uint32_t first = cycle * PERIODS_PER_CYCLE + leg * SPWM_STEPS;
+    uint32_t errors = 0;
+
+    for (uint8_t k = 0; k < SPWM_STEPS; k++)
+    {
+        const period_t* p = &_log[first + k];
+        uint16_t duty = (peak * _sine[k]) >> 8;
+
+        errors += p->psc != psc || p->arr != arr ||
+                  p->ccr1 != (leg ? 0 : duty) || p->ccr2 != (leg ? duty : 0);
+    }
+    return errors;
+}
+
+static uint32_t _cycle_errors(uint32_t cycle, uint16_t psc, uint16_t arr, uint16_t amplitude)
+{
+    return _half_errors(cycle, 0, psc, arr, amplitude) + _half_errors(cycle, 1, psc, arr, amplitude);
+}
+
+// 120Hz: 3225 clocks per period = 13 * 248, 400Hz: 967 = 4 * 241
+#define PSC_120HZ   12
+#define ARR_120HZ   247
+#define PSC_400HZ   3
+#define ARR_400HZ   240
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// Three cycles out of one DMA arm, CH1 leg then CH2 leg, two handler
+// calls per cycle and no CCR write by the CPU
+static void spwm_duty_sequence(void)
+{
+    spwm_init(16384, 120);
+    CHECK_EQ(SIM_REG(TIM1->DMACFGR), TIM_DMABase_CCR1 | TIM_DMABurstLength_2Transfers);
+    _tim1_start();
+    _run_periods(3 * PERIODS_PER_CYCLE);
+
+    for (uint32_t c = 0; c < 3; c++) CHECK_EQ(_cycle_errors(c, PSC_120HZ, ARR_120HZ, 16384), 0);
+    CHECK_EQ(_log[0].ccr1, (123u * _sine[0]) >> 8);
+    CHECK_EQ(_log[29].ccr1, (123u * 255) >> 8);
+    CHECK_EQ(sim_dma_arms[6], 1);
+    CHECK_EQ(sim_irq_count[DMA1_Channel6_IRQn], 6);   // HT and TC of each cycle
+    CHECK_EQ(_psc_written, -1);
+}
+
+// DMA1-CH6 set up once: circular over the whole table, bytes to the
+// 16-bit DMAADR, HT and TC interrupts. 50 cycles later it was armed once,
+// the CPU wrote no CCR and no DMA register, the handler ran at each half
+static void spwm_dma_circular(void)
+{
+    uint32_t cfgr = DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_PeripheralDataSize_HalfWord |
+                    DMA_MemoryDataSize_Byte | DMA_Mode_Circular | DMA_Priority_VeryHigh |
+                    DMA_IT_HT | DMA_IT_TC | DMA_CFGR1_EN;
+
+    spwm_init(20000, 120);
+
+    CHECK_EQ(SIM_REG(DMA1_Channel6->CFGR), cfgr);
+    CHECK_EQ(SIM_REG(DMA1_Channel6->PADDR), (uintptr_t)&TIM1->DMAADR);
+    CHECK_EQ(SIM_REG(DMA1_Channel6->CNTR), SPWM_TABLE_LEN);
+    CHECK_EQ(SIM_REG(TIM1->DMAINTENR) & TIM_DMA_CC3, TIM_DMA_CC3);
+    CHECK_EQ(SIM_REG(TIM1->CH3CVR), SPWM_DMA_DELAY);
+
+    uint32_t arms = sim_dma_arms[6];
+    _tim1_start();
+    _run_periods(50 * PERIODS_PER_CYCLE);
+
+    CHECK_EQ(_cpu_writes, 0);
+    CHECK_EQ(sim_dma_arms[6], arms);
+    CHECK_EQ(sim_irq_count[DMA1_Channel6_IRQn], 2 * 50);
+    CHECK_EQ(_psc_written, -1);
+    CHECK_EQ(SIM_REG(DMA1_Channel6->CNTR), SPWM_TABLE_LEN);    // Reloaded at the wrap
+    for (uint32_t c = 0; c < LOG_CYCLES; c++) CHECK_EQ(_cycle_errors(c, PSC_120HZ, ARR_120HZ, 20000), 0);
+}
+
+// spwm_set before HT gives the next cycle, after HT the one after it,
+// never a cycle of two amplitudes
+static void spwm_set_whole_cycles(void)
+{
+    spwm_init(16384, 120);
+    _tim1_start();
+
+    _run_periods(PERIODS_PER_CYCLE + 10);          // Cycle 1, first half
+    spwm_set(8192, 120);
+    CHECK(spwm_pending());
+
+    _run_periods(3 * PERIODS_PER_CYCLE + 70);      // Cycle 3, second half
+    CHECK(!spwm_pending());
+    spwm_set(32768, 120);
+
+    _run_periods(6 * PERIODS_PER_CYCLE);
+    CHECK(!spwm_pending());
+
+    CHECK_EQ(_cycle_errors(0, PSC_120HZ, ARR_120HZ, 16384), 0);
+    CHECK_EQ(_cycle_errors(1, PSC_120HZ, ARR_120HZ, 16384), 0);
+    CHECK_EQ(_cycle_errors(2, PSC_120HZ, ARR_120HZ, 8192), 0);
+    CHECK_EQ(_cycle_errors(3, PSC_120HZ, ARR_120HZ, 8192), 0);
+    CHECK_EQ(_cycle_errors(4, PSC_120HZ, ARR_120HZ, 8192), 0);
+    CHECK_EQ(_cycle_errors(5, PSC_120HZ, ARR_120HZ, 32768), 0);
+}
+
+// A new frequency: PSC/ATRLR written in the last period of the old cycle,
+// used from the first period of the new one, the table follows ATRLR
+static void spwm_frequency_at_tc(void)
+{
+    spwm_init(16384, 120);
+    _tim1_start();
+
+    _run_periods(PERIODS_PER_CYCLE + 10);
+    spwm_set(16384, 400);
+    _run_periods(4 * PERIODS_PER_CYCLE);
+
+    CHECK_EQ(_psc_written, 2 * PERIODS_PER_CYCLE - 1);
+    CHECK_EQ(_cycle_errors(1, PSC_120HZ, ARR_120HZ, 16384), 0);
+    CHECK_EQ(_cycle_errors(2, PSC_400HZ, ARR_400HZ, 16384), 0);
+    CHECK_EQ(_cycle_errors(3, PSC_400HZ, ARR_400HZ, 16384), 0);
+
+    // Back to 120Hz, a later spwm_set replaces an earlier one
+    spwm_set(8192, 60);
+    spwm_set(8192, 120);
+    _run_periods(7 * PERIODS_PER_CYCLE);
+    CHECK_EQ(_cycle_errors(4, PSC_400HZ, ARR_400HZ, 16384), 0);
+    CHECK_EQ(_cycle_errors(5, PSC_120HZ, ARR_120HZ, 8192), 0);
+    CHECK_EQ(_cycle_errors(6, PSC_120HZ, ARR_120HZ, 8192), 0);
+}
+
+// spwm_set_amplitude from the hook acts on the half being rewritten:
+// set at HT for the CH1 leg, at TC for the CH2 leg
+static uint8_t _hook_calls;
+
+static void _hook_alternate(void)
+{
+    spwm_set_amplitude((_hook_calls++ & 1) ? 24576 : 8192);
+}
+
+static void spwm_hook_halves(void)
+{
+    _hook_calls = 0;
+    spwm_init(16384, 120);
+    spwm_set_hook(_hook_alternate);
+    _tim1_start();
+    _run_periods(4 * PERIODS_PER_CYCLE);
+    spwm_set_hook(0);
+
+    CHECK_EQ(_cycle_errors(0, PSC_120HZ, ARR_120HZ, 16384), 0);
+    for (uint32_t c = 1; c < 4; c++)
+    {
+        CHECK_EQ(_half_errors(c, 0, PSC_120HZ, ARR_120HZ, 8192), 0);
+        CHECK_EQ(_half_errors(c, 1, PSC_120HZ, ARR_120HZ, 24576), 0);
+    }
+}
+
+// The PI loop on the SPWM interrupt: one ADC read and one amplitude per
+// half cycle, in the interrupt. The amplitude set at HT is the CH1 leg of
+// the next cycle, the one set at TC its CH2 leg
+static void spwm_control_halves(void)
+{
+    spwm_init(8192, 120);
+    _adc_average = 300;
+    control_init(450, 8192);        // The reference starts at 300
+    _adc_average = 200;             // e =100: +400 of Q15 per half
+    _adc_reads = _adc_reads_isr = 0;
+    _tim1_start();
+    _run_periods(LOG_CYCLES * PERIODS_PER_CYCLE);
+    control_stop();
+
+    CHECK_EQ(sim_irq_count[DMA1_Channel6_IRQn], 2 * LOG_CYCLES);
+    CHECK_EQ(_adc_reads, 2 * LOG_CYCLES);
+    CHECK_EQ(_adc_reads_isr, _adc_reads);
+    CHECK_EQ(_cycle_errors(0, PSC_120HZ, ARR_120HZ, 8192), 0);
+
+    for (uint32_t c = 1; c < LOG_CYCLES; c++)
+    {
+        const period_t* ht = &_log[(c - 1) * PERIODS_PER_CYCLE + SPWM_STEPS];
+        const period_t* tc = &_log[c * PERIODS_PER_CYCLE];
+
+        CHECK(tc->amp > ht->amp);
+        CHECK(ht->amp > (ht - 1)->amp);
+        CHECK_EQ(_half_errors(c, 0, PSC_120HZ, ARR_120HZ, ht->amp), 0);
+        CHECK_EQ(_half_errors(c, 1, PSC_120HZ, ARR_120HZ, tc->amp), 0);
+    }
+}
+
+int main(void)
+{
+    sim_init();
+
+    // The table of spwm.c, sin(pi *(k +1) /62) *255
+    for (uint8_t k = 0; k < SPWM_STEPS; k++) _sine[k] = lround(sin(M_PI * (k + 1) / SPWM_STEPS) * 255);
+
+    TEST(spwm_duty_sequence);
+    TEST(spwm_dma_circular);
+    TEST(spwm_set_whole_cycles);
+    TEST(spwm_frequency_at_tc);
+    TEST(spwm_hook_halves);
+    TEST(spwm_control_halves);
+
+    return sim_done();
+}
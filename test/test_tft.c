@@ -0,0 +1,1085 @@
+/// \brief Host Tests of the ILI9341 Driver and its SPI-DMA Transfer Engine
+/// \details ili9341.c runs against the register model, the panel model
+/// decodes what went over SPI1.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "font7x10.h"
+#include "ili9341.h"
+#include "panel.h"
+#include "sim.h"
+
+// Panel initialized, logs and counters cleared
+static void _tft_start(void)
+{
+    tft_init();
+    sim_idle();
+    panel_attach();
+    sim_spi_len = 0;
+    memset(sim_dma_arms, 0, sizeof(sim_dma_arms));
+    memset(&tft_stats, 0, sizeof(tft_stats));
+}
+
+// Frames of the log sent while CS was high
+static uint32_t _frames_deselected(void)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sim_spi_len; i++)
+    {
+        n += (sim_spi[i].flags & (SIM_PIN | SIM_CS)) == SIM_CS;
+    }
+    return n;
+}
+
+// Bytes on the wire since the log was cleared, 16-bit frames are two
+static uint32_t _wire_bytes(void)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sim_spi_len; i++)
+    {
+        if (sim_spi[i].flags & SIM_PIN) continue;
+        n += (sim_spi[i].flags & SIM_16BIT) ? 2 : 1;
+    }
+    return n;
+}
+
+// 16-bit frames of the log sent by DMA with the given data
+static uint32_t _dma_words(uint16_t data)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sim_spi_len; i++)
+    {
+        const sim_frame_t* f = &sim_spi[i];
+        n += (f->flags & (SIM_PIN | SIM_16BIT | SIM_DMA)) == (SIM_16BIT | SIM_DMA) && f->data == data;
+    }
+    return n;
+}
+
+//-------------------------------------------------------------
+// Transfer engine
+//-------------------------------------------------------------
+static void init_sequence(void)
+{
+    panel_attach();
+    tft_init();
+    sim_idle();
+
+    CHECK_EQ(panel.commands[ILI9341_SLPOUT], 1);
+    CHECK_EQ(panel.commands[ILI9341_DISPON], 1);
+    CHECK_EQ(panel.commands[ILI9341_GMCTRP1], 1);
+    CHECK_EQ(panel.commands[ILI9341_GMCTRN1], 1);
+    CHECK_EQ(sim_dma_arms[3], 2);   // The two gamma tables
+    CHECK(sim_now() >= (ILI9341_SLPOUT_DELAY + 30) * 1000000ull);
+    CHECK_EQ(panel.deselected, 0);
+}
+
+// Jobs queued behind a running transfer go out in order
+static void jobs_in_order(void)
+{
+    _tft_start();
+
+    sim_dma_hold(3, 1);
+    tft_fill_rect(0, 0, 10, 10, RED);
+    tft_fill_rect(5, 5, 10, 10, BLUE);
+    tft_draw_pixel(7, 7, GREEN);
+
+    CHECK(tft_dma_busy());
+    CHECK_EQ(sim_dma_arms[3], 1);   // Only the first job is on the wire
+    CHECK_EQ(panel.pixels, 100);
+
+    sim_dma_hold(3, 0);
+    sim_idle();
+
+    CHECK(!tft_dma_busy());
+    CHECK_EQ(sim_dma_arms[3], 3);
+    CHECK_EQ(panel.pixels, 201);
+    CHECK_EQ(panel.fb[0][0], RED);
+    CHECK_EQ(panel.fb[4][9], RED);
+    CHECK_EQ(panel.fb[5][5], BLUE);
+    CHECK_EQ(panel.fb[14][14], BLUE);
+    CHECK_EQ(panel.fb[7][7], GREEN);
+}
+
+// More jobs than queue slots: the allocation waits for the interrupt
+static void queue_full_waits(void)
+{
+    static const uint16_t colors[] = {RED, GREEN, BLUE, CYAN, MAGENTA, YELLOW, WHITE, ORANGE};
+
+    _tft_start();
+
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        tft_draw_pixel(100, 50, colors[i]);
+        tft_draw_pixel(101 + i, 50, colors[i]);
+    }
+    tft_dma_wait();
+
+    CHECK_EQ(sim_dma_arms[3], 16);
+    CHECK_EQ(panel.pixels, 16);
+    CHECK_EQ(panel.fb[50][100], ORANGE);
+    for (uint8_t i = 0; i < 8; i++) CHECK_EQ(panel.fb[50][101 + i], colors[i]);
+    CHECK(sim_irq_count[DMA1_Channel3_IRQn] >= 16);
+}
+
+// CS low for every frame, DC low only for command bytes, the bus released
+// when the queue drains. The model itself fails a test when CS/DC or a CPU
+// frame change the bus while DMA1-CH3 sends.
+static void cs_dc_toggling(void)
+{
+    _tft_start();
+
+    tft_fill_rect(0, 0, 320, 240, BLACK);
+    tft_set_cursor(8, 8);
+    tft_print("CS/DC");
+    tft_draw_pixel(300, 200, WHITE);
+    tft_fill_rect(20, 100, 50, 2, RED);
+    tft_dma_wait();
+
+    uint32_t commands = 0, isr_frames = 0;
+    for (uint32_t i = 0; i < sim_spi_len; i++)
+    {
+        const sim_frame_t* f = &sim_spi[i];
+        if (f->flags & SIM_PIN) continue;
+
+        CHECK(!(f->flags & SIM_CS));
+        if (!(f->flags & SIM_DC))
+        {
+            CHECK(!(f->flags & (SIM_16BIT | SIM_DMA)));  // Commands are polled bytes
+            commands++;
+        }
+        isr_frames += (f->flags & SIM_ISR) != 0;
+    }
+
+    CHECK_EQ(_frames_deselected(), 0);
+    CHECK_EQ(panel.deselected, 0);
+    CHECK(commands > 0);
+    CHECK(isr_frames > 0);          // Windows of queued jobs are sent by the interrupt
+    const sim_frame_t* last = &sim_spi[sim_spi_len - 1];
+    CHECK((last->flags & SIM_PIN) && (last->data & SIM_CS));
+    CHECK_EQ(panel.fb[200][300], WHITE);
+    CHECK_EQ(panel.fb[101][69], RED);
+}
+
+//-------------------------------------------------------------
+// Solid fills
+//-------------------------------------------------------------
+
+// 76800 pixels are one full burst of 65535 plus the rest
+static void fill_full_screen(void)
+{
+    _tft_start();
+
+    tft_fill_rect(0, 0, 320, 240, NAVY);
+    tft_dma_wait();
+
+    CHECK_EQ(sim_dma_arms[3], 2);
+    CHECK_EQ(tft_stats.arms, 2);
+    CHECK_EQ(_dma_words(NAVY), 320 * 240);
+    CHECK_EQ(_wire_bytes(), 11 + 320 * 240 * 2);    // CASET, RASET, RAMWR once
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 1);
+    CHECK_EQ(panel.pixels, 320 * 240);
+    CHECK_EQ(panel.fb[0][0], NAVY);
+    CHECK_EQ(panel.fb[239][319], NAVY);
+    CHECK_EQ(panel.outside, 0);
+}
+
+// A fill of many rows is one arm, no re-arm per row
+static void fill_one_arm(void)
+{
+    _tft_start();
+
+    tft_fill_rect(10, 20, 200, 100, RED);
+    tft_dma_wait();
+
+    CHECK_EQ(sim_dma_arms[3], 1);
+    CHECK_EQ(_dma_words(RED), 200 * 100);
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    CHECK_EQ(panel.fb[20][10], RED);
+    CHECK_EQ(panel.fb[119][209], RED);
+    CHECK_EQ(panel.fb[120][209], 0);
+    CHECK_EQ(panel.fb[20][210], 0);
+}
+
+// Around the burst limit: 65520 pixels are one arm, 65600 a full burst
+// and 65 more in the same RAMWR stream; an empty fill sends nothing
+static void fill_edges(void)
+{
+    _tft_start();
+
+    tft_fill_rect(10, 10, 0, 5, RED);
+    tft_fill_rect(10, 10, 5, 0, RED);
+    tft_dma_wait();
+    CHECK_EQ(sim_spi_len, 0);
+    CHECK_EQ(tft_stats.arms, 0);
+
+    tft_fill_rect(319, 239, 1, 1, WHITE);
+    tft_dma_wait();
+    CHECK_EQ(sim_dma_arms[3], 1);
+    CHECK_EQ(_wire_bytes(), 11 + 2);
+    CHECK_EQ(panel.fb[239][319], WHITE);
+
+    _tft_start();
+    tft_fill_rect(0, 0, 273, 240, OLIVE);
+    tft_dma_wait();
+    CHECK_EQ(sim_dma_arms[3], 1);
+    CHECK_EQ(_dma_words(OLIVE), 273 * 240);
+    CHECK_EQ(panel.fb[239][272], OLIVE);
+    CHECK_EQ(panel.fb[239][273], 0);
+
+    _tft_start();
+    tft_fill_rect(0, 0, 320, 205, MAROON);
+    tft_dma_wait();
+    CHECK_EQ(sim_dma_arms[3], 2);
+    CHECK_EQ(_dma_words(MAROON), 320 * 205);
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 1);
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    CHECK_EQ(panel.fb[204][319], MAROON);
+    CHECK_EQ(panel.fb[205][0], 0);
+    CHECK_EQ(panel.outside, 0);
+}
+
+// Two split fills queued behind each other: each remainder job sends
+// its own color word, the second window is sent again
+static void fill_split_queued(void)
+{
+    _tft_start();
+
+    tft_fill_rect(0, 0, 320, 240, RED);
+    tft_fill_rect(0, 20, 320, 220, GREEN);
+    CHECK(tft_dma_busy());          // Queued while the first fill is on the wire
+    tft_dma_wait();
+
+    CHECK_EQ(sim_dma_arms[3], 4);
+    CHECK_EQ(_dma_words(RED), 320 * 240);
+    CHECK_EQ(_dma_words(GREEN), 320 * 220);
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 2);
+    CHECK_EQ(panel.fb[19][319], RED);
+    CHECK_EQ(panel.fb[20][0], GREEN);
+    CHECK_EQ(panel.fb[239][319], GREEN);
+
+    // Portrait: 240x320 is the same split
+    _tft_start();
+    tft_set_rotation(ili9341_portrait);
+    tft_fill_rect(0, 0, 240, 320, BLUE);
+    tft_dma_wait();
+    tft_set_rotation(ili9341_landscape);
+
+    CHECK_EQ(tft_stats.arms, 2);
+    CHECK_EQ(_dma_words(BLUE), 240 * 320);
+    CHECK_EQ(panel.fb[319][239], BLUE);
+    CHECK_EQ(panel.outside, 0);
+}
+
+// Lines and rectangle outlines: one arm per line, counters match the wire
+static void fill_lines(void)
+{
+    _tft_start();
+
+    tft_draw_rect(30, 40, 320 - 60, 100, GREEN);   // 2 horizontal + 2 vertical lines
+    tft_dma_wait();
+
+    CHECK_EQ(sim_dma_arms[3], 4);
+    CHECK_EQ(tft_stats.arms, 4);
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    CHECK_EQ(panel.fb[40][30], GREEN);
+    CHECK_EQ(panel.fb[139][289], GREEN);
+    CHECK_EQ(panel.fb[90][30], GREEN);
+    CHECK_EQ(panel.fb[90][289], GREEN);
+    CHECK_EQ(panel.fb[90][100], 0);
+}
+
+//-------------------------------------------------------------
+// Address window cache
+//-------------------------------------------------------------
+
+// Rows of the same column range below each other are one RAMWR stream
+static void window_rows_continue(void)
+{
+    _tft_start();
+
+    for (uint16_t y = 0; y < 10; y++) tft_fill_rect(10, 50 + y, 40, 1, y + 1);
+    for (uint16_t y = 0; y < 20; y++) tft_draw_pixel(100, 20 + y, WHITE);
+    tft_dma_wait();
+
+    CHECK_EQ(panel.commands[ILI9341_CASET], 2);
+    CHECK_EQ(panel.commands[ILI9341_RASET], 2);
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 2);
+    CHECK_EQ(tft_stats.ramwr_continued, 9 + 19);
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    for (uint16_t y = 0; y < 10; y++)
+    {
+        CHECK_EQ(panel.fb[50 + y][10], y + 1);
+        CHECK_EQ(panel.fb[50 + y][49], y + 1);
+    }
+    for (uint16_t y = 0; y < 20; y++) CHECK_EQ(panel.fb[20 + y][100], WHITE);
+    CHECK_EQ(panel.pixels, 10 * 40 + 20);
+}
+
+// A window down to the bottom row wraps the pointer to its start,
+// drawing the same window again continues the stream
+static void window_wrap_continues(void)
+{
+    _tft_start();
+
+    tft_fill_rect(0, 230, 320, 10, RED);
+    tft_fill_rect(0, 230, 320, 10, GREEN);
+    tft_fill_rect(0, 230, 320, 4, BLUE);
+    tft_dma_wait();
+
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 1);
+    CHECK_EQ(tft_stats.ramwr_continued, 2);
+    CHECK_EQ(panel.fb[230][0], BLUE);
+    CHECK_EQ(panel.fb[233][319], BLUE);
+    CHECK_EQ(panel.fb[234][0], GREEN);
+    CHECK_EQ(panel.fb[239][319], GREEN);
+}
+
+// Any other command ends the stream, the next window sends RAMWR again
+static void window_command_closes(void)
+{
+    _tft_start();
+
+    tft_fill_rect(10, 10, 20, 1, RED);
+    tft_scroll(0);
+    tft_fill_rect(10, 11, 20, 1, RED);
+    tft_dma_wait();
+
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 2);
+    CHECK_EQ(tft_stats.ramwr_continued, 0);
+    CHECK_EQ(panel.fb[11][29], RED);
+}
+
+//-------------------------------------------------------------
+// Pixel batches
+//-------------------------------------------------------------
+
+// The caller's array is left alone, adjacent pixels become one run,
+// off-screen pixels are dropped, batches larger than the scratch work
+static void pixels_batch(void)
+{
+    point_t pts[40], copy[40];
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        pts[i].x = 19 - i;                      // Row 5, x 10..19 backwards
+        pts[i].y = 5;
+    }
+    for (uint16_t i = 10; i < 38; i++)
+    {
+        pts[i].x = 7 * i;                       // Scattered on row 100 + i
+        pts[i].y = 100 + i;
+    }
+    pts[38].x = 320; pts[38].y = 0;             // Off screen
+    pts[39].x = 0;   pts[39].y = 240;
+    memcpy(copy, pts, sizeof(pts));
+
+    _tft_start();
+    tft_draw_pixels(pts, 40, YELLOW);
+    tft_dma_wait();
+
+    CHECK(memcmp(copy, pts, sizeof(pts)) == 0);
+    CHECK_EQ(sim_dma_arms[3], 1 + 28);
+    CHECK_EQ(panel.pixels, 10 + 28);
+    CHECK_EQ(panel.outside, 0);
+    for (uint16_t x = 10; x < 20; x++) CHECK_EQ(panel.fb[5][x], YELLOW);
+    for (uint16_t i = 10; i < 38; i++) CHECK_EQ(panel.fb[100 + i][7 * i], YELLOW);
+}
+
+// Colored pixels: one window per run, one burst per color change,
+// a pixel given twice keeps the last color, also across batches
+static void pixels_color_batch(void)
+{
+    static const pixel_t pixels[] = {
+        {12, 9, RED}, {10, 9, RED}, {11, 9, RED}, {13, 9, BLUE}, {14, 9, BLUE},
+        {0, 0, WHITE}, {1, 0, WHITE}, {3, 0, WHITE}, {5, 5, WHITE}, {6, 6, WHITE},
+        {7, 7, WHITE}, {8, 8, WHITE}, {20, 20, WHITE}, {21, 21, WHITE}, {22, 22, WHITE},
+        {23, 23, WHITE}, {24, 24, WHITE}, {25, 25, WHITE}, {26, 26, WHITE}, {27, 27, WHITE},
+        {28, 28, WHITE}, {29, 29, WHITE}, {30, 30, WHITE}, {12, 9, GREEN}, {0, 0, GREEN},
+    };
+
+    _tft_start();
+    tft_draw_pixels_color(pixels, sizeof(pixels) / sizeof(pixels[0]));
+    tft_dma_wait();
+
+    CHECK_EQ(panel.fb[9][10], RED);
+    CHECK_EQ(panel.fb[9][11], RED);
+    CHECK_EQ(panel.fb[9][12], GREEN);
+    CHECK_EQ(panel.fb[9][13], BLUE);
+    CHECK_EQ(panel.fb[9][14], BLUE);
+    CHECK_EQ(panel.fb[0][0], GREEN);
+    CHECK_EQ(panel.fb[0][1], WHITE);
+    CHECK_EQ(panel.fb[0][2], 0);
+    CHECK_EQ(panel.fb[30][30], WHITE);
+}
+
+//-------------------------------------------------------------
+// Lines and circle outlines, against the per-pixel code they replaced
+//-------------------------------------------------------------
+static uint8_t _ref[240][320];     // Reference pixel set
+static uint32_t _nref;
+
+static void _ref_pixel(int16_t x, int16_t y)
+{
+    if (x < 0 || y < 0 || x >= 320 || y >= 240 || _ref[y][x]) return;
+    _ref[y][x] = 1;
+    _nref++;
+}
+
+// Bresenham of the original driver, one pixel per step
+static void _ref_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+    int16_t t;
+    uint8_t steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep)
+    {
+        t = x0; x0 = y0; y0 = t;
+        t = x1; x1 = y1; y1 = t;
+    }
+    if (x0 > x1)
+    {
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+    int16_t dx = x1 - x0, dy = abs(y1 - y0), err = dx >> 1, step = (y0 < y1) ? 1 : -1;
+    for (; x0 <= x1; x0++)
+    {
+        if (steep) _ref_pixel(y0, x0);
+        else _ref_pixel(x0, y0);
+        err -= dy;
+        if (err < 0)
+        {
+            err += dx;
+            y0 += step;
+        }
+    }
+}
+
+// Midpoint circle of the original driver, 8 pixels per step
+static void _ref_circle(int16_t x0, int16_t y0, int16_t r)
+{
+    int16_t f = 1 - r, ddx = 1, ddy = -2 * r, x = 0, y = r;
+
+    _ref_pixel(x0, y0 + r);
+    _ref_pixel(x0, y0 - r);
+    _ref_pixel(x0 + r, y0);
+    _ref_pixel(x0 - r, y0);
+    while (x < y)
+    {
+        if (f >= 0)
+        {
+            y--;
+            ddy += 2;
+            f += ddy;
+        }
+        x++;
+        ddx += 2;
+        f += ddx;
+        _ref_pixel(x0 + x, y0 + y); _ref_pixel(x0 - x, y0 + y);
+        _ref_pixel(x0 + x, y0 - y); _ref_pixel(x0 - x, y0 - y);
+        _ref_pixel(x0 + y, y0 + x); _ref_pixel(x0 - y, y0 + x);
+        _ref_pixel(x0 + y, y0 - x); _ref_pixel(x0 - y, y0 - x);
+    }
+}
+
+// The shape just drawn in `color` is the reference set, each pixel sent once
+static uint32_t _ref_errors(uint16_t color, uint32_t pixels_before)
+{
+    uint32_t errors = 0;
+
+    tft_dma_wait();
+    for (uint16_t y = 0; y < 240; y++)
+    {
+        for (uint16_t x = 0; x < 320; x++) errors += (panel.fb[y][x] == color) != _ref[y][x];
+    }
+    errors += panel.pixels - pixels_before != _nref;
+    memset(_ref, 0, sizeof(_ref));
+    _nref = 0;
+    return errors;
+}
+
+static uint32_t _seed = 12345;
+
+static int16_t _rand(int16_t n)
+{
+    _seed = _seed * 1103515245 + 12345;
+    return (_seed >> 16) % n;
+}
+
+// Random lines, all octants, and the axis cases: the same pixels as the
+// per-pixel Bresenham, the wire bytes match the counters
+static void lines_match_bresenham(void)
+{
+    static const int16_t fixed[][4] = {{5, 5, 5, 5}, {0, 0, 319, 239}, {319, 0, 0, 239}, {10, 200, 300, 201},
+                                       {100, 0, 101, 239}, {50, 50, 50, 10}, {300, 30, 20, 30}, {0, 239, 319, 238}};
+    uint32_t errors = 0;
+
+    _tft_start();
+    for (uint16_t i = 0; i < 300; i++)
+    {
+        int16_t x0, y0, x1, y1;
+        if (i < sizeof(fixed) / sizeof(fixed[0]))
+        {
+            x0 = fixed[i][0]; y0 = fixed[i][1]; x1 = fixed[i][2]; y1 = fixed[i][3];
+        }
+        else
+        {
+            x0 = _rand(320); y0 = _rand(240); x1 = _rand(320); y1 = _rand(240);
+        }
+        uint32_t before = panel.pixels;
+        tft_draw_line(x0, y0, x1, y1, i + 1);
+        _ref_line(x0, y0, x1, y1);
+        uint32_t e = _ref_errors(i + 1, before);
+        if (e) printf("  line %d,%d - %d,%d: %u errors\n", x0, y0, x1, y1, e);
+        errors += e;
+    }
+    CHECK_EQ(errors, 0);
+    CHECK_EQ(tft_stats.bytes, _wire_bytes());
+    CHECK_EQ(panel.outside, 0);
+}
+
+// Circle outlines, clipped at the edges too: the midpoint pixels once each
+static void circles_match_midpoint(void)
+{
+    uint32_t errors = 0;
+
+    _tft_start();
+    for (uint16_t i = 0; i < 40; i++)
+    {
+        int16_t x0 = _rand(320), y0 = _rand(240), r = (i < 4) ? i : _rand(120);
+        uint32_t before = panel.pixels;
+        tft_draw_circle(x0, y0, r, i + 1);
+        _ref_circle(x0, y0, r);
+        uint32_t e = _ref_errors(i + 1, before);
+        if (e) printf("  circle %d,%d r %d: %u errors\n", x0, y0, r, e);
+        errors += e;
+    }
+    CHECK_EQ(errors, 0);
+    CHECK_EQ(panel.outside, 0);
+}
+
+// A vertical line continued below its end is one RAMWR stream, the
+// window cache does not change the pixels
+static void line_continues_stream(void)
+{
+    _tft_start();
+
+    tft_draw_line(10, 10, 10, 50, RED);
+    tft_draw_line(10, 51, 10, 90, RED);
+    tft_dma_wait();
+
+    CHECK_EQ(tft_stats.ramwr_continued, 1);
+    CHECK_EQ(panel.commands[ILI9341_RAMWR], 1);
+    CHECK_EQ(panel.pixels, 81);
+    CHECK_EQ(panel.fb[10][10], RED);
+    CHECK_EQ(panel.fb[90][10], RED);
+    CHECK_EQ(panel.fb[91][10], 0);
+}
+
+//-------------------------------------------------------------
+// Filled shapes
+//-------------------------------------------------------------
+
+// Pixels of `color` in the frame memory, and their bounding box
+static uint32_t _box(uint16_t color, uint16_t* x0, uint16_t* y0, uint16_t* x1, uint16_t* y1)
+{
+    uint32_t n = 0;
+
+    *x0 = *y0 = 0xFFFF;
+    *x1 = *y1 = 0;
+    for (uint16_t y = 0; y < PANEL_HEIGHT; y++)
+    {
+        for (uint16_t x = 0; x < PANEL_WIDTH; x++)
+        {
+            if (panel.fb[y][x] != color) continue;
+            n++;
+            if (x < *x0) *x0 = x;
+            if (x > *x1) *x1 = x;
+            if (y < *y0) *y0 = y;
+            if (y > *y1) *y1 = y;
+        }
+    }
+    return n;
+}
+
+// Radii at and past half a side: a pill of the full size, the same for
+// every radius past the limit, a 1 pixel side is a line, no overdraw
+static void round_rect_radii(void)
+{
+    static const int16_t radii[] = {0, 10, 24, 25, 49, 50, 1000};
+    static const struct { int16_t w, h; } sizes[] = {{100, 50}, {50, 100}, {51, 51}, {100, 1}, {1, 40}};
+    uint16_t x0, y0, x1, y1;
+    uint32_t pill = 0;
+
+    for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        for (uint8_t i = 0; i < sizeof(radii) / sizeof(radii[0]); i++)
+        {
+            int16_t w = sizes[s].w, h = sizes[s].h, r = radii[i];
+
+            _tft_start();
+            tft_fill_round_rect(20, 30, w, h, r, YELLOW);
+            tft_dma_wait();
+
+            uint32_t n = _box(YELLOW, &x0, &y0, &x1, &y1);
+            CHECK(n > 0);
+            CHECK_EQ(panel.pixels, n);              // Each pixel once
+            CHECK_EQ(x0, 20);
+            CHECK_EQ(y0, 30);
+            CHECK_EQ(x1, 20 + w - 1);
+            CHECK_EQ(y1, 30 + h - 1);
+            if (r == 0) CHECK_EQ(n, (uint32_t)w * h);
+            if (w > 2 && h > 2 && r > 1) CHECK_EQ(panel.fb[30][20], 0);    // Corner cut
+
+            // 100x50 from r =24 on: the same pill
+            if (s == 0 && r == 24) pill = n;
+            if (s == 0 && r > 24) CHECK_EQ(n, pill);
+        }
+    }
+    CHECK(pill > 100 * 50 * 3 / 4);
+}
+
+//-------------------------------------------------------------
+// Sprites
+//-------------------------------------------------------------
+
+// Pixels in the area that are not the sprite where it is and the
+// background elsewhere
+static uint32_t _sprite_errors(const tft_sprite_t* s)
+{
+    uint32_t n = 0;
+
+    for (int16_t y = 0; y < 240; y++)
+    {
+        for (int16_t x = 0; x < 320; x++)
+        {
+            uint8_t in = x >= s->x && x < s->x + s->width && y >= s->y && y < s->y + s->height;
+            n += panel.fb[y][x] != ((in && s->visible) ? s->color : s->bg);
+        }
+    }
+    return n;
+}
+
+// Overlapping moves send the covered and the uncovered strips only,
+// 2 (|dy| w + |dx| (h - |dy|)) pixels, far moves erase and redraw
+static void sprite_move_damage(void)
+{
+    static const struct { int16_t dx, dy; } moves[] =
+    {
+        {2, 2}, {-3, 1}, {0, -5}, {5, 0}, {-2, -2}, {39, 0}, {0, 19}, {-39, -19}, {1, -1},
+        {40, 0}, {-100, 50}, {0, 0},
+    };
+    tft_sprite_t s = {100, 100, 40, 20, RED, NAVY, 0};
+
+    _tft_start();
+    tft_fill_rect(0, 0, 320, 240, NAVY);
+    tft_sprite_show(&s);
+    tft_dma_wait();
+    CHECK_EQ(_sprite_errors(&s), 0);
+
+    for (uint8_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++)
+    {
+        int16_t dx = abs(moves[i].dx), dy = abs(moves[i].dy);
+        uint32_t pixels = panel.pixels;
+
+        tft_sprite_move(&s, s.x + moves[i].dx, s.y + moves[i].dy);
+        tft_dma_wait();
+
+        pixels = panel.pixels - pixels;
+        if (i == 0) CHECK_EQ(pixels, 232);    // 40x20 by (2, 2), as documented
+        if (dx < s.width && dy < s.height) CHECK_EQ(pixels, 2u * (dy * s.width + dx * (s.height - dy)));
+        else CHECK_EQ(pixels, 2u * s.width * s.height);
+        CHECK_EQ(_sprite_errors(&s), 0);
+    }
+
+    tft_sprite_hide(&s);
+    tft_dma_wait();
+    CHECK_EQ(_sprite_errors(&s), 0);
+
+    // Moving a hidden sprite shows it
+    uint32_t pixels = panel.pixels;
+    tft_sprite_move(&s, 10, 10);
+    tft_dma_wait();
+    CHECK_EQ(panel.pixels - pixels, 40 * 20);
+    CHECK_EQ(_sprite_errors(&s), 0);
+    CHECK_EQ(panel.outside, 0);
+}
+
+//-------------------------------------------------------------
+// Hardware scrolling
+//-------------------------------------------------------------
+
+// Landscape: screen column x is panel line 319 - x, memory line m is
+// the frame memory column 319 - m
+static uint16_t _shown(int16_t x, int16_t y)
+{
+    return panel.fb[y][319 - panel_line(319 - x)];
+}
+
+#define CHART_SAMPLES 300
+
+static uint16_t _sample(uint16_t i)
+{
+    return (i * 37 + (i >> 4) * 11) & 0xFF;
+}
+
+static int16_t _sample_row(uint16_t i)
+{
+    return 239 - (int16_t)((_sample(i) * 240) >> 8);
+}
+
+// Expected column of sample i: the vertical run from the previous
+// sample row, the grid lines and the background
+static uint16_t _chart_pixel(const tft_chart_t* c, uint16_t i, int16_t row)
+{
+    int16_t lo = _sample_row(i), hi = lo;
+
+    if (i)
+    {
+        if (_sample_row(i - 1) < lo) lo = _sample_row(i - 1);
+        if (_sample_row(i - 1) > hi) hi = _sample_row(i - 1);
+    }
+    if (row >= lo && row <= hi) return c->color;
+    return (row & c->grid_mask) ? c->bg : c->grid;
+}
+
+// Each sample is one 240 pixel column and one VSCRSADD, the start line
+// walks down the scrolling area and wraps: the newest sample is the
+// right end of the area, older ones follow to the left, the fixed
+// columns are never sent
+static void chart_push_scrolls(void)
+{
+    tft_chart_t c = {.left = 20, .right = 10, .color = YELLOW, .bg = BLACK, .grid = DARKGREY,
+                     .grid_mask = 15, .bits = 8};
+    uint16_t line = c.right;
+
+    _tft_start();
+    tft_fill_rect(0, 0, 320, 240, WHITE);
+    tft_chart_init(&c);
+    tft_dma_wait();
+
+    CHECK_EQ(panel.tfa, 10);
+    CHECK_EQ(panel.vsa, 290);
+    CHECK_EQ(panel.bfa, 20);
+    CHECK_EQ(panel.vsp, 10);
+    CHECK_EQ(_shown(20, 0), DARKGREY);
+    CHECK_EQ(_shown(309, 1), BLACK);
+
+    for (uint16_t i = 0; i < CHART_SAMPLES; i++)
+    {
+        uint32_t pixels = panel.pixels, caset = panel.commands[ILI9341_CASET];
+        uint32_t vscrsadd = panel.commands[ILI9341_VSCRSADD];
+
+        tft_chart_push(&c, _sample(i));
+        tft_dma_wait();
+
+        line = (line == 10) ? 299 : line - 1;
+        CHECK_EQ(panel.vsp, line);
+        CHECK_EQ(panel.pixels - pixels, 240);
+        CHECK_EQ(panel.commands[ILI9341_CASET] - caset, 1);
+        CHECK_EQ(panel.commands[ILI9341_VSCRSADD] - vscrsadd, 1);
+        CHECK_EQ(_shown(309, _sample_row(i)), YELLOW);
+    }
+
+    // Once round and 10 more: the area shows the last 290 samples
+    uint32_t errors = 0;
+    for (uint16_t k = 0; k < 290; k++)
+    {
+        for (int16_t y = 0; y < 240; y++)
+        {
+            errors += _shown(309 - k, y) != _chart_pixel(&c, CHART_SAMPLES - 1 - k, y);
+        }
+    }
+    CHECK_EQ(errors, 0);
+
+    for (int16_t y = 0; y < 240; y++)
+    {
+        for (int16_t x = 0; x < 20; x++) CHECK_EQ(_shown(x, y), WHITE);
+        for (int16_t x = 310; x < 320; x++) CHECK_EQ(_shown(x, y), WHITE);
+    }
+    CHECK_EQ(panel.outside, 0);
+
+    tft_scroll_reset();
+    CHECK_EQ(panel.vsa, 320);
+    CHECK_EQ(panel.vsp, 0);
+}
+
+//-------------------------------------------------------------
+// Text
+//-------------------------------------------------------------
+
+#define CON_COLS 30     // 240 / 8 pixel cells
+#define CON_ROWS 32     // 320 / 10 lines
+
+static uint16_t _con_ref[320][240];
+
+// 40 lines, the 21st wraps once: 41 text rows. The first rows are the
+// longest, the rows recycling them must clear their tail. Returns the
+// text length
+static uint16_t _console_text(char* text, char rows[][CON_COLS + 1], uint16_t* nrows)
+{
+    uint16_t len = 0, n = 0;
+
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        char line[64];
+        uint8_t k = sprintf(line, "line %02u", i);
+        if (i < 10) k += sprintf(line + k, " %s", "scrolled out");
+        if (i == 20) k += sprintf(line + k, " %s", "wraps past the right edge of the row");
+
+        for (uint8_t j = 0; j < k; j += CON_COLS)
+        {
+            snprintf(rows[n++], CON_COLS + 1, "%s", line + j);
+        }
+        memcpy(text + len, line, k);
+        len += k;
+        if (i < 39) text[len++] = '\n';
+    }
+    *nrows = n;
+    return len;
+}
+
+// Past the last row each new row recycles the oldest: one row fill and
+// one VSCRSADD, the panel shows the newest 32 rows from the top down,
+// the wrapped line continues on the next row
+static void console_scroll_wrap(void)
+{
+    static char rows[48][CON_COLS + 1];
+    static char text[2048];
+    uint16_t nrows;
+    uint16_t len = _console_text(text, rows, &nrows);
+    CHECK_EQ(nrows, 41);
+
+    // Reference: the last 32 rows printed unscrolled
+    _tft_start();
+    tft_set_rotation(ili9341_portrait);
+    tft_set_color(GREEN);
+    tft_set_background_color(BLACK);
+    tft_fill_rect(0, 0, 240, 320, BLACK);
+    for (uint8_t r = 0; r < CON_ROWS; r++)
+    {
+        tft_set_cursor(0, r * 10);
+        tft_print(rows[nrows - CON_ROWS + r]);
+    }
+    tft_dma_wait();
+    for (uint16_t y = 0; y < 320; y++) memcpy(_con_ref[y], panel.fb[y], sizeof(_con_ref[y]));
+
+    _tft_start();
+    tft_set_color(GREEN);
+    tft_set_background_color(BLACK);
+    tft_console_init();
+    for (uint16_t i = 0; i < len; i += 7) tft_console_write(&text[i], (len - i < 7) ? len - i : 7);
+    tft_dma_wait();
+
+    CHECK_EQ(panel.tfa, 0);
+    CHECK_EQ(panel.vsa, 320);
+    CHECK_EQ(panel.vsp, (nrows - CON_ROWS) * 10);
+    CHECK_EQ(panel.commands[ILI9341_VSCRSADD], 1 + nrows - CON_ROWS);
+    CHECK_EQ(panel.outside, 0);
+
+    uint32_t errors = 0;
+    for (uint16_t y = 0; y < 320; y++)
+    {
+        for (uint16_t x = 0; x < 240; x++) errors += panel.fb[panel_line(y)][x] != _con_ref[y][x];
+    }
+    CHECK_EQ(errors, 0);
+
+    tft_set_rotation(ili9341_landscape);
+    tft_scroll_reset();
+}
+
+
+// A line cut by the bottom edge keeps its upper rows, nothing below
+// the screen reaches the frame memory, a line below the edge sends nothing
+static void text_clip_bottom(void)
+{
+    _tft_start();
+
+    tft_set_color(WHITE);
+    tft_set_background_color(BLUE);
+    tft_set_cursor(0, 240 - 4);
+    tft_print("clip");
+    tft_dma_wait();
+
+    CHECK_EQ(panel.pixels, 4 * 8 * 4);    // 4 cells of 8 columns, 4 rows
+    CHECK_EQ(panel.ye, 239);
+    CHECK_EQ(panel.fb[236][7], BLUE);      // Gap column
+    for (uint16_t y = 240; y < PANEL_HEIGHT; y++)
+    {
+        for (uint16_t x = 0; x < PANEL_WIDTH; x++) CHECK_EQ(panel.fb[y][x], 0);
+    }
+
+    sim_spi_len = 0;
+    tft_set_cursor(0, 240);
+    tft_print("gone");
+    tft_dma_wait();
+    CHECK_EQ(sim_spi_len, 0);
+}
+
+// A text half last used 32800 jobs ago: its ticket wrapped past
+// _job_done, the next string must not wait for it
+static void text_stale_ticket(void)
+{
+    _tft_start();
+
+    tft_set_color(WHITE);
+    tft_set_background_color(BLUE);
+    tft_set_cursor(0, 0);
+    tft_print("A");
+    for (uint32_t n = 0; n < 32800; n++) tft_draw_pixel(n % 320, 100 + n / 320, RED);
+    tft_set_cursor(0, 20);
+    tft_print("B");
+    tft_dma_wait();
+
+    CHECK_EQ(panel.fb[20][7], BLUE);        // Gap column of "B"
+    CHECK_EQ(panel.fb[100][0], RED);
+    CHECK_EQ(panel.fb[202][159], RED);    // The last pixel
+}
+
+// Pixels of `str` at x, y which differ from font7x10, gap column included
+static uint32_t _text_errors(uint16_t x, uint16_t y, const char* str, uint16_t fg, uint16_t bg)
+{
+    uint32_t n = 0;
+
+    for (uint16_t c = 0; str[c]; c++)
+    {
+        for (uint8_t i = 0; i < 10; i++)
+        {
+            uint8_t row = font7x10[(str[c] - 32) * 10 + i] << 1;
+            for (uint8_t b = 0; b < 8; b++) n += panel.fb[y + i][x + c * 8 + b] != ((row & (0x80 >> b)) ? fg : bg);
+        }
+    }
+    return n;
+}
+
+// 70000 jobs of text: the job tickets wrap at 65536 while a buffer half
+// is on the wire, its next user still waits for it
+static void text_ticket_wrap(void)
+{
+    char str[31];
+    uint32_t prints = 0, errors = 0;
+
+    _tft_start();
+    tft_set_color(YELLOW);
+    tft_set_background_color(NAVY);
+
+    // 30 characters: 4 chunks per glyph row, 40 jobs a string
+    while (tft_stats.arms < 70000)
+    {
+        for (uint8_t c = 0; c < 30; c++) str[c] = 33 + (prints * 7 + c * 13) % 94;
+        str[30] = 0;
+        sim_spi_len = 0;
+        tft_set_cursor(0, (prints % 24) * 10);
+        tft_print(str);
+        tft_dma_wait();
+        errors += _text_errors(0, (prints % 24) * 10, str, YELLOW, NAVY);
+        prints++;
+    }
+    CHECK_EQ(errors, 0);
+    CHECK_EQ(tft_stats.arms, prints * 40);
+}
+
+// Readout cells that differ from the string printed in full below it
+static uint32_t _field_errors(const tft_field_t* f, const char* str)
+{
+    uint32_t n = 0;
+
+    tft_fill_rect(f->x, f->y + 100, 8 * 8, 10, f->bg);
+    tft_set_cursor(f->x, f->y + 100);
+    tft_print(str);
+    tft_dma_wait();
+
+    for (uint16_t y = 0; y < 10; y++)
+    {
+        for (uint16_t x = f->x; x < f->x + 8 * 8; x++) n += panel.fb[f->y + y][x] != panel.fb[f->y + 100 + y][x];
+    }
+    return n;
+}
+
+// Only the runs of changed characters are sent, one window each; a
+// value wider or narrower than the field redraws it and clears the tail
+static void field_partial_redraw(void)
+{
+    static const struct { uint32_t value; const char* str; uint8_t cells, runs; } steps[] =
+    {
+        {12345,   "123.45",   6, 1},    // First update, in full
+        {12346,   "123.46",   1, 1},
+        {12399,   "123.99",   2, 1},
+        {13346,   "133.46",   3, 2},
+        {13346,   "133.46",   0, 0},
+        {1234567, "12345.67", 8, 1},    // Wider than the field
+        {5,       "  0.05",   8, 2},    // Narrower: clear 2 cells, then all
+    };
+    tft_field_t f = {.x = 10, .y = 50, .width = 6, .decimals = 2, .color = WHITE, .bg = BLUE};
+
+    _tft_start();
+    tft_fill_rect(0, 0, 320, 240, BLUE);
+    tft_set_color(WHITE);
+    tft_set_background_color(BLUE);
+    tft_dma_wait();
+
+    for (uint8_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        uint32_t pixels = panel.pixels, ramwr = panel.commands[ILI9341_RAMWR];
+
+        tft_field_set(&f, steps[i].value);
+        tft_dma_wait();
+
+        CHECK_EQ(panel.pixels - pixels, steps[i].cells * 8 * 10);
+        CHECK_EQ(panel.commands[ILI9341_RAMWR] - ramwr, steps[i].runs);
+        CHECK_EQ(f.len, strlen(steps[i].str));
+        CHECK_EQ(_field_errors(&f, steps[i].str), 0);
+    }
+
+    // After the screen was cleared
+    tft_field_invalidate(&f);
+    uint32_t pixels = panel.pixels;
+    tft_field_set(&f, 5);
+    tft_dma_wait();
+    CHECK_EQ(panel.pixels - pixels, 6 * 8 * 10);
+
+    // Integer readout, right aligned with spaces
+    tft_field_t g = {.x = 200, .y = 20, .width = 4, .color = WHITE, .bg = BLUE};
+    tft_field_set(&g, 999);
+    tft_field_set(&g, 1000);
+    tft_dma_wait();
+    CHECK_EQ(_field_errors(&g, "1000"), 0);
+    pixels = panel.pixels;
+    tft_field_set(&g, 1001);
+    tft_dma_wait();
+    CHECK_EQ(panel.pixels - pixels, 8 * 10);
+    CHECK_EQ(_field_errors(&g, "1001"), 0);
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(init_sequence);
+    TEST(jobs_in_order);
+    TEST(queue_full_waits);
+    TEST(cs_dc_toggling);
+    TEST(fill_full_screen);
+    TEST(fill_one_arm);
+    TEST(fill_edges);
+    TEST(fill_split_queued);
+    TEST(fill_lines);
+    TEST(window_rows_continue);
+    TEST(window_wrap_continues);
+    TEST(window_command_closes);
+    TEST(pixels_batch);
+    TEST(pixels_color_batch);
+    TEST(lines_match_bresenham);
+    TEST(circles_match_midpoint);
+    TEST(line_continues_stream);
+    TEST(round_rect_radii);
+    TEST(sprite_move_damage);
+    TEST(chart_push_scrolls);
+    TEST(text_clip_bottom);
+    TEST(text_stale_ticket);
+    TEST(text_ticket_wrap);
+    TEST(console_scroll_wrap);
+    TEST(field_partial_redraw);
+
+    return sim_done();
+}
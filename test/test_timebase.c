@@ -0,0 +1,339 @@
+/// \brief Host Tests of the Timebase, the Timer Wheel and the Scheduler
+/// \details The test models TIM2: CNT counts model microseconds, the
+/// compare with CH1CVR sets CC1IF, the wrap sets UIF, and INTFR clears
+/// by writing 0 (rc_w0). Time only moves by _tim2_to(), the interrupt
+/// runs at once unless the test masked interrupts.
+///
+/// timebase.c is compiled into this file so a test can start now_ms()
+/// just before the 32-bit wrap instead of running 49 days.
+
+#include "../User/timebase.c"
+
+#include <string.h>
+
+#include "../User/sched.h"
+#include "sim.h"
+
+uint32_t SystemCoreClock = 48000000;
+
+static uint64_t _us;            // Model time since timebase_init, us
+static uint16_t _intfr;         // TIM2 flags
+
+//-------------------------------------------------------------
+// TIM2 model
+//-------------------------------------------------------------
+static void _tim2_write(uint32_t addr)
+{
+    if (addr == (uintptr_t)&TIM2->INTFR)
+    {
+        _intfr &= SIM_REG(TIM2->INTFR);
+        SIM_REG(TIM2->INTFR) = _intfr;
+    }
+}
+
+// Count up to `us`, stopping at each compare and wrap
+static void _tim2_to(uint64_t us)
+{
+    while (_us < us)
+    {
+        uint16_t cnt = _us;
+        uint32_t to_ccr = (uint16_t)(SIM_REG(TIM2->CH1CVR) - cnt);
+        uint32_t to_wrap = 0x10000 - cnt;
+        uint64_t step = us - _us;
+
+        if (to_ccr == 0) to_ccr = 0x10000;
+        if (to_ccr < step) step = to_ccr;
+        if (to_wrap < step) step = to_wrap;
+
+        _us += step;
+        SIM_REG(TIM2->CNT) = _us;
+
+        uint16_t flags = 0;
+        if (step == to_ccr) flags |= TIM_CC1IF;
+        if (step == to_wrap) flags |= TIM_UIF;
+        if (!flags) continue;
+
+        _intfr |= flags;
+        SIM_REG(TIM2->INTFR) = _intfr;
+        if (SIM_REG(TIM2->DMAINTENR) & flags) sim_irq_raise(TIM2_IRQn);
+    }
+}
+
+// TIM2 started, now_ms() from `ms`
+static void _start(uint32_t ms)
+{
+    _us = 0;
+    _intfr = 0;
+    memset(_tb_wheel, 0, sizeof(_tb_wheel));
+    timebase_init();
+    sim_on_write = _tim2_write;
+    _tb_ms = ms;
+}
+
+//-------------------------------------------------------------
+// Timer callbacks, each call logged with now_ms()
+//-------------------------------------------------------------
+#define LOG_LEN 64
+
+typedef struct
+{
+    uint32_t ms;
+    void*    arg;
+} call_t;
+
+static call_t   _calls[LOG_LEN];
+static uint32_t _ncalls;
+
+static void _log(void* arg)
+{
+    if (_ncalls < LOG_LEN) _calls[_ncalls] = (call_t){now_ms(), arg};
+    _ncalls++;
+}
+
+// Calls of `arg` at `ms`, in the log
+static uint32_t _called(void* arg, uint32_t ms)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < _ncalls && i < LOG_LEN; i++) n += _calls[i].arg == arg && _calls[i].ms == ms;
+    return n;
+}
+
+static uint32_t _calls_of(void* arg)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < _ncalls && i < LOG_LEN; i++) n += _calls[i].arg == arg;
+    return n;
+}
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// now_us() across three TIM2 wraps, now_ms() from the compare
+static void tb_overflow(void)
+{
+    static const uint32_t at[] = {1, 999, 1000, 0xFFFF, 0x10000, 0x10001, 0x1FFFF,
+                                  0x20000, 0x2FFFF, 0x30000, 0x30000 + 12345};
+    _start(0);
+
+    for (uint8_t i = 0; i < sizeof(at) / sizeof(at[0]); i++)
+    {
+        _tim2_to(at[i]);
+        CHECK_EQ(now_us(), at[i]);
+        CHECK_EQ(now_ms(), at[i] / 1000);
+    }
+    CHECK_EQ(sim_irq_count[TIM2_IRQn], 0x30000 / 1000 + 12 + 3);
+    CHECK_EQ(_intfr, 0);
+}
+
+// Interrupts masked over the wrap: UIF is pending, _tb_high is old,
+// a low CNT is after the wrap
+static void tb_pending_overflow(void)
+{
+    _start(0);
+    _tim2_to(0x1FF00);
+
+    __disable_irq();
+    _tim2_to(0x1FFFF);
+    CHECK_EQ(now_us(), 0x1FFFF);
+    _tim2_to(0x20000);
+    CHECK(_intfr & TIM_UIF);
+    CHECK_EQ(now_us(), 0x20000);
+    _tim2_to(0x20000 + 700);
+    CHECK_EQ(now_us(), 0x20000 + 700);
+    __enable_irq();
+
+    CHECK_EQ(_intfr, 0);
+    CHECK_EQ(now_us(), 0x20000 + 700);
+    CHECK_EQ(now_ms(), (0x20000 + 700) / 1000);
+}
+
+// A tick held off for 3.5ms is caught up by the next interrupt
+static void tb_catch_up(void)
+{
+    _start(0);
+    _tim2_to(10500);
+
+    __disable_irq();
+    _tim2_to(14000);
+    CHECK_EQ(now_ms(), 10);
+    __enable_irq();
+    CHECK_EQ(now_ms(), 14);
+
+    _tim2_to(15000);
+    CHECK_EQ(now_ms(), 15);
+}
+
+// now_ms() wraps from 0xFFFFFFFF to 0: timers started before the wrap
+// and due after it are called on time
+static void tb_ms_wrap(void)
+{
+    static tb_timer_t once, every7;
+    _ncalls = 0;
+
+    _start(0xFFFFFFF0);
+    timer_start(&once, 20, 0, _log, &once);
+    timer_start(&every7, 7, 7, _log, &every7);
+    _tim2_to(40000);
+
+    CHECK_EQ(now_ms(), 0xFFFFFFF0 + 40);
+    CHECK_EQ(_calls_of(&once), 1);
+    CHECK_EQ(_called(&once, 0xFFFFFFF0 + 20), 1);
+    CHECK_EQ(_calls_of(&every7), 5);
+    for (uint32_t k = 1; k <= 5; k++) CHECK_EQ(_called(&every7, 0xFFFFFFF0 + 7 * k), 1);
+    CHECK(!once.active);
+    CHECK(every7.active);
+    timer_stop(&every7);
+}
+
+// Re-armed into the slot being walked: a period of TIMER_WHEEL_SLOTS,
+// a callback restarting itself a round later, one starting a timer due
+// at the next tick and one stopping a timer due in this tick
+static tb_timer_t _periodic, _self, _stopper, _stopped, _started;
+
+static void _restart_self(void* arg)
+{
+    _log(arg);
+    timer_start(&_self, TIMER_WHEEL_SLOTS, 0, _restart_self, arg);
+}
+
+static void _stop_other(void* arg)
+{
+    _log(arg);
+    timer_stop(&_stopped);
+    timer_start(&_started, 0, 0, _log, &_started);   // At least 1ms
+}
+
+static void tb_rearm_current_slot(void)
+{
+    _ncalls = 0;
+    _start(0);
+
+    timer_start(&_periodic, 8, TIMER_WHEEL_SLOTS, _log, &_periodic);
+    timer_start(&_self, 8, 0, _restart_self, &_self);
+    timer_start(&_stopped, 8, 0, _log, &_stopped);       // Stopped by _stopper in the same tick
+    timer_start(&_stopper, 8, 0, _stop_other, &_stopper);
+    _tim2_to(8000);
+
+    CHECK_EQ(_calls_of(&_periodic), 1);
+    CHECK_EQ(_calls_of(&_self), 1);
+    CHECK_EQ(_calls_of(&_stopper), 1);
+    CHECK_EQ(_calls_of(&_stopped), 0);
+    CHECK(!_stopped.active);
+
+    _tim2_to(9000);
+    CHECK_EQ(_called(&_started, 9), 1);
+
+    _tim2_to(40000);
+    for (uint32_t ms = 8; ms <= 40; ms += TIMER_WHEEL_SLOTS)
+    {
+        CHECK_EQ(_called(&_periodic, ms), 1);
+        CHECK_EQ(_called(&_self, ms), 1);
+    }
+    CHECK_EQ(_calls_of(&_periodic), 5);
+    CHECK_EQ(_calls_of(&_self), 5);
+    CHECK_EQ(_calls_of(&_stopper), 1);
+    CHECK_EQ(_calls_of(&_started), 1);
+
+    timer_stop(&_periodic);
+    timer_stop(&_self);
+    _tim2_to(60000);
+    CHECK_EQ(_calls_of(&_periodic), 5);
+    CHECK_EQ(_calls_of(&_self), 5);
+}
+
+// 16 one-shots in one slot over 4 rounds, started out of order, next
+// to a periodic timer of the same slot: each is called once in its own
+// round; a restarted timer moves, a stopped one is not called
+static void tb_many_in_slot(void)
+{
+    static tb_timer_t shots[16], every8, moved, gone;
+    _ncalls = 0;
+    _start(0);
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        uint8_t k = (i * 7) % 16;                   // Out of order
+        timer_start(&shots[k], 3 + TIMER_WHEEL_SLOTS * (k % 4), 0, _log, &shots[k]);
+    }
+    timer_start(&every8, 3, TIMER_WHEEL_SLOTS, _log, &every8);
+    timer_start(&moved, 3, 0, _log, &moved);
+    timer_start(&gone, 11, 0, _log, &gone);
+    timer_start(&moved, 14, 0, _log, &moved);       // Restarted before it was due
+    timer_stop(&gone);
+    timer_stop(&gone);                              // Not running: nothing
+
+    _tim2_to(40000);
+
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        CHECK_EQ(_calls_of(&shots[k]), 1);
+        CHECK_EQ(_called(&shots[k], 3 + TIMER_WHEEL_SLOTS * (k % 4)), 1);
+        CHECK(!shots[k].active);
+    }
+    for (uint32_t ms = 3; ms <= 40; ms += TIMER_WHEEL_SLOTS) CHECK_EQ(_called(&every8, ms), 1);
+    CHECK_EQ(_calls_of(&every8), 5);
+    CHECK_EQ(_calls_of(&moved), 1);
+    CHECK_EQ(_called(&moved, 14), 1);
+    CHECK_EQ(_calls_of(&gone), 0);
+    CHECK_EQ(_ncalls, 16 + 5 + 1);
+    timer_stop(&every8);
+}
+
+// A task posting itself while it runs: the run is timed from the
+// release it ran for, the new post keeps its own release
+static uint8_t _reposts;
+static void _repost_run(void);
+static const task_t _repost = {"repost", _repost_run, 0, 5, 0};
+
+static void _repost_run(void)
+{
+    _tim2_to(_us + 3000);
+    if (_reposts)
+    {
+        _reposts--;
+        sched_post(&_repost);
+    }
+    _tim2_to(_us + 3000);
+}
+
+static void sched_repost_response(void)
+{
+    _start(0);
+    CHECK(sched_add(&_repost));
+
+    _tim2_to(1000);
+    _reposts = 1;
+    sched_post(&_repost);
+    _tim2_to(3000);
+    CHECK(sched_run());
+
+    // Released at 1ms, done at 9ms; the post at 6ms is ready
+    const task_stats_t* st = sched_stats(0);
+    CHECK_EQ(st->runs, 1);
+    CHECK_EQ(st->wcet_us, 6000);
+    CHECK_EQ(st->response_ms, 8);
+    CHECK_EQ(st->misses, 1);
+
+    // Released at 6ms, done at 15ms
+    CHECK(sched_run());
+    CHECK_EQ(st->runs, 2);
+    CHECK_EQ(st->response_ms, 9);
+    CHECK_EQ(st->misses, 2);
+    CHECK(!sched_run());
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(tb_overflow);
+    TEST(tb_pending_overflow);
+    TEST(tb_catch_up);
+    TEST(tb_ms_wrap);
+    TEST(tb_rearm_current_slot);
+    TEST(tb_many_in_slot);
+    TEST(sched_repost_response);
+
+    return sim_done();
+}
@@ -0,0 +1,162 @@
+/// \brief Host Tests of the USART1 TX Ring
+/// \details uart.c runs against the register model: DMA1-CH4 sends each
+/// chunk at 115200 and its TC interrupt takes the next one from the ring.
+/// sim_dma_hold() keeps the first chunk on the line while the ring fills.
+
+#include <string.h>
+
+#include "sim.h"
+#include "uart.h"
+
+#define TEXT_LEN 1024
+
+static char _text[TEXT_LEN];
+static uart_tx_stats_t _was;
+
+// USART1 TX running with `policy`, the text to send
+static void _start(uint8_t policy)
+{
+    for (uint16_t i = 0; i < TEXT_LEN; i++) _text[i] = ' ' + (i * 7 + i / 95) % 95;
+    uart_init();
+    uart_tx_policy(policy);
+    uart_tx_stats(&_was);
+}
+
+// Statistics since _start()
+static uart_tx_stats_t _stats(void)
+{
+    uart_tx_stats_t s;
+
+    uart_tx_stats(&s);
+    s.queued -= _was.queued;
+    s.dropped -= _was.dropped;
+    s.overwritten -= _was.overwritten;
+    return s;
+}
+
+//-------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------
+
+// Ring full, drop: a chunk on the line and the ring are kept, the rest
+// of the write is lost and counted
+static void tx_drop_full(void)
+{
+    _start(UART_TX_DROP);
+    sim_dma_hold(4, 1);
+
+    CHECK_EQ(uart_write(_text, 100), UART_TX_CHUNK + UART_TX_SIZE);
+    CHECK_EQ(uart_write(_text, 5), 0);
+    CHECK_EQ(_stats().queued, UART_TX_CHUNK + UART_TX_SIZE);
+    CHECK_EQ(_stats().dropped, 100 - UART_TX_CHUNK - UART_TX_SIZE + 5);
+    CHECK_EQ(_stats().overwritten, 0);
+
+    sim_dma_hold(4, 0);
+    uart_tx_flush();
+    CHECK_EQ(sim_uart_tx_len, UART_TX_CHUNK + UART_TX_SIZE);
+    CHECK(!memcmp(sim_uart_tx, _text, UART_TX_CHUNK + UART_TX_SIZE));
+}
+
+// Ring full, overwrite: the chunk on the line and the newest bytes of
+// the ring go out, the oldest ones in the ring are lost and counted
+static void tx_overwrite_full(void)
+{
+    _start(UART_TX_OVERWRITE);
+    sim_dma_hold(4, 1);
+
+    CHECK_EQ(uart_write(_text, 100), 100);
+    CHECK_EQ(_stats().queued, 100);
+    CHECK_EQ(_stats().overwritten, 100 - UART_TX_CHUNK - UART_TX_SIZE);
+    CHECK_EQ(_stats().dropped, 0);
+
+    sim_dma_hold(4, 0);
+    uart_tx_flush();
+    CHECK_EQ(sim_uart_tx_len, UART_TX_CHUNK + UART_TX_SIZE);
+    CHECK(!memcmp(sim_uart_tx, _text, UART_TX_CHUNK));
+    CHECK(!memcmp(sim_uart_tx + UART_TX_CHUNK, _text + 100 - UART_TX_SIZE, UART_TX_SIZE));
+}
+
+// Ring full, block: writes of any size wrap the ring many times, every
+// byte goes out once and in order
+static void tx_block_wrap(void)
+{
+    static const uint16_t sizes[] = {1, 7, 16, 33, 64, 65, 100, 3};
+    uint16_t len = 0;
+
+    _start(UART_TX_BLOCK);
+
+    for (uint8_t i = 0; len < TEXT_LEN - 100; i = (i + 1) % 8)
+    {
+        CHECK_EQ(uart_write(_text + len, sizes[i]), sizes[i]);
+        len += sizes[i];
+    }
+    uart_tx_flush();
+
+    CHECK_EQ(sim_uart_tx_len, len);
+    CHECK(!memcmp(sim_uart_tx, _text, len));
+    CHECK_EQ(_stats().queued, len);
+    CHECK_EQ(_stats().dropped, 0);
+    CHECK_EQ(_stats().overwritten, 0);
+    CHECK(sim_dma_arms[4] >= len / UART_TX_CHUNK);
+}
+
+// The DMA stopped with the ring empty: the next write starts it again
+static void tx_dma_restart(void)
+{
+    _start(UART_TX_BLOCK);
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        uint32_t arms = sim_dma_arms[4];
+
+        CHECK_EQ(uart_write(_text + i * 5, 5), 5);
+        CHECK_EQ(sim_dma_arms[4], arms + 1);
+        uart_tx_flush();
+        CHECK_EQ(sim_uart_tx_len, (i + 1) * 5);
+    }
+    CHECK(!memcmp(sim_uart_tx, _text, 15));
+    CHECK_EQ(sim_irq_count[DMA1_Channel4_IRQn], 3);
+}
+
+// Block from an interrupt handler: the TC interrupt cannot run, the
+// write takes the finished chunks itself and returns
+static uint16_t _isr_written;
+static uint32_t _isr_tc_before, _isr_tc_after;
+
+void TIM2_IRQHandler(void)
+{
+    _isr_tc_before = sim_irq_count[DMA1_Channel4_IRQn];
+    _isr_written = uart_write(_text + 40, 300);
+    _isr_tc_after = sim_irq_count[DMA1_Channel4_IRQn];
+}
+
+static void tx_block_in_isr(void)
+{
+    _start(UART_TX_BLOCK);
+    _isr_written = 0;
+
+    CHECK_EQ(uart_write(_text, 40), 40);
+    NVIC_EnableIRQ(TIM2_IRQn);
+    sim_irq_raise(TIM2_IRQn);
+    CHECK_EQ(sim_irq_count[TIM2_IRQn], 1);
+    CHECK_EQ(_isr_written, 300);
+    CHECK_EQ(_isr_tc_after, _isr_tc_before);
+
+    uart_tx_flush();
+    CHECK_EQ(sim_uart_tx_len, 340);
+    CHECK(!memcmp(sim_uart_tx, _text, 340));
+    CHECK_EQ(_stats().queued, 340);
+}
+
+int main(void)
+{
+    sim_init();
+
+    TEST(tx_drop_full);
+    TEST(tx_overwrite_full);
+    TEST(tx_block_wrap);
+    TEST(tx_dma_restart);
+    TEST(tx_block_in_isr);
+
+    return sim_done();
+}